@@ -263,6 +263,7 @@ static ssize_t ahci_device_read(struct cdev *cdev, void *buffer, size_t cnt, off
 
 	int bytes_read = ahci_issue_read(device, lba_start, lba_cnt, lba_buffer);
 	if(bytes_read == -1) {
+		pmm_free((uintptr_t)lba_buffer - HIGH_VMA, DIV_ROUNDUP(lba_cnt * AHCI_SECTOR_SIZE, PAGE_SIZE));
 		return -1;
 	}
 
@@ -287,12 +288,13 @@ static ssize_t ahci_device_write(struct cdev *cdev, const void *buffer, size_t c
 	memcpy(lba_buffer + (offset % AHCI_SECTOR_SIZE), buffer, cnt);
 
 	int bytes_read = ahci_issue_write(device, lba_start, lba_cnt, lba_buffer);
+
+	pmm_free((uintptr_t)lba_buffer - HIGH_VMA, DIV_ROUNDUP(lba_cnt * AHCI_SECTOR_SIZE, PAGE_SIZE));
+
 	if(bytes_read == -1) {
 		return -1;
 	}
 
-	pmm_free((uintptr_t)lba_buffer, DIV_ROUNDUP(lba_cnt * AHCI_SECTOR_SIZE, PAGE_SIZE));
-
 	return bytes_read - ABS(bytes_read, cnt);
 }
 
@@ -1,6 +1,7 @@
 #include <drivers/block.h>
 #include <fs/ext2/ext2.h>
 #include <fs/cdev.h>
+#include <mm/swap.h>
 #include <debug.h>
 
 static int register_mbr_partitions(struct blkdev *blkdev);
@@ -66,6 +67,7 @@ int register_blkdev(struct blkdev *blkdev) {
 		stat_init(stat);
 
 		stat->st_blksize = blkdev->sector_size;
+		stat->st_size = partition->lba_cnt * blkdev->sector_size;
 		stat->st_mode = S_IFCHR | S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
 		stat->st_rdev = makedev(blkdev->partition_major, blkdev->partition_minor);
 
@@ -93,6 +95,12 @@ static int detect_filesystems(struct blkdev *blkdev) {
 	struct partition *partition = blkdev->partitions;
 
 	while(partition) {
+		if(partition->type == SWAP_PARTITION_TYPE) {
+			swap_add_device(partition->cdev, partition->lba_cnt * blkdev->sector_size);
+			partition = partition->next;
+			continue;
+		}
+
 		if(ext2_init(partition) != -1) {
 			partition = partition->next;
 			continue;
@@ -130,6 +138,7 @@ static int register_mbr_partitions(struct blkdev *blkdev) {
 
 		partition->lba_start = mbr_partition->lba_start;
 		partition->lba_cnt = mbr_partition->lba_cnt;
+		partition->type = mbr_partition->type;
 
 		partition->next = blkdev->partitions;
 		blkdev->partitions = partition;
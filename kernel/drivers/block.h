@@ -35,6 +35,7 @@ struct partition {
 
 	uint64_t lba_start;
 	uint64_t lba_cnt;
+	uint8_t type;
 
 	struct partition *next;
 };
@@ -35,6 +35,13 @@ void nsleep(size_t us) {
 	}
 }
 
+uint64_t hpet_nanoseconds() {
+	uint64_t period = hpet_regs->capabilities >> 32; // femtoseconds
+	uint64_t counter = hpet_regs->counter_value;
+
+	return (counter / 1000000) * period + (counter % 1000000) * period / 1000000;
+}
+
 void hpet_init() {
 	hpet_table = acpi_find_sdt("HPET");
 	hpet_regs = (struct hpet_regs*)(hpet_table->address + HIGH_VMA);
@@ -2,12 +2,21 @@
 #include <drivers/tty/tty.h>
 #include <int/apic.h>
 #include <int/idt.h>
+#include <sched/workqueue.h>
 #include <debug.h>
 
 static void ps2_enable();
 static void ps2_disable();
 static void ps2_flush_buffer();
 
+// the handler only drains the controller, translation and the tty run from the worker
+static uint8_t ps2_scancodes[PS2_SCANCODE_BUFFER];
+static size_t ps2_scancode_head;
+static size_t ps2_scancode_tail;
+static size_t ps2_scancode_drops;
+static struct spinlock ps2_scancode_lock;
+static struct work ps2_work;
+
 static bool shift_active;
 static bool shift_lock;
 static bool ctrl_active;
@@ -65,8 +74,7 @@ static char *function_table[] = {
 	function_table_raw + 31,
 };
 
-static int ps2_get_character(char *character) {
-	uint8_t scancode = inb(KDB_PS2_DATA);
+static int ps2_get_character(uint8_t scancode, char *character) {
 	bool release = scancode & 0x80;
 
 	if(scancode == 0x2a || scancode == 0x36
@@ -154,13 +162,59 @@ noextend:
 	return -1;
 }
 
+static void ps2_push(struct tty *tty, char character, int function) {
+	tty_handle_signal(tty, character);
+
+	if(character != '\0') {
+		circular_queue_push(&tty->input_queue, &character);
+		return;
+	}
+
+	if(function == -1) {
+		return;
+	}
+
+	char *sequence = function_table[function];
+
+	for(size_t i = 0; i < strlen(sequence); i++) {
+		circular_queue_push(&tty->input_queue, &sequence[i]);
+	}
+}
+
+static void ps2_work_handler(struct work*) {
+	for(;;) {
+		spinlock_irqsave(&ps2_scancode_lock);
+
+		if(ps2_scancode_tail == ps2_scancode_head) {
+			spinrelease_irqsave(&ps2_scancode_lock);
+			return;
+		}
+
+		uint8_t scancode = ps2_scancodes[ps2_scancode_tail++ % PS2_SCANCODE_BUFFER];
+
+		spinrelease_irqsave(&ps2_scancode_lock);
+
+		struct tty *tty = active_tty;
+		if(tty == NULL) {
+			continue;
+		}
+
+		char character = '\0';
+		int function = ps2_get_character(scancode, &character);
+
+		spinlock_irqsave(&tty->input_lock);
+		ps2_push(tty, character, function);
+		spinrelease_irqsave(&tty->input_lock);
+	}
+}
+
 void ps2_handler(struct registers*, void*) {
 	if(!active_tty) {
 		ps2_flush_buffer();
 		return;
 	}
 
-	spinlock_irqsave(&active_tty->input_lock);
+	spinlock_irqsave(&ps2_scancode_lock);
 
 	for(;;) {
 		uint8_t status = inb(KDB_PS2_STATUS);
@@ -169,31 +223,23 @@ void ps2_handler(struct registers*, void*) {
 			break;
 		}
 
-		if(status & (1 << 5)) {
-			continue;
-		}
-
-		char character = '\0';
-		int function = ps2_get_character(&character);
-		tty_handle_signal(active_tty, character);
+		uint8_t scancode = inb(KDB_PS2_DATA);
 
-		if(character != '\0') {
-			circular_queue_push(&active_tty->input_queue, &character);
+		if(status & (1 << 5)) { // mouse data
 			continue;
 		}
 
-		if(function == -1) {
+		if(ps2_scancode_head - ps2_scancode_tail == PS2_SCANCODE_BUFFER) {
+			ps2_scancode_drops++;
 			continue;
 		}
 
-		char *sequence = function_table[function];
-
-		for(size_t i = 0; i < strlen(sequence); i++) {
-			circular_queue_push(&active_tty->input_queue, &sequence[i]);
-		}
+		ps2_scancodes[ps2_scancode_head++ % PS2_SCANCODE_BUFFER] = scancode;
 	}
 
-	spinrelease_irqsave(&active_tty->input_lock);
+	spinrelease_irqsave(&ps2_scancode_lock);
+
+	work_queue(&ps2_work);
 }
 
 static bool ps2_validate() {
@@ -239,6 +285,8 @@ void ps2_init() {
 	ps2_disable();
 	ps2_flush_buffer();
 
+	work_init(&ps2_work, ps2_work_handler, NULL);
+
 	int ps2_vector = idt_alloc_vector(ps2_handler, NULL);
 	ioapic_set_irq_redirection(xapic_read(XAPIC_ID_REG_OFF), ps2_vector, 1, false);
 
@@ -4,4 +4,6 @@
 #define KDB_PS2_STATUS 0x64
 #define KDB_PS2_COMMAND 0x64
 
+#define PS2_SCANCODE_BUFFER 64 // scancodes the handler holds until the worker gets to them
+
 void ps2_init();
@@ -1,3 +0,0 @@
-#pragma once
-
-void pit_init();
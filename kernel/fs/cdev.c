@@ -28,6 +28,13 @@ int cdev_open(struct vfs_node *node, struct file_handle *file) {
 	return 0;
 }
 
+struct cdev *cdev_search(dev_t dev) {
+	spinlock_irqsave(&cdev_lock);
+	struct cdev *cdev = hash_table_search(&cdev_list, &dev, sizeof(dev_t));
+	spinrelease_irqsave(&cdev_lock);
+	return cdev;
+}
+
 int cdev_register(struct cdev *cdev) {
 	spinlock_irqsave(&cdev_lock);
 	struct cdev *aux = hash_table_search(&cdev_list, &cdev->rdev, sizeof(dev_t));
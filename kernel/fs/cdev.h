@@ -25,4 +25,5 @@ struct cdev {
 int cdev_open(struct vfs_node *node, struct file_handle *file);
 
 int cdev_register(struct cdev *cdev);
+struct cdev *cdev_search(dev_t dev);
 int cdev_unregister(dev_t dev);
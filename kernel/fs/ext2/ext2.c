@@ -1,5 +1,6 @@
 #include <fs/ext2/ext2.h>
 #include <fs/fd.h>
+#include <sched/preempt.h>
 #include <debug.h>
 
 static struct vfs_node *ext2_create(struct vfs_node *parent, const char *name, struct stat *stat);
@@ -222,6 +223,8 @@ static int ext2_refresh(struct vfs_node *dir) {
 		}
 
 		file = file->next;
+
+		cond_resched(); // every entry costs an inode read, large directories take a while
 	}
 
 	return 0;
@@ -2,6 +2,7 @@
 #include <vector.h>
 #include <cpu.h>
 #include <sched/sched.h>
+#include <sched/preempt.h>
 #include <errno.h>
 #include <bitmap.h>
 #include <string.h>
@@ -139,16 +140,16 @@ int stat_has_access(struct stat *stat, uid_t uid, gid_t gid, int mode) {
 }
 
 int stat_update_time(struct stat *stat, int flags) {
-	if(flags & STAT_ACCESS) stat->st_atim = clock_realtime;
-	if(flags & STAT_MOD) stat->st_mtim = clock_realtime;
-	if(flags & STAT_STATUS) stat->st_ctim = clock_realtime;
+	if(flags & STAT_ACCESS) stat->st_atim = clock_get(CLOCK_REALTIME);
+	if(flags & STAT_MOD) stat->st_mtim = clock_get(CLOCK_REALTIME);
+	if(flags & STAT_STATUS) stat->st_ctim = clock_get(CLOCK_REALTIME);
 
 	return 0;
 }
 
 static struct fd_handle *fd_translate_unlocked(int index) {
 	struct task *current_task = CURRENT_TASK;
-	return hash_table_search(&current_task->fd_table->fd_list, &index, sizeof(index));
+	return index < 0 ? NULL : idr_find(&current_task->fd_table->fd_list, index);
 }
 
 struct fd_handle *fd_translate(int index) {
@@ -164,6 +165,28 @@ struct fd_handle *fd_translate(int index) {
 	return handle;
 }
 
+// the file stays valid until the matching file_put even if the fd gets closed meanwhile
+struct file_handle *fd_file_get(int index) {
+	struct task *current_task = CURRENT_TASK;
+	if(current_task == NULL) {
+		return NULL;
+	}
+
+	spinlock_irqsave(&current_task->fd_table->fd_lock);
+
+	struct fd_handle *handle = fd_translate_unlocked(index);
+	struct file_handle *file = NULL;
+
+	if(handle) {
+		file = handle->file_handle;
+		file_get(file);
+	}
+
+	spinrelease_irqsave(&current_task->fd_table->fd_lock);
+
+	return file;
+}
+
 off_t fd_seek(int fd, off_t offset, int whence) {
 	struct fd_handle *fd_handle = fd_translate(fd);
 	if(fd_handle == NULL) {
@@ -307,7 +330,7 @@ ssize_t pipe_read(struct file_handle *file, void *buf, size_t cnt, off_t offset)
 		cnt = stat->st_size - offset;
 	}
 
-	memcpy8(buf, out + offset, cnt);
+	copy_resched(buf, out + offset, cnt);
 	offset += cnt;
 
 	return cnt;
@@ -337,7 +360,7 @@ ssize_t pipe_write(struct file_handle *file, const void *buf, size_t cnt, off_t
 		stat->st_size += offset + cnt - stat->st_size;
 	}
 
-	memcpy8(out + offset, buf, cnt);
+	copy_resched(out + offset, buf, cnt);
 
 	return cnt;
 }
@@ -468,19 +491,20 @@ int fd_openat(int dirfd, const char *path, int flags, mode_t mode) {
 
 	stat_update_time(vfs_node->stat, STAT_ACCESS);
 
-	struct fd_handle *new_fd_handle = alloc(sizeof(struct fd_handle));
-	fd_init(new_fd_handle);
-	new_fd_handle->fd_number = bitmap_alloc(&CURRENT_TASK->fd_table->fd_bitmap);
-	new_fd_handle->file_handle = new_file_handle;
-	new_fd_handle->flags = (flags & O_CLOEXEC) ? FD_CLOEXEC : 0;
-
 	struct task *current_task = CURRENT_TASK;
 	if(current_task == NULL) {
 		set_errno(ENOENT);
 		return -1;
 	}
 
-	hash_table_push(&current_task->fd_table->fd_list, &new_fd_handle->fd_number, new_fd_handle, sizeof(new_fd_handle->fd_number));
+	struct fd_handle *new_fd_handle = alloc(sizeof(struct fd_handle));
+	fd_init(new_fd_handle);
+	new_fd_handle->file_handle = new_file_handle;
+	new_fd_handle->flags = (flags & O_CLOEXEC) ? FD_CLOEXEC : 0;
+
+	spinlock_irqsave(&current_task->fd_table->fd_lock);
+	new_fd_handle->fd_number = idr_alloc(&current_task->fd_table->fd_list, new_fd_handle);
+	spinrelease_irqsave(&current_task->fd_table->fd_lock);
 
 	return new_fd_handle->fd_number;
 }
@@ -493,8 +517,7 @@ static void fd_close_unlocked(struct fd_handle *handle) {
 		handle->file_handle->ops->close(handle->file_handle->vfs_node, handle->file_handle);
 
 	file_put(handle->file_handle);
-	hash_table_delete(&current_task->fd_table->fd_list, &handle->fd_number, sizeof(handle->fd_number));
-	bitmap_free(&current_task->fd_table->fd_bitmap, handle->fd_number);
+	idr_remove(&current_task->fd_table->fd_list, handle->fd_number);
 	free(handle);
 }
 
@@ -602,7 +625,7 @@ int fd_dup(int fd, bool clear_cloexec) {
 
 	struct fd_handle *handle = alloc(sizeof(struct fd_handle));
 	*handle = *fd_handle;
-	handle->fd_number = bitmap_alloc(&current_task->fd_table->fd_bitmap);
+	handle->fd_number = idr_alloc(&current_task->fd_table->fd_list, handle);
 
 	if (clear_cloexec)
 		handle->flags &= ~FD_CLOEXEC;
@@ -610,7 +633,6 @@ int fd_dup(int fd, bool clear_cloexec) {
 		handle->flags |= FD_CLOEXEC;
 
 	file_get(handle->file_handle);
-	hash_table_push(&current_task->fd_table->fd_list, &handle->fd_number, handle, sizeof(handle->fd_number));
 	spinrelease_irqsave(&current_task->fd_table->fd_lock);
 
 	return handle->fd_number;
@@ -638,13 +660,12 @@ int fd_dup2(int oldfd, int newfd) {
 	new_handle->flags &= ~FD_CLOEXEC;
 	file_get(new_handle->file_handle);
 
-	if(BIT_TEST(current_task->fd_table->fd_bitmap.data, newfd)) {
-		fd_close_unlocked(fd_translate_unlocked(newfd));
+	struct fd_handle *open_handle = fd_translate_unlocked(newfd);
+	if(open_handle) {
+		fd_close_unlocked(open_handle);
 	}
 
-	BIT_SET(current_task->fd_table->fd_bitmap.data, newfd);
-
-	hash_table_push(&current_task->fd_table->fd_list, &new_handle->fd_number, new_handle, sizeof(new_handle->fd_number));
+	idr_insert(&current_task->fd_table->fd_list, newfd, new_handle);
 
 	spinrelease_irqsave(&current_task->fd_table->fd_lock);
 
@@ -738,10 +759,6 @@ int fd_fchownat(int fd, const char *path, uid_t uid, gid_t gid, int flag) {
 int fd_poll(struct pollfd *fds, nfds_t nfds, struct timespec *timespec) {
 	struct waitq waitq = { 0 };
 
-	if(timespec) {
-		waitq_set_timer(&waitq, *timespec);
-	}
-
 	VECTOR(struct file_handle*) handle_list = { 0 };
 
 	for(size_t i = 0; i < nfds; i++) {
@@ -764,11 +781,21 @@ int fd_poll(struct pollfd *fds, nfds_t nfds, struct timespec *timespec) {
 			waitq_add(&waitq, file_handle->trigger);
 			VECTOR_PUSH(handle_list, file_handle);
 		} else {
-			print("poll: unrecognised event type {%x}\n", type);
+			klog_ratelimited(KLOG_WARN, "poll: unrecognised event type {%x}\n", type);
 		}
 	}
 
+	// armed only once nothing can bail out early, the waitq lives on this stack
+	if(timespec) {
+		waitq_set_timer(&waitq, *timespec);
+	}
+
 	int ret = waitq_wait(&waitq, EVENT_ANY);
+
+	if(timespec) {
+		waitq_clear_timer(&waitq);
+	}
+
 	if(ret == -1) {
 		return -1;
 	}
@@ -795,7 +822,7 @@ void syscall_dup2(struct registers *regs) {
 	int oldfd = regs->rdi;
 	int newfd = regs->rsi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] dup2: oldfd {%x}, newfd {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, oldfd, newfd);
 #endif
 
@@ -805,7 +832,7 @@ void syscall_dup2(struct registers *regs) {
 void syscall_dup(struct registers *regs) {
 	int fd = regs->rdi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] dup: fd {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd);
 #endif
 
@@ -816,7 +843,7 @@ void syscall_stat(struct registers *regs) {
 	int fd = regs->rdi;
 	void *buf = (void*)regs->rsi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] stat: fd {%x}, buf {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, (uintptr_t)buf);
 #endif
 
@@ -829,7 +856,7 @@ void syscall_statat(struct registers *regs) {
 	void *buf = (void*)regs->rdx;
 	int flags = regs->r10;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] statat: dirfd {%x}, path {%s}, buf {%x}, flags {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, dirfd, path, (uintptr_t)buf, flags);
 #endif
 
@@ -841,7 +868,7 @@ void syscall_write(struct registers *regs) {
 	const void *buf = (const void*)regs->rsi;
 	size_t cnt = regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] write: fd {%x}, buf {%x}, cnt {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, (uintptr_t)buf, cnt);
 #endif
 
@@ -853,7 +880,7 @@ void syscall_read(struct registers *regs) {
 	void *buf = (void*)regs->rsi;
 	size_t cnt = regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] read: fd {%x}, buf {%x}, cnt {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, (uintptr_t)buf, cnt);
 #endif
 
@@ -865,7 +892,7 @@ void syscall_seek(struct registers *regs) {
 	off_t offset = regs->rsi;
 	int whence = regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] seek: fd {%x}, offset {%x}, whence {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, offset, whence);
 #endif
 
@@ -878,7 +905,7 @@ void syscall_openat(struct registers *regs) {
 	int flags = regs->rdx;
 	mode_t mode = regs->r10;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] open: dirfd {%x}, pathname {%s}, flags {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, dirfd, pathname, flags);
 #endif
 
@@ -888,7 +915,7 @@ void syscall_openat(struct registers *regs) {
 void syscall_close(struct registers *regs) {
 	int fd = regs->rdi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] close: fd {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd);
 #endif
 
@@ -896,7 +923,7 @@ void syscall_close(struct registers *regs) {
 }
 
 void syscall_fcntl(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] fcntl: fd {%x}, cmd {%x}, data {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, regs->rdi, regs->rsi, regs->rdx);
 #endif
 
@@ -944,7 +971,7 @@ void syscall_fcntl(struct registers *regs) {
 			break;
 		}
 		default:
-			print("fnctl unknown command %x\n", regs->rsi);
+			klog_ratelimited(KLOG_WARN, "fcntl: unknown command %x\n", regs->rsi);
 			set_errno(EINVAL);
 			regs->rax = -1;
 	}
@@ -954,7 +981,7 @@ void syscall_readdir(struct registers *regs) {
 	int fd = regs->rdi;
 	struct dirent *buf = (void*)regs->rsi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] readdir: fd {%x}, buf {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, (uintptr_t)buf);
 #endif
 
@@ -969,7 +996,6 @@ void syscall_readdir(struct registers *regs) {
 
 	if(!S_ISDIR(dir->stat->st_mode)) {
 		set_errno(ENOTDIR);
-		print("returingin here\n");
 		regs->rax = -1;
 		return;
 	}
@@ -1011,7 +1037,7 @@ void syscall_getcwd(struct registers *regs) {
 	char *buf = (void*)regs->rdi;
 	size_t size = regs->rsi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getcwd: buf {%x}, size {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, buf, size);
 #endif
 
@@ -1030,7 +1056,7 @@ void syscall_getcwd(struct registers *regs) {
 void syscall_chdir(struct registers *regs) {
 	const char *path = (const char*)regs->rdi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] chdir: path {%s}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, path);
 #endif
 
@@ -1048,13 +1074,10 @@ void syscall_chdir(struct registers *regs) {
 void syscall_pipe(struct registers *regs) {
 	int *fd_pair = (int*)regs->rdi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] pipe: fd pair {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd_pair);
 #endif
 
-	fd_pair[0] = bitmap_alloc(&CURRENT_TASK->fd_table->fd_bitmap);
-	fd_pair[1] = bitmap_alloc(&CURRENT_TASK->fd_table->fd_bitmap);
-
 	struct fd_handle *read_fd_handle = alloc(sizeof(struct fd_handle));
 	struct fd_handle *write_fd_handle = alloc(sizeof(struct fd_handle));
 	struct file_handle *read_file_handle = alloc(sizeof(struct file_handle));
@@ -1084,14 +1107,12 @@ void syscall_pipe(struct registers *regs) {
 
 	// Do we want to support full duplex pipes? If so,
 	// make both ends readable and writable.
-	read_fd_handle->fd_number = fd_pair[0];
 	read_fd_handle->file_handle = read_file_handle;
 	read_file_handle->ops = read_ops;
 	read_file_handle->pipe = pipe;
 	read_file_handle->flags = O_RDONLY;
 	read_file_handle->stat = pipe_stat;
 
-	write_fd_handle->fd_number = fd_pair[1];
 	write_fd_handle->file_handle = write_file_handle;
 	write_file_handle->ops = write_ops;
 	write_file_handle->pipe = pipe;
@@ -1101,10 +1122,13 @@ void syscall_pipe(struct registers *regs) {
 	stat_update_time(pipe_stat, STAT_ACCESS | STAT_MOD | STAT_STATUS);
 
 	spinlock_irqsave(&CURRENT_TASK->fd_table->fd_lock);
-	hash_table_push(&CURRENT_TASK->fd_table->fd_list, &read_fd_handle->fd_number, read_fd_handle, sizeof(read_fd_handle->fd_number));
-	hash_table_push(&CURRENT_TASK->fd_table->fd_list, &write_fd_handle->fd_number, write_fd_handle, sizeof(write_fd_handle->fd_number));
+	read_fd_handle->fd_number = idr_alloc(&CURRENT_TASK->fd_table->fd_list, read_fd_handle);
+	write_fd_handle->fd_number = idr_alloc(&CURRENT_TASK->fd_table->fd_list, write_fd_handle);
 	spinrelease_irqsave(&CURRENT_TASK->fd_table->fd_lock);
 
+	fd_pair[0] = read_fd_handle->fd_number;
+	fd_pair[1] = write_fd_handle->fd_number;
+
 	regs->rax = 0;
 }
 
@@ -1114,7 +1138,7 @@ void syscall_faccessat(struct registers *regs) {
 	int mode = regs->rdx;
 	int flags = regs->r10;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] faccessat: dirfd {%x}, path {%s}, mode {%x}, flags {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, dirfd, path, mode, flags);
 #endif
 
@@ -1143,7 +1167,7 @@ void syscall_symlinkat(struct registers *regs) {
 	int newdirfd = regs->rsi;
 	const char *linkpath = (const char*)regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] symlink: target {%s}, newdirfd {%x}, linkpath {%s}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, target, newdirfd, linkpath);
 #endif
 
@@ -1188,7 +1212,7 @@ void syscall_ioctl(struct registers *regs) {
 	uint64_t req = regs->rsi;
 	void *args = (void*)regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] ioctl: fd {%x}, req {%x}, args {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, req, args);
 #endif
 
@@ -1211,7 +1235,7 @@ void syscall_ioctl(struct registers *regs) {
 void syscall_umask(struct registers *regs) {
 	mode_t mask = regs->rdi & 0777;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] umask: mask {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, mask);
 #endif
 
@@ -1237,7 +1261,7 @@ void syscall_fchmod(struct registers *regs) {
 	int fd = regs->rdi;
 	mode_t mode = regs->rsi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] fchmod: fd {%x}, mode {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, mode);
 #endif
 
@@ -1257,7 +1281,7 @@ void syscall_fchmodat(struct registers *regs) {
 	mode_t mode = regs->rdx;
 	int flags = regs->r10;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] fchmodat: fd {%x}, path {%s}, mode {%x}, flags {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, path, mode, flags);
 #endif
 
@@ -1279,7 +1303,7 @@ void syscall_fchownat(struct registers *regs) {
 	gid_t gid = regs->r10;
 	int flag = regs->r8;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] fchownat: fd {%x}, path {%s}, uid {%x}, gid {%x}, flag {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, path, uid, gid, flag);
 #endif
 
@@ -1291,7 +1315,7 @@ void syscall_poll(struct registers *regs) {
 	nfds_t nfds = regs->rsi;
 	int timeout = regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] poll: fds {%x}, nfds {%x}, timeout {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fds, nfds, timeout);
 #endif
 
@@ -1311,7 +1335,7 @@ void syscall_ppoll(struct registers *regs) {
 	struct timespec *timespec = (void*)regs->rdx;
 	sigset_t *sigmask = (void*)regs->r10;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] ppoll: fds {%x}, nfds {%x}, timespec {%x}, sigmask {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fds, nfds, timespec, sigmask);
 #endif
 
@@ -7,6 +7,7 @@
 #include <sched/sched.h>
 #include <sched/queue.h>
 #include <bitmap.h>
+#include <idr.h>
 #include <lock.h>
 
 #define PIPE_BUFFER_SIZE 0x10000
@@ -53,8 +54,7 @@ struct fd_handle {
 
 struct fd_table {
 	struct spinlock fd_lock;
-	struct hash_table fd_list;
-	struct bitmap fd_bitmap;
+	struct idr fd_list; // lowest free number first, as posix wants
 	int refcnt;
 };
 
@@ -73,11 +73,11 @@ struct file_ops {
 	int (*ioctl)(struct file_handle *, uint64_t, void *);
 	int (*truncate)(struct file_handle *, off_t);
 	void *(*shared)(struct file_handle *, void *, off_t);
+	void (*release)(struct file_handle *); // the last reference is gone, close runs on every fd instead
 };
 
 static inline void fd_table_init(struct fd_table *table) {
 	memset(table, 0, sizeof(*table));
-	table->fd_bitmap.resizable = true;
 	table->refcnt = 1;
 }
 
@@ -112,17 +112,23 @@ static inline void file_get(struct file_handle *handle) {
 }
 
 static inline void file_put(struct file_handle *handle) {
-	if (__atomic_sub_fetch(&handle->refcnt, 1, __ATOMIC_RELAXED) == 0)
+	if (__atomic_sub_fetch(&handle->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+		if (handle->ops && handle->ops->release)
+			handle->ops->release(handle);
 		free(handle);
+	}
 }
 
 int stat_has_access(struct stat *stat, uid_t uid, gid_t gid, int mode);
 int stat_update_time(struct stat *stat, int flags);
 struct fd_handle *fd_translate(int index);
+struct file_handle *fd_file_get(int index);
 ssize_t fd_write(int fd, const void *buf, size_t count);
 ssize_t fd_read(int fd, void *buf, size_t count);
 off_t fd_seek(int fd, off_t offset, int whence);
+int fd_poll(struct pollfd *fds, nfds_t nfds, struct timespec *timespec);
 int fd_openat(int dirfd, const char *path, int flags, mode_t mode);
 int fd_close(int fd);
+int fd_statat(int dirfd, const char *path, void *buffer, int flags);
 int fd_generate_dirent(struct fd_handle *dir_handle, struct vfs_node *node, struct dirent *entry);
 int fd_fchownat(int fd, const char *path, uid_t uid, gid_t gid, int flag);
@@ -6,6 +6,7 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include <sched/preempt.h>
 
 struct hash_table ramfs_node_list;
 
@@ -70,7 +71,27 @@ ssize_t ramfs_read(struct file_handle *file, void *buf, size_t cnt, off_t offset
 		cnt = stat->st_size - offset;
 	}
 
-	memcpy8(buf, ramfs_handle->buffer + offset, cnt);
+	// the node stays locked for one chunk at a time so large copies have preemption points
+	for(size_t done = 0; done < cnt;) {
+		size_t chunk = cnt - done < PREEMPT_COPY_CHUNK ? cnt - done : PREEMPT_COPY_CHUNK;
+
+		memcpy8(buf + done, ramfs_handle->buffer + offset + done, chunk);
+		done += chunk;
+
+		if(done == cnt) {
+			break;
+		}
+
+		node_unlock(file->vfs_node);
+		cond_resched();
+		node_lock(file->vfs_node);
+
+		if(offset + done >= stat->st_size) { // truncated in between
+			cnt = done;
+		} else if(offset + cnt > stat->st_size) {
+			cnt = stat->st_size - offset;
+		}
+	}
 
 	node_unlock(file->vfs_node);
 	return cnt;
@@ -95,7 +116,24 @@ ssize_t ramfs_write(struct file_handle *file, const void *buf, size_t cnt, off_t
 		ramfs_handle->buffer = realloc(ramfs_handle->buffer, stat->st_size);
 	}
 
-	memcpy8(ramfs_handle->buffer + offset, buf, cnt);
+	for(size_t done = 0; done < cnt;) {
+		size_t chunk = cnt - done < PREEMPT_COPY_CHUNK ? cnt - done : PREEMPT_COPY_CHUNK;
+
+		memcpy8(ramfs_handle->buffer + offset + done, buf + done, chunk);
+		done += chunk;
+
+		if(done == cnt) {
+			break;
+		}
+
+		node_unlock(file->vfs_node);
+		cond_resched();
+		node_lock(file->vfs_node);
+
+		if(offset + cnt > stat->st_size) { // truncated in between, the rest has nowhere to go
+			cnt = done;
+		}
+	}
 
 	node_unlock(file->vfs_node);
 	return cnt;
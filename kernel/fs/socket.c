@@ -119,7 +119,6 @@ static struct fd_handle *create_sockfd(struct socket *socket, struct file_handle
 	fd_init(socket_fd_handle);
 
 	socket_fd_handle->file_handle = socket_file_handle;
-	socket_fd_handle->fd_number = bitmap_alloc(&CURRENT_TASK->fd_table->fd_bitmap);
 
 	socket->fd_handle = socket_fd_handle;
 	socket->file_handle = socket_file_handle;
@@ -127,7 +126,7 @@ static struct fd_handle *create_sockfd(struct socket *socket, struct file_handle
 	stat_update_time(socket_file_handle->stat, STAT_ACCESS | STAT_MOD | STAT_STATUS);
 
 	spinlock_irqsave(&CURRENT_TASK->fd_table->fd_lock);
-	hash_table_push(&CURRENT_TASK->fd_table->fd_list, &socket_fd_handle->fd_number, socket_fd_handle, sizeof(socket_fd_handle->fd_number));
+	socket_fd_handle->fd_number = idr_alloc(&CURRENT_TASK->fd_table->fd_list, socket_fd_handle);
 	spinrelease_irqsave(&CURRENT_TASK->fd_table->fd_lock);
 
 	return socket_fd_handle;
@@ -138,7 +137,7 @@ void syscall_socket(struct registers *regs) {
 	int type = regs->rsi;
 	int protocol = regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] socket: family {%x}, type {%x}, protocol {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, family, type, protocol);
 #endif
 
@@ -169,7 +168,7 @@ void syscall_getsockname(struct registers *regs) {
 	struct socketaddr *addr = (void*)regs->rsi;
 	socklen_t *addrlen = (void*)regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getsockname: sockfd {%x}, addr {%x}, addrlen {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, sockfd, addr, addrlen);
 #endif
 
@@ -188,7 +187,7 @@ void syscall_getpeername(struct registers *regs) {
 	struct socketaddr *addr = (void*)regs->rsi;
 	socklen_t *addrlen = (void*)regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getpeername: sockfd {%x}, addr {%x}, addrlen {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, sockfd, addr, addrlen);
 #endif
 
@@ -206,7 +205,7 @@ void syscall_listen(struct registers *regs) {
 	int sockfd = regs->rdi;
 	int backlog = regs->rsi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] backlog: sockfd {%x}, backlog {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, sockfd, backlog);
 #endif
 
@@ -225,7 +224,7 @@ void syscall_accept(struct registers *regs) {
 	struct socketaddr *addr = (void*)regs->rsi;
 	socklen_t *addrlen = (void*)regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] accept: sockfd {%x}, addr {%x}, addrlen {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, sockfd, addr, addrlen);
 #endif
 
@@ -244,7 +243,7 @@ void syscall_bind(struct registers *regs) {
 	const struct socketaddr *addr = (void*)regs->rsi;
 	socklen_t addrlen = regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] bind: sockfd {%x}, addr {%x}, addrlen {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, sockfd, addr, addrlen);
 #endif
 
@@ -263,10 +262,10 @@ void syscall_sendto(struct registers *regs) {
 	const void *buf = (void*)regs->rsi;
 	size_t len = regs->rdx;
 	int flags = regs->r10;
-	const struct sockaddr *dest = (void*)regs->r10;
+	const struct sockaddr *dest = (void*)regs->r8;
 	socklen_t addrlen = regs->r9;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] sendto: sockfd {%x}, buf {%x}, len {%x}, flags {%x}, dest {%x}, addrlen {%x}\n", sockfd, buf, len, flags, dest, addrlen);
 #endif
 
@@ -301,10 +300,10 @@ void syscall_recvfrom(struct registers *regs) {
 	void *buf = (void*)regs->rsi;
 	size_t len = regs->rdx;
 	int flags = regs->r10;
-	struct socketaddr *src = (void*)regs->r10;
+	struct socketaddr *src = (void*)regs->r8;
 	socklen_t *addrlen = (void*)regs->r9;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] recvfrom: sockfd {%x}, buf {%x}, len {%x}, flags {%x}, src {%x}, addrlen {%x}\n", sockfd, buf, len, flags, src, addrlen);
 #endif
 
@@ -338,7 +337,7 @@ void syscall_connect(struct registers *regs) {
 	const struct socketaddr *addr = (void*)regs->rsi;
 	socklen_t addrlen = regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] connect: sockfd {%x}, addr {%x}, addrlen {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, sockfd, addr, addrlen);
 #endif
 
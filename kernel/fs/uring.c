@@ -0,0 +1,318 @@
+#include <fs/uring.h>
+#include <fs/fd.h>
+#include <mm/mmap.h>
+#include <sched/sched.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+#include <cpu.h>
+
+// sockets keep their logic in the syscall handlers, entries for them go through a register frame
+extern void syscall_accept(struct registers*);
+extern void syscall_sendto(struct registers*);
+extern void syscall_recvfrom(struct registers*);
+
+static void uring_release(struct file_handle *handle);
+
+static struct file_ops uring_ops = {
+	.release = uring_release
+};
+
+// an enter in progress holds its own reference, so this only runs once the last batch is done
+static void uring_release(struct file_handle *handle) {
+	// the rings are ordinary memory of the process, they go away with its mappings
+	free(handle->private_data);
+	free(handle->stat);
+}
+
+// runs one entry the way the matching syscall would, on the caller's fd table and address space
+static int64_t uring_issue(struct io_uring_sqe *sqe) {
+	struct registers regs = { 0 };
+	int64_t ret;
+
+	set_errno(0);
+
+	switch(sqe->opcode) {
+		case IORING_OP_NOP:
+			return 0;
+		case IORING_OP_READ:
+		case IORING_OP_WRITE:
+			// there is no pread, an offset moves the file position like a seek would
+			if(sqe->off != (uint64_t)-1 && fd_seek(sqe->fd, sqe->off, SEEK_SET) == -1) {
+				ret = -1;
+				break;
+			}
+
+			if(sqe->opcode == IORING_OP_READ) {
+				ret = fd_read(sqe->fd, (void*)sqe->addr, sqe->len);
+			} else {
+				ret = fd_write(sqe->fd, (const void*)sqe->addr, sqe->len);
+			}
+
+			break;
+		case IORING_OP_OPENAT:
+			ret = fd_openat(sqe->fd, (const char*)sqe->addr, sqe->op_flags, sqe->len);
+			break;
+		case IORING_OP_CLOSE:
+			ret = fd_close(sqe->fd);
+			break;
+		case IORING_OP_POLL: {
+			// fd_poll only waits for input, anything else would sleep forever
+			if(sqe->op_flags != POLLIN) {
+				set_errno(EINVAL);
+				ret = -1;
+				break;
+			}
+
+			struct pollfd pollfd = { .fd = sqe->fd, .events = sqe->op_flags };
+
+			ret = fd_poll(&pollfd, 1, NULL);
+			if(ret != -1) {
+				ret = pollfd.revents;
+			}
+
+			break;
+		}
+		case IORING_OP_ACCEPT:
+			regs.rdi = sqe->fd;
+			regs.rsi = sqe->addr;
+			regs.rdx = sqe->addr2;
+			syscall_accept(&regs);
+			ret = regs.rax;
+			break;
+		case IORING_OP_SENDTO:
+		case IORING_OP_RECVFROM:
+			regs.rdi = sqe->fd;
+			regs.rsi = sqe->addr;
+			regs.rdx = sqe->len;
+			regs.r10 = sqe->op_flags;
+			regs.r8 = sqe->addr2;
+			regs.r9 = sqe->off;
+
+			if(sqe->opcode == IORING_OP_SENDTO) {
+				syscall_sendto(&regs);
+			} else {
+				syscall_recvfrom(&regs);
+			}
+
+			ret = regs.rax;
+			break;
+		case IORING_OP_FSYNC:
+			// writes go straight to the filesystem, there is nothing buffered to flush
+			if(fd_translate(sqe->fd) == NULL) {
+				set_errno(EBADF);
+				ret = -1;
+			} else {
+				ret = 0;
+			}
+
+			break;
+		default:
+			set_errno(EINVAL);
+			ret = -1;
+	}
+
+	return ret == -1 ? -(int64_t)get_errno() : ret;
+}
+
+static int uring_setup(uint32_t entries, struct io_uring_params *params) {
+	if(entries == 0 || entries > IORING_MAX_ENTRIES || params == NULL) {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	struct task *current_task = CURRENT_TASK;
+
+	uint32_t sq_entries = pow2_roundup(entries);
+	uint32_t cq_entries = sq_entries * 2;
+
+	size_t sq_off = ALIGN_UP(sizeof(struct io_uring_rings), 64);
+	size_t cq_off = sq_off + sq_entries * sizeof(struct io_uring_sqe);
+	size_t size = ALIGN_UP(cq_off + cq_entries * sizeof(struct io_uring_cqe), PAGE_SIZE);
+
+	// the rings are plain anonymous memory of the caller, the kernel only touches them from its enter calls
+	void *base = mmap(current_task->page_table, NULL, size, MMAP_PROT_READ | MMAP_PROT_WRITE | MMAP_PROT_USER,
+		MMAP_MAP_PRIVATE | MMAP_MAP_ANONYMOUS, -1, 0);
+	if(base == MMAP_MAP_FAILED) {
+		return -1;
+	}
+
+	struct uring *ring = alloc(sizeof(struct uring));
+
+	*ring = (struct uring) {
+		.page_table = current_task->page_table,
+		.rings = base,
+		.sqes = base + sq_off,
+		.cqes = base + cq_off,
+		.sq_entries = sq_entries,
+		.cq_entries = cq_entries
+	};
+
+	*ring->rings = (struct io_uring_rings) {
+		.sq_mask = sq_entries - 1,
+		.sq_entries = sq_entries,
+		.cq_mask = cq_entries - 1,
+		.cq_entries = cq_entries
+	};
+
+	struct fd_handle *fd_handle = alloc(sizeof(struct fd_handle));
+	struct file_handle *file_handle = alloc(sizeof(struct file_handle));
+
+	fd_init(fd_handle);
+	file_init(file_handle);
+
+	struct stat *stat = alloc(sizeof(struct stat));
+	stat_init(stat);
+	stat->st_mode = S_IRUSR | S_IWUSR;
+
+	file_handle->ops = &uring_ops;
+	file_handle->flags = O_RDWR;
+	file_handle->stat = stat;
+	file_handle->private_data = ring;
+	fd_handle->file_handle = file_handle;
+
+	spinlock_irqsave(&current_task->fd_table->fd_lock);
+	fd_handle->fd_number = idr_alloc(&current_task->fd_table->fd_list, fd_handle);
+	spinrelease_irqsave(&current_task->fd_table->fd_lock);
+
+	params->sq_entries = sq_entries;
+	params->cq_entries = cq_entries;
+	params->sq_off = sq_off;
+	params->cq_off = cq_off;
+	params->ring = (uintptr_t)base;
+	params->ring_size = size;
+
+	return fd_handle->fd_number;
+}
+
+// claims the next submission entry together with room for its completion, false when either ring is in the way
+static bool uring_claim(struct uring *ring, struct io_uring_sqe *sqe, bool *cq_full) {
+	spinlock_irqsave(&ring->lock);
+
+	uint32_t sq_tail = __atomic_load_n(&ring->rings->sq_tail, __ATOMIC_ACQUIRE);
+	uint32_t pending = sq_tail - ring->sq_head;
+
+	if(pending == 0 || pending > ring->sq_entries) {
+		spinrelease_irqsave(&ring->lock);
+		return false;
+	}
+
+	uint32_t cq_head = __atomic_load_n(&ring->rings->cq_head, __ATOMIC_ACQUIRE);
+	uint32_t cq_used = ring->cq_tail - cq_head;
+
+	if(cq_used > ring->cq_entries || cq_used + ring->cq_inflight >= ring->cq_entries) {
+		*cq_full = true;
+		spinrelease_irqsave(&ring->lock);
+		return false;
+	}
+
+	*sqe = ring->sqes[ring->sq_head & (ring->sq_entries - 1)];
+
+	ring->sq_head++;
+	ring->cq_inflight++;
+
+	__atomic_store_n(&ring->rings->sq_head, ring->sq_head, __ATOMIC_RELEASE); // the slot can be refilled now
+
+	spinrelease_irqsave(&ring->lock);
+
+	return true;
+}
+
+static void uring_complete(struct uring *ring, uint64_t user_data, int64_t res) {
+	spinlock_irqsave(&ring->lock);
+
+	ring->cqes[ring->cq_tail & (ring->cq_entries - 1)] = (struct io_uring_cqe) {
+		.user_data = user_data,
+		.res = res
+	};
+
+	ring->cq_tail++;
+	ring->cq_inflight--;
+
+	__atomic_store_n(&ring->rings->cq_tail, ring->cq_tail, __ATOMIC_RELEASE);
+
+	spinrelease_irqsave(&ring->lock);
+}
+
+// entries run in order on the caller and have their completion posted before enter returns,
+// so IORING_ENTER_GETEVENTS never has anything left to wait for
+static int uring_enter(int fd, uint32_t to_submit, uint32_t, int flags) {
+	if(flags & ~IORING_ENTER_GETEVENTS) {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	// held for the whole batch, an entry may close the ring's fd
+	struct file_handle *file_handle = fd_file_get(fd);
+	if(file_handle == NULL) {
+		set_errno(EBADF);
+		return -1;
+	}
+
+	if(file_handle->ops != &uring_ops) {
+		file_put(file_handle);
+		set_errno(EOPNOTSUPP);
+		return -1;
+	}
+
+	struct uring *ring = file_handle->private_data;
+
+	// a forked child or an exec'd image has the fd but not these rings
+	if(ring->page_table != CURRENT_TASK->page_table) {
+		file_put(file_handle);
+		set_errno(EBADF);
+		return -1;
+	}
+
+	uint32_t submitted = 0;
+	bool cq_full = false;
+	bool link_failed = false;
+
+	while(submitted < to_submit) {
+		struct io_uring_sqe sqe;
+
+		if(!uring_claim(ring, &sqe, &cq_full)) {
+			break;
+		}
+
+		int64_t res = link_failed ? -ECANCELED : uring_issue(&sqe);
+
+		link_failed = (sqe.flags & IOSQE_IO_LINK) && res < 0;
+
+		uring_complete(ring, sqe.user_data, res);
+		submitted++;
+	}
+
+	file_put(file_handle);
+
+	if(submitted == 0 && to_submit && cq_full) {
+		set_errno(EBUSY);
+		return -1;
+	}
+
+	return submitted;
+}
+
+void syscall_io_uring_setup(struct registers *regs) {
+	uint32_t entries = regs->rdi;
+	struct io_uring_params *params = (void*)regs->rsi;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] io_uring_setup: entries {%x}, params {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, entries, params);
+#endif
+
+	regs->rax = uring_setup(entries, params);
+}
+
+void syscall_io_uring_enter(struct registers *regs) {
+	int fd = regs->rdi;
+	uint32_t to_submit = regs->rsi;
+	uint32_t min_complete = regs->rdx;
+	int flags = regs->r10;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] io_uring_enter: fd {%x}, to_submit {%x}, min_complete {%x}, flags {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, fd, to_submit, min_complete, flags);
+#endif
+
+	regs->rax = uring_enter(fd, to_submit, min_complete, flags);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <types.h>
+#include <lock.h>
+
+#define IORING_MAX_ENTRIES 4096 // submission entries, the completion ring is twice as big
+
+#define IORING_OP_NOP 0
+#define IORING_OP_READ 1 // fd, addr buffer, len, off or -1 for the file position
+#define IORING_OP_WRITE 2 // fd, addr buffer, len, off or -1 for the file position
+#define IORING_OP_OPENAT 3 // fd dirfd, addr path, op_flags open flags, len mode
+#define IORING_OP_CLOSE 4 // fd
+#define IORING_OP_POLL 5 // fd, op_flags poll events, res is the events that fired
+#define IORING_OP_ACCEPT 6 // fd, addr sockaddr, addr2 socklen_t pointer
+#define IORING_OP_SENDTO 7 // fd, addr buffer, len, op_flags msg flags, addr2 sockaddr, off its length
+#define IORING_OP_RECVFROM 8 // fd, addr buffer, len, op_flags msg flags, addr2 sockaddr, off socklen_t pointer
+#define IORING_OP_FSYNC 9 // fd
+#define IORING_OP_LAST 10
+
+#define IOSQE_IO_LINK (1 << 0) // the next entry only runs if this one succeeds, otherwise it completes with -ECANCELED
+
+#define IORING_ENTER_GETEVENTS (1 << 0)
+
+// ring layout, shared with user space
+struct io_uring_sqe {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t ioprio;
+	int32_t fd;
+	uint64_t off;
+	uint64_t addr;
+	uint32_t len;
+	uint32_t op_flags;
+	uint64_t user_data;
+	uint64_t addr2;
+	uint64_t pad[2];
+};
+
+struct io_uring_cqe {
+	uint64_t user_data;
+	int32_t res; // the syscall's return value, or -errno
+	uint32_t flags;
+};
+
+// at the start of the mapping, user space moves sq_tail and cq_head, the kernel sq_head and cq_tail
+struct io_uring_rings {
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint32_t cq_mask;
+	uint32_t cq_entries;
+};
+
+struct io_uring_params {
+	uint32_t sq_entries; // in the requested size, out rounded up to a power of two
+	uint32_t cq_entries;
+	uint32_t flags;
+	uint32_t sq_off; // of the submission entries from the start of the mapping
+	uint32_t cq_off;
+	uint32_t resv;
+	uint64_t ring; // where the rings got mapped
+	uint64_t ring_size;
+};
+
+struct page_table;
+
+struct uring {
+	struct spinlock lock;
+
+	struct page_table *page_table; // the address space the rings are mapped in
+	struct io_uring_rings *rings;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+
+	// the kernel's own copies, user space can scribble over the shared ones
+	uint32_t sq_head;
+	uint32_t cq_tail;
+	uint32_t cq_inflight; // completions reserved by entries that are still running
+};
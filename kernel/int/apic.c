@@ -4,6 +4,7 @@
 #include <drivers/hpet.h>
 #include <string.h>
 #include <cpu.h>
+#include <lock.h>
 
 typeof(madt_ent0_list) madt_ent0_list;
 typeof(madt_ent1_list) madt_ent1_list;
@@ -32,6 +33,22 @@ uint32_t xapic_read(uint32_t reg) {
 	return *(volatile uint32_t*)((rdmsr(MSR_LAPIC_BASE) & 0xfffff000) + HIGH_VMA + reg);
 }
 
+void xapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+	bool interrupts = get_interrupt_state();
+	asm volatile ("cli"); // the two icr halves must not be split by an ipi sent from an interrupt
+
+	while(xapic_read(XAPIC_ICR_OFF) & (1 << 12)) { // delivery status, the last ipi is still pending
+		asm volatile ("pause");
+	}
+
+	xapic_write(XAPIC_ICR_OFF + 0x10, apic_id << 24);
+	xapic_write(XAPIC_ICR_OFF, vector);
+
+	if(interrupts) {
+		asm volatile ("sti");
+	}
+}
+
 void ioapic_write_redirection_table(struct ioapic *ioapic, uint32_t redirection_entry, uint64_t data) {
 	ioapic_write(ioapic, redirection_entry + 0x10, data & 0xffffffff);
 	ioapic_write(ioapic, redirection_entry + 0x10 + 1, data >> 32 & 0xffffffff);
@@ -42,19 +59,6 @@ uint64_t ioapic_read_redirection_table(struct ioapic *ioapic, uint8_t redirectio
 	return data;
 }
 
-void apic_timer_init(uint32_t ms) {
-	xapic_write(XAPIC_TIMER_DIVIDE_CONF_OFF, 0x3); // divide by 16
-	xapic_write(XAPIC_TIMER_INITAL_COUNT_OFF, ~0);
-
-	msleep(ms);
-
-	uint32_t ticks = ~0 - xapic_read(XAPIC_TIMER_CURRENT_COUNT_OFF);
-
-	xapic_write(XAPIC_TIMER_LVT_OFF, 0x20 | (1 << 17));
-	xapic_write(XAPIC_TIMER_DIVIDE_CONF_OFF, 0x3); // divide by 16
-	xapic_write(XAPIC_TIMER_INITAL_COUNT_OFF, ticks);
-}
-
 int ioapic_set_irq_redirection(uint32_t lapic_id, uint8_t vector, uint8_t irq, bool mask) {
 	uint64_t flags = 0;
 
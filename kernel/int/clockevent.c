@@ -0,0 +1,107 @@
+#include <int/clockevent.h>
+#include <int/apic.h>
+#include <drivers/hpet.h>
+#include <sched/smp.h>
+#include <sched/sched.h>
+#include <time.h>
+#include <debug.h>
+#include <cpu.h>
+
+static void clockevent_stop(struct clockevent *clockevent) {
+	if(clockevent->mode == CLOCKEVENT_TSC_DEADLINE) {
+		wrmsr(MSR_TSC_DEADLINE, 0);
+	} else {
+		xapic_write(XAPIC_TIMER_INITAL_COUNT_OFF, 0);
+	}
+}
+
+// must run with interrupts disabled, the state is per cpu and the tick reprograms it
+void clockevent_program(uint64_t deadline) {
+	struct clockevent *clockevent = CORE_LOCAL->clockevent;
+	uint64_t now = clock_nanoseconds();
+
+	if(deadline == clockevent->deadline && (deadline == TIMER_NONE || deadline > now)) { // already armed
+		return;
+	}
+
+	clockevent->program_cnt++;
+
+	if(deadline == TIMER_NONE) {
+		clockevent->deadline = TIMER_NONE;
+		clockevent_stop(clockevent);
+		return;
+	}
+
+	uint64_t delta = deadline > now ? deadline - now : 0;
+	if(delta > CLOCKEVENT_MAX_DELTA) {
+		delta = CLOCKEVENT_MAX_DELTA;
+	}
+
+	clockevent->deadline = now + delta;
+
+	uint64_t ticks = delta * clockevent->ticks_per_ms / 1000000;
+	if(ticks == 0) {
+		ticks = 1;
+	}
+
+	if(clockevent->mode == CLOCKEVENT_TSC_DEADLINE) {
+		wrmsr(MSR_TSC_DEADLINE, rdtsc() + ticks);
+	} else {
+		xapic_write(XAPIC_TIMER_INITAL_COUNT_OFF, ticks > UINT32_MAX ? UINT32_MAX : ticks);
+	}
+}
+
+static uint64_t clockevent_calibrate_tsc() {
+	uint64_t start = hpet_nanoseconds();
+	uint64_t tsc = rdtsc();
+
+	msleep(CLOCKEVENT_CALIBRATE_MS);
+
+	uint64_t elapsed = hpet_nanoseconds() - start;
+
+	return (rdtsc() - tsc) * 1000000 / elapsed;
+}
+
+static uint64_t clockevent_calibrate_lapic() {
+	xapic_write(XAPIC_TIMER_LVT_OFF, XAPIC_TIMER_MASKED);
+	xapic_write(XAPIC_TIMER_DIVIDE_CONF_OFF, 0x3); // divide by 16
+	xapic_write(XAPIC_TIMER_INITAL_COUNT_OFF, ~0);
+
+	uint64_t start = hpet_nanoseconds();
+
+	msleep(CLOCKEVENT_CALIBRATE_MS);
+
+	uint32_t ticks = ~0 - xapic_read(XAPIC_TIMER_CURRENT_COUNT_OFF);
+	uint64_t elapsed = hpet_nanoseconds() - start;
+
+	xapic_write(XAPIC_TIMER_INITAL_COUNT_OFF, 0);
+
+	return (uint64_t)ticks * 1000000 / elapsed;
+}
+
+void clockevent_init() {
+	struct clockevent *clockevent = alloc(sizeof(struct clockevent));
+	clockevent->deadline = TIMER_NONE;
+
+	struct cpuid_state cpuid_state = cpuid(1, 0);
+
+	if(cpuid_state.rcx & (1 << 24)) {
+		clockevent->mode = CLOCKEVENT_TSC_DEADLINE;
+		clockevent->ticks_per_ms = clockevent_calibrate_tsc();
+
+		xapic_write(XAPIC_TIMER_LVT_OFF, SCHED_VECTOR | XAPIC_TIMER_TSC_DEADLINE);
+		asm volatile ("mfence" ::: "memory"); // the lvt write must land before the first deadline is armed
+	} else {
+		clockevent->mode = CLOCKEVENT_LAPIC_ONESHOT;
+		clockevent->ticks_per_ms = clockevent_calibrate_lapic();
+
+		xapic_write(XAPIC_TIMER_LVT_OFF, SCHED_VECTOR);
+	}
+
+	CORE_LOCAL->clockevent = clockevent;
+
+	print("clockevent: apic_id %x %s, %d ticks/ms\n", CORE_LOCAL->apic_id,
+		clockevent->mode == CLOCKEVENT_TSC_DEADLINE ? "tsc-deadline" : "lapic one-shot", clockevent->ticks_per_ms);
+
+	// nothing is armed until the scheduler has work here, sched_requeue kicks idle cpus
+}
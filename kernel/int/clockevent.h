@@ -0,0 +1,25 @@
+#pragma once
+
+#include <types.h>
+
+#define MSR_TSC_DEADLINE 0x6e0
+
+#define CLOCKEVENT_LAPIC_ONESHOT 0
+#define CLOCKEVENT_TSC_DEADLINE 1
+
+#define CLOCKEVENT_CALIBRATE_MS 10
+#define CLOCKEVENT_MAX_DELTA 1000000000 // ns, longer deadlines fire early and get reprogrammed
+
+#define XAPIC_TIMER_TSC_DEADLINE (1 << 18)
+#define XAPIC_TIMER_MASKED (1 << 16)
+
+struct clockevent {
+	int mode;
+	uint64_t ticks_per_ms; // tsc or lapic timer ticks
+	uint64_t deadline; // monotonic nanoseconds, TIMER_NONE when stopped
+
+	size_t program_cnt;
+};
+
+void clockevent_init();
+void clockevent_program(uint64_t deadline);
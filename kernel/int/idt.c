@@ -4,7 +4,9 @@
 #include <int/idt.h>
 #include <mm/vmm.h>
 #include <sched/sched.h>
+#include <sched/fpu.h>
 #include <lock.h>
+#include <klog.h>
 #include <debug.h>
 
 struct idt_descriptor {
@@ -94,6 +96,13 @@ extern void isr_handler_main(struct registers *regs) {
 		swapgs();
 	}
 
+	if(regs->isr_number == 0x7 && fpu_trap(regs) == 0) {
+		if(regs->cs & 0x3) {
+			swapgs();
+		}
+		return;
+	}
+
 	if(regs->isr_number == 0xe) {
 		int status = vmm_pf_handler(regs);
 
@@ -133,6 +142,8 @@ extern void isr_handler_main(struct registers *regs) {
 
 		spinrelease_irqsave(&exception_lock);
 
+		klog_flush();
+
 		for(;;) {
 			asm ("hlt");
 		}
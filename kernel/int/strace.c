@@ -3,6 +3,8 @@
 #include <debug.h>
 #include <sched/sched.h>
 #include <lib/errno.h>
+#include <int/trace.h>
+#include <int/sysprof.h>
 
 struct syscall_handle {
 	void (*handler)(struct registers*);
@@ -16,6 +18,21 @@ extern void syscall_write(struct registers*);
 extern void syscall_seek(struct registers*);
 extern void syscall_mmap(struct registers*);
 extern void syscall_munmap(struct registers*);
+extern void syscall_mremap(struct registers*);
+extern void syscall_swapon(struct registers*);
+extern void syscall_setpriority(struct registers*);
+extern void syscall_getpriority(struct registers*);
+extern void syscall_nice(struct registers*);
+extern void syscall_clock_gettime(struct registers*);
+extern void syscall_sched_setaffinity(struct registers*);
+extern void syscall_sched_getaffinity(struct registers*);
+extern void syscall_sched_setscheduler(struct registers*);
+extern void syscall_sched_getscheduler(struct registers*);
+extern void syscall_sched_getparam(struct registers*);
+extern void syscall_sched_rr_get_interval(struct registers*);
+extern void syscall_futex_waitv(struct registers*);
+extern void syscall_io_uring_setup(struct registers*);
+extern void syscall_io_uring_enter(struct registers*);
 extern void syscall_stat(struct registers*);
 extern void syscall_statat(struct registers*);
 extern void syscall_getpid(struct registers*);
@@ -77,7 +94,7 @@ static void syscall_set_fs_base(struct registers *regs) {
 
 	CURRENT_TASK->user_fs_base = addr;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] set_fs_base: addr {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, addr);
 #endif
 
@@ -87,7 +104,7 @@ static void syscall_set_fs_base(struct registers *regs) {
 }
 
 static void syscall_get_fs_base(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] get_fs_base\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 
@@ -99,7 +116,7 @@ static void syscall_set_gs_base(struct registers *regs) {
 
 	CURRENT_TASK->user_gs_base = addr;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] set_gs_base: addr {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, addr);
 #endif
 
@@ -109,7 +126,7 @@ static void syscall_set_gs_base(struct registers *regs) {
 }
 
 static void syscall_get_gs_base(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] get_gs_base\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 
@@ -188,9 +205,28 @@ static struct syscall_handle syscall_list[] = {
 	{ .handler = syscall_sendto, .name = "sendto" }, // 63
 	{ .handler = syscall_recvfrom, .name = "recvfrom" }, // 64
 	{ .handler = syscall_clone, .name = "clone" }, // 65
-	{ .handler = syscall_futex, .name = "futex" } // 66
+	{ .handler = syscall_futex, .name = "futex" }, // 66
+	{ .handler = syscall_mremap, .name = "mremap" }, // 67
+	{ .handler = syscall_swapon, .name = "swapon" }, // 68
+	{ .handler = syscall_setpriority, .name = "setpriority" }, // 69
+	{ .handler = syscall_getpriority, .name = "getpriority" }, // 70
+	{ .handler = syscall_nice, .name = "nice" }, // 71
+	{ .handler = syscall_clock_gettime, .name = "clock_gettime" }, // 72
+	{ .handler = syscall_sched_setaffinity, .name = "sched_setaffinity" }, // 73
+	{ .handler = syscall_sched_getaffinity, .name = "sched_getaffinity" }, // 74
+	{ .handler = syscall_sched_setscheduler, .name = "sched_setscheduler" }, // 75
+	{ .handler = syscall_sched_getscheduler, .name = "sched_getscheduler" }, // 76
+	{ .handler = syscall_sched_getparam, .name = "sched_getparam" }, // 77
+	{ .handler = syscall_sched_rr_get_interval, .name = "sched_rr_get_interval" }, // 78
+	{ .handler = syscall_futex_waitv, .name = "futex_waitv" }, // 79
+	{ .handler = syscall_io_uring_setup, .name = "io_uring_setup" }, // 80
+	{ .handler = syscall_io_uring_enter, .name = "io_uring_enter" } // 81
 };
 
+const char *syscall_name(uint64_t number) {
+	return number < LENGTHOF(syscall_list) ? syscall_list[number].name : "unknown";
+}
+
 extern void syscall_handler(struct registers *regs) {
 	uint64_t syscall_number = regs->rax;
 
@@ -203,6 +239,20 @@ extern void syscall_handler(struct registers *regs) {
 
 	CURRENT_TASK->signal_queue.active = false;
 
+	// one load and a branch each while tracing and profiling are off
+	struct trace_event event;
+	bool tracing = __atomic_load_n(&trace_enabled, __ATOMIC_RELAXED);
+	bool profiling = __atomic_load_n(&sysprof_enabled, __ATOMIC_RELAXED);
+	uint64_t profile_start = 0;
+
+	if(__builtin_expect(tracing, 0)) {
+		trace_syscall_start(&event, regs);
+	}
+
+	if(__builtin_expect(profiling, 0)) {
+		profile_start = rdtsc();
+	}
+
 	if(syscall_list[syscall_number].handler != NULL) {
 		syscall_list[syscall_number].handler(regs);
 	} else {
@@ -213,9 +263,17 @@ extern void syscall_handler(struct registers *regs) {
 		set_errno(0);
 	}
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] %s returning %x with errno %d\n", CORE_LOCAL->pid, CORE_LOCAL->tid, syscall_list[syscall_number].name, regs->rax, get_errno());
 #endif
 
+	if(__builtin_expect(profiling, 0)) {
+		sysprof_syscall(syscall_number, rdtsc() - profile_start, regs->rax == -1);
+	}
+
+	if(__builtin_expect(tracing, 0)) {
+		trace_syscall_end(&event, regs);
+	}
+
 	CURRENT_TASK->signal_queue.active = true;
 }
@@ -0,0 +1,273 @@
+#include <int/sysprof.h>
+#include <sched/smp.h>
+#include <sched/sched.h>
+#include <sched/runqueue.h>
+#include <fs/cdev.h>
+#include <mm/pmm.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+#include <time.h>
+#include <cpu.h>
+
+extern const char *syscall_name(uint64_t number);
+
+bool sysprof_enabled;
+
+static struct sysprof_cpu **sysprof_cpus;
+static size_t sysprof_cpu_cnt;
+
+// the tsc rate is taken against the clock over the whole uptime instead of calibrating again
+static uint64_t sysprof_tsc_base;
+static uint64_t sysprof_clock_base;
+
+static struct sysprof_task *sysprof_task_stats(struct task *task) {
+	struct task *leader = task->id.tid == 0 ? task : idr_find(&task->thread_group->process_list, 0);
+	if(leader == NULL) {
+		leader = task;
+	}
+
+	struct sysprof_task *stats = __atomic_load_n(&leader->sysprof, __ATOMIC_ACQUIRE);
+	if(stats) {
+		return stats;
+	}
+
+	struct sysprof_task *fresh = alloc(sizeof(struct sysprof_task));
+
+	// two threads of the process may race for the first call
+	if(!__atomic_compare_exchange_n(&leader->sysprof, &stats, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		free(fresh);
+		return stats;
+	}
+
+	return fresh;
+}
+
+void sysprof_syscall(uint64_t number, uint64_t cycles, bool error) {
+	struct sched_queue *queue = CORE_LOCAL->queue;
+	size_t cpu = queue ? queue->cpu : 0;
+
+	if(sysprof_cpus == NULL || cpu >= sysprof_cpu_cnt || number >= SYSPROF_SYSCALLS) {
+		return;
+	}
+
+	struct sysprof_cpu *stats = sysprof_cpus[cpu];
+
+	int bucket = cycles ? 64 - __builtin_clzl(cycles) : 0;
+	if(bucket >= SYSPROF_HIST_BUCKETS) {
+		bucket = SYSPROF_HIST_BUCKETS - 1;
+	}
+
+	stats->calls[number]++;
+	stats->errors[number] += error;
+	stats->cycles[number] += cycles;
+	stats->hist[number][bucket]++;
+
+	if(cycles > stats->max[number]) {
+		stats->max[number] = cycles;
+	}
+
+	struct task *task = CURRENT_TASK;
+	if(task == NULL) {
+		return;
+	}
+
+	struct sysprof_task *process = sysprof_task_stats(task);
+
+	__atomic_fetch_add(&process->calls[number], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&process->cycles[number], cycles, __ATOMIC_RELAXED);
+}
+
+void sysprof_init() {
+	struct sysprof_cpu **cpus = alloc(sizeof(struct sysprof_cpu*) * cpu_list.length);
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		cpus[i] = (void*)(pmm_alloc(DIV_ROUNDUP(sizeof(struct sysprof_cpu), PAGE_SIZE), 1) + HIGH_VMA);
+	}
+
+	sysprof_tsc_base = rdtsc();
+	sysprof_clock_base = clock_nanoseconds();
+
+	sysprof_cpu_cnt = cpu_list.length;
+	sysprof_cpus = cpus;
+}
+
+static ssize_t sysprof_read(struct file_handle *file, void *buf, size_t cnt, off_t offset);
+static ssize_t sysprof_write(struct file_handle *file, const void *buf, size_t cnt, off_t offset);
+
+static struct file_ops sysprof_ops = {
+	.read = sysprof_read,
+	.write = sysprof_write
+};
+
+#define SYSPROF_LINE 64
+#define SYSPROF_SYSCALL_LINE (SYSPROF_LINE + SYSPROF_HIST_BUCKETS * 11)
+
+// tagged lines, all counts since the last reset:
+// "syscall nr name calls errors cycles max hist...", totals over every cpu
+// "cpu n nr calls cycles" and "pid n nr calls cycles", only for syscalls that were made
+static ssize_t sysprof_read(struct file_handle*, void *buf, size_t cnt, off_t offset) {
+	struct idr *process_list = &CURRENT_TASK->namespace->process_list;
+	size_t process_cnt = 0;
+
+	// exits free idr layers, the pid list is only walked under sched_lock
+	spinlock_irqsave(&sched_lock);
+
+	struct task *task;
+	for(size_t pid = 0; (task = idr_next(process_list, &pid)); pid++) {
+		process_cnt++;
+	}
+
+	spinrelease_irqsave(&sched_lock);
+
+	size_t size = SYSPROF_LINE * 2 + SYSPROF_SYSCALLS * (SYSPROF_SYSCALL_LINE + (sysprof_cpu_cnt + process_cnt) * SYSPROF_LINE);
+	size_t pages = DIV_ROUNDUP(size, PAGE_SIZE);
+
+	char *text = (void*)(pmm_alloc(pages, 1) + HIGH_VMA);
+
+	uint64_t elapsed = clock_nanoseconds() - sysprof_clock_base;
+	uint64_t tsc_per_ms = elapsed ? (rdtsc() - sysprof_tsc_base) * 1000000 / elapsed : 0;
+
+	size_t length = sprint(text, "sysprof enabled %d cpus %d tsc_per_ms %d buckets %d\n", sysprof_enabled,
+		sysprof_cpu_cnt, tsc_per_ms, SYSPROF_HIST_BUCKETS);
+
+	for(size_t nr = 0; nr < SYSPROF_SYSCALLS; nr++) {
+		uint64_t calls = 0, errors = 0, cycles = 0, max = 0;
+
+		for(size_t i = 0; i < sysprof_cpu_cnt; i++) {
+			struct sysprof_cpu *stats = sysprof_cpus[i];
+
+			calls += stats->calls[nr];
+			errors += stats->errors[nr];
+			cycles += stats->cycles[nr];
+
+			if(stats->max[nr] > max) {
+				max = stats->max[nr];
+			}
+		}
+
+		if(calls == 0) {
+			continue;
+		}
+
+		length += sprint(text + length, "syscall %d %s %d %d %d %d", nr, syscall_name(nr), calls, errors, cycles, max);
+
+		for(int j = 0; j < SYSPROF_HIST_BUCKETS; j++) {
+			uint64_t bucket = 0;
+
+			for(size_t i = 0; i < sysprof_cpu_cnt; i++) {
+				bucket += sysprof_cpus[i]->hist[nr][j];
+			}
+
+			length += sprint(text + length, " %d", bucket);
+		}
+
+		length += sprint(text + length, "\n");
+	}
+
+	for(size_t i = 0; i < sysprof_cpu_cnt; i++) {
+		struct sysprof_cpu *stats = sysprof_cpus[i];
+
+		for(size_t nr = 0; nr < SYSPROF_SYSCALLS; nr++) {
+			if(stats->calls[nr]) {
+				length += sprint(text + length, "cpu %d %d %d %d\n", i, nr, stats->calls[nr], stats->cycles[nr]);
+			}
+		}
+	}
+
+	// processes that appeared since the count are left out rather than overflowing the buffer
+	size_t process_budget = process_cnt;
+
+	spinlock_irqsave(&sched_lock);
+
+	for(size_t pid = 0; process_budget && (task = idr_next(process_list, &pid)); pid++, process_budget--) {
+		struct sysprof_task *stats = __atomic_load_n(&task->sysprof, __ATOMIC_ACQUIRE);
+		if(stats == NULL) {
+			continue;
+		}
+
+		for(size_t nr = 0; nr < SYSPROF_SYSCALLS; nr++) {
+			uint64_t calls = __atomic_load_n(&stats->calls[nr], __ATOMIC_RELAXED);
+
+			if(calls) {
+				length += sprint(text + length, "pid %d %d %d %d\n", task->id.pid, nr, calls,
+					__atomic_load_n(&stats->cycles[nr], __ATOMIC_RELAXED));
+			}
+		}
+	}
+
+	spinrelease_irqsave(&sched_lock);
+
+	ssize_t ret = 0;
+
+	if(offset < length) {
+		ret = cnt > length - offset ? length - offset : cnt;
+		memcpy(buf, text + offset, ret);
+	}
+
+	pmm_free((uintptr_t)text - HIGH_VMA, pages);
+
+	return ret;
+}
+
+// "on"/"1" and "off"/"0" switch the accounting, "reset" clears every counter
+static ssize_t sysprof_write(struct file_handle*, const void *buf, size_t cnt, off_t) {
+	const char *text = buf;
+	size_t length = cnt;
+
+	while(length && (text[length - 1] == '\n' || text[length - 1] == ' ')) {
+		length--;
+	}
+
+	if(sysprof_cpus == NULL) {
+		set_errno(ENODEV);
+		return -1;
+	}
+
+	if((length == 2 && memcmp(text, "on", 2) == 0) || (length == 1 && text[0] == '1')) {
+		__atomic_store_n(&sysprof_enabled, true, __ATOMIC_RELAXED);
+	} else if((length == 3 && memcmp(text, "off", 3) == 0) || (length == 1 && text[0] == '0')) {
+		__atomic_store_n(&sysprof_enabled, false, __ATOMIC_RELAXED);
+	} else if(length == 5 && memcmp(text, "reset", 5) == 0) {
+		// racy against calls in flight, which only costs those few samples
+		for(size_t i = 0; i < sysprof_cpu_cnt; i++) {
+			memset(sysprof_cpus[i], 0, sizeof(struct sysprof_cpu));
+		}
+
+		struct idr *process_list = &CURRENT_TASK->namespace->process_list;
+
+		spinlock_irqsave(&sched_lock);
+
+		struct task *task;
+		for(size_t pid = 0; (task = idr_next(process_list, &pid)); pid++) {
+			struct sysprof_task *stats = __atomic_load_n(&task->sysprof, __ATOMIC_ACQUIRE);
+
+			if(stats) {
+				memset(stats, 0, sizeof(struct sysprof_task));
+			}
+		}
+
+		spinrelease_irqsave(&sched_lock);
+	} else {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	return cnt;
+}
+
+int sysprof_dev_init() {
+	struct cdev *cdev = alloc(sizeof(struct cdev));
+	cdev->fops = &sysprof_ops;
+	cdev->rdev = makedev(SYSPROF_MAJOR, 0);
+	if(cdev_register(cdev) == -1)
+		return -1;
+
+	struct stat *stat = alloc(sizeof(struct stat));
+	stat_init(stat);
+	stat->st_mode = S_IFCHR | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+	stat->st_rdev = makedev(SYSPROF_MAJOR, 0);
+	vfs_create_node_deep(NULL, NULL, NULL, stat, "/dev/sysprof");
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <types.h>
+
+#define SYSPROF_MAJOR 244
+
+#define SYSPROF_SYSCALLS 128 // above the last syscall number
+#define SYSPROF_HIST_BUCKETS 40 // bucket n counts calls under 2^n tsc cycles, the last one everything longer
+
+struct task;
+
+// written only by its own cpu's syscall path with interrupts masked
+struct sysprof_cpu {
+	uint64_t calls[SYSPROF_SYSCALLS];
+	uint64_t errors[SYSPROF_SYSCALLS];
+	uint64_t cycles[SYSPROF_SYSCALLS];
+	uint64_t max[SYSPROF_SYSCALLS];
+	uint32_t hist[SYSPROF_SYSCALLS][SYSPROF_HIST_BUCKETS];
+};
+
+// hangs off the thread group leader, every thread of the process adds to it
+struct sysprof_task {
+	uint64_t calls[SYSPROF_SYSCALLS];
+	uint64_t cycles[SYSPROF_SYSCALLS];
+};
+
+extern bool sysprof_enabled;
+
+void sysprof_syscall(uint64_t number, uint64_t cycles, bool error);
+
+void sysprof_init();
+int sysprof_dev_init();
@@ -0,0 +1,209 @@
+#include <int/trace.h>
+#include <sched/smp.h>
+#include <sched/runqueue.h>
+#include <fs/cdev.h>
+#include <mm/pmm.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+#include <cpu.h>
+
+bool trace_enabled;
+
+static struct trace_ring **trace_rings;
+static size_t trace_ring_cnt;
+
+static struct trace_ring *trace_local_ring(int *cpu) {
+	struct sched_queue *queue = CORE_LOCAL->queue;
+
+	*cpu = queue ? queue->cpu : 0;
+
+	return trace_rings && *cpu < trace_ring_cnt ? trace_rings[*cpu] : NULL;
+}
+
+// the handler clobbers the argument registers, they are taken before it runs
+void trace_syscall_start(struct trace_event *event, struct registers *regs) {
+	event->number = regs->rax;
+	event->args[0] = regs->rdi;
+	event->args[1] = regs->rsi;
+	event->args[2] = regs->rdx;
+	event->args[3] = regs->r10;
+	event->args[4] = regs->r8;
+	event->args[5] = regs->r9;
+	event->start = rdtsc();
+}
+
+void trace_syscall_end(struct trace_event *event, struct registers *regs) {
+	event->end = rdtsc();
+
+	int cpu;
+	struct trace_ring *ring = trace_local_ring(&cpu);
+	if(ring == NULL) {
+		return;
+	}
+
+	event->pid = CORE_LOCAL->pid;
+	event->tid = CORE_LOCAL->tid;
+	event->cpu = cpu;
+	event->error = get_errno();
+	event->ret = regs->rax;
+
+	uint64_t head = ring->head;
+
+	if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE) {
+		ring->dropped++;
+		return;
+	}
+
+	ring->events[head & (TRACE_RING_SIZE - 1)] = *event;
+	ring->recorded++;
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE); // the slot is complete before a reader sees it
+}
+
+void trace_init() {
+	struct trace_ring **rings = alloc(sizeof(struct trace_ring*) * cpu_list.length);
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct trace_ring *ring = alloc(sizeof(struct trace_ring));
+
+		ring->events = (void*)(pmm_alloc(DIV_ROUNDUP(sizeof(struct trace_event) * TRACE_RING_SIZE, PAGE_SIZE), 1) +
+			HIGH_VMA);
+
+		rings[i] = ring;
+	}
+
+	trace_ring_cnt = cpu_list.length;
+	trace_rings = rings;
+}
+
+static ssize_t trace_read(struct file_handle *file, void *buf, size_t cnt, off_t offset);
+static ssize_t trace_write(struct file_handle *file, const void *buf, size_t cnt, off_t offset);
+static ssize_t tracestat_read(struct file_handle *file, void *buf, size_t cnt, off_t offset);
+
+static struct file_ops trace_ops = {
+	.read = trace_read,
+	.write = trace_write
+};
+
+static struct file_ops tracestat_ops = {
+	.read = tracestat_read
+};
+
+// drains whole events from every cpu in turn, a stream with no offsets, 0 once all rings are empty
+static ssize_t trace_read(struct file_handle*, void *buf, size_t cnt, off_t) {
+	struct trace_event *out = buf;
+	size_t want = cnt / sizeof(struct trace_event);
+	size_t taken = 0;
+
+	if(want == 0) {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	for(size_t i = 0; i < trace_ring_cnt && taken < want; i++) {
+		struct trace_ring *ring = trace_rings[i];
+
+		spinlock_irqsave(&ring->reader_lock);
+
+		uint64_t tail = ring->tail;
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		while(tail != head && taken < want) {
+			out[taken++] = ring->events[tail & (TRACE_RING_SIZE - 1)];
+			tail++;
+		}
+
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE); // hands the slots back to the producer
+
+		spinrelease_irqsave(&ring->reader_lock);
+	}
+
+	return taken * sizeof(struct trace_event);
+}
+
+static ssize_t trace_write(struct file_handle*, const void *buf, size_t cnt, off_t) {
+	const char *text = buf;
+	size_t length = cnt;
+
+	while(length && (text[length - 1] == '\n' || text[length - 1] == ' ')) {
+		length--;
+	}
+
+	bool enable;
+
+	if((length == 2 && memcmp(text, "on", 2) == 0) || (length == 1 && text[0] == '1')) {
+		enable = true;
+	} else if((length == 3 && memcmp(text, "off", 3) == 0) || (length == 1 && text[0] == '0')) {
+		enable = false;
+	} else {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	if(enable && trace_rings == NULL) {
+		set_errno(ENODEV);
+		return -1;
+	}
+
+	__atomic_store_n(&trace_enabled, enable, __ATOMIC_RELAXED);
+
+	return cnt;
+}
+
+static ssize_t tracestat_read(struct file_handle*, void *buf, size_t cnt, off_t offset) {
+	size_t size = trace_ring_cnt * 128 + 64;
+
+	char *text = alloc(size);
+	size_t length = sprint(text, "enabled %d event %d\n", trace_enabled, sizeof(struct trace_event));
+
+	for(size_t i = 0; i < trace_ring_cnt; i++) {
+		struct trace_ring *ring = trace_rings[i];
+
+		uint64_t pending = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail,
+			__ATOMIC_ACQUIRE);
+
+		length += sprint(text + length, "cpu%d recorded %d dropped %d pending %d\n", i, ring->recorded,
+			ring->dropped, pending);
+	}
+
+	if(offset >= length) {
+		free(text);
+		return 0;
+	}
+
+	if(cnt > length - offset) {
+		cnt = length - offset;
+	}
+
+	memcpy(buf, text + offset, cnt);
+	free(text);
+
+	return cnt;
+}
+
+static int trace_dev_create(struct file_ops *fops, int minor, mode_t mode, const char *path) {
+	struct cdev *cdev = alloc(sizeof(struct cdev));
+	cdev->fops = fops;
+	cdev->rdev = makedev(TRACE_MAJOR, minor);
+	if(cdev_register(cdev) == -1)
+		return -1;
+
+	struct stat *stat = alloc(sizeof(struct stat));
+	stat_init(stat);
+	stat->st_mode = S_IFCHR | mode;
+	stat->st_rdev = makedev(TRACE_MAJOR, minor);
+	vfs_create_node_deep(NULL, NULL, NULL, stat, path);
+
+	return 0;
+}
+
+int trace_dev_init() {
+	// the events carry every process' syscall arguments, and a write switches tracing for the whole system
+	if(trace_dev_create(&trace_ops, 0, S_IRUSR | S_IWUSR, "/dev/trace") == -1) {
+		return -1;
+	}
+
+	// only counters, nothing to write
+	return trace_dev_create(&tracestat_ops, 1, S_IRUSR | S_IRGRP | S_IROTH, "/dev/tracestat");
+}
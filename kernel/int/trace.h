@@ -0,0 +1,43 @@
+#pragma once
+
+#include <types.h>
+#include <lock.h>
+
+#define TRACE_MAJOR 242
+
+#define TRACE_RING_SIZE 1024 // events per cpu, a power of two
+
+struct registers;
+
+// one syscall as /dev/trace hands it out, user space reads whole records
+struct trace_event {
+	uint64_t start; // tsc at entry
+	uint64_t end; // tsc at return
+	int32_t pid;
+	int32_t tid;
+	uint16_t number;
+	uint16_t cpu; // where it returned, a blocking syscall may have moved
+	uint32_t error; // errno, 0 when the call succeeded
+	uint64_t args[6];
+	uint64_t ret;
+};
+
+// single producer, the cpu's own syscall path with interrupts masked, readers only move the tail
+struct trace_ring {
+	struct trace_event *events;
+	uint64_t head; // next slot the cpu writes
+	uint64_t tail; // next slot a reader takes
+
+	struct spinlock reader_lock; // readers against each other, the producer never takes it
+
+	size_t recorded;
+	size_t dropped; // the ring was full, new events are lost rather than old ones overwritten
+};
+
+extern bool trace_enabled;
+
+void trace_syscall_start(struct trace_event *event, struct registers *regs);
+void trace_syscall_end(struct trace_event *event, struct registers *regs);
+
+void trace_init();
+int trace_dev_init();
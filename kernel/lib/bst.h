@@ -41,43 +41,40 @@ out: \
 	ret; \
 })
 
+#define BST_GENERIC_REPLACE(TABLE_ROOT, NODE, CHILD) ({ \
+	typeof(NODE) _parent = (NODE)->parent; \
+	typeof(NODE) _child = (CHILD); \
+	if(_parent == NULL) { \
+		TABLE_ROOT = _child; \
+	} else if(_parent->left == (NODE)) { \
+		_parent->left = _child; \
+	} else { \
+		_parent->right = _child; \
+	} \
+	if(_child != NULL) { \
+		_child->parent = _parent; \
+	} \
+})
+
 #define BST_GENERIC_DELETE(TABLE_ROOT, BASE, NODE) ({ \
 	__label__ out; \
 	int ret = 0; \
-	typeof(NODE) parent = NODE->parent; \
 	if((NODE) == NULL) { \
 		ret = -1; \
 		goto out; \
 	} \
-	if((NODE)->left == NULL && (NODE)->right == NULL) { \
-		if(parent == NULL) { \
-			TABLE_ROOT = NULL; \
-		} else if(parent->left == (NODE)) { \
-			parent->left = NULL; \
-		} else { \
-			parent->right = NULL; \
-		} \
-	} else if((NODE)->left && (NODE)->right == NULL) { \
-		if(parent->left == (NODE)) { \
-			parent->left = (NODE)->left; \
-		} else { \
-			parent->right = (NODE)->left; \
-		} \
-	} else if((NODE)->right && (NODE)->left == NULL) { \
-		if(parent->left == (NODE)) { \
-			parent->left = (NODE)->right; \
-		} else { \
-			parent->right = (NODE)->right; \
-		} \
+	if((NODE)->left == NULL) { \
+		BST_GENERIC_REPLACE(TABLE_ROOT, NODE, (NODE)->right); \
+	} else if((NODE)->right == NULL) { \
+		BST_GENERIC_REPLACE(TABLE_ROOT, NODE, (NODE)->left); \
 	} else { \
-		if(parent->left == (NODE)) { \
-			parent->left = NULL; \
-		} else { \
-			parent->right = NULL; \
-		} \
+		BST_GENERIC_REPLACE(TABLE_ROOT, NODE, NULL); \
 		BST_GENERIC_INSERT(TABLE_ROOT, BASE, (NODE)->right); \
 		BST_GENERIC_INSERT(TABLE_ROOT, BASE, (NODE)->left); \
 	} \
+	(NODE)->left = NULL; \
+	(NODE)->right = NULL; \
+	(NODE)->parent = NULL; \
 out: \
 	ret; \
 })
@@ -1,4 +1,5 @@
 #include <cpu.h>
+#include <sched/fpu.h>
 
 uint64_t HIGH_VMA = 0xffff800000000000;
 
@@ -14,7 +15,7 @@ struct cpuid_state cpuid(size_t leaf, size_t subleaf) {
 		return ret;
 	}
 
-	asm volatile ("cpuid" : "=a"(ret.rax), "=b"(ret.rbx), "=c"(ret.rcx), "=d"(ret.rbx) : "a"(leaf), "c"(subleaf));
+	asm volatile ("cpuid" : "=a"(ret.rax), "=b"(ret.rbx), "=c"(ret.rcx), "=d"(ret.rdx) : "a"(leaf), "c"(subleaf));
 
 	return ret;
 }
@@ -42,6 +43,8 @@ void init_cpu_features() {
 											
 	asm volatile ("mov %0, %%cr4" :: "r"(cr4));
 
+	fpu_init();
+
 	struct cpuid_state cpuid_state = cpuid(7, 0);
 	if(cpuid_state.rcx & (1 << 16)) {
 		HIGH_VMA = 0xff00000000000000;
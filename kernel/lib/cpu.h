@@ -32,8 +32,30 @@ extern uint64_t HIGH_VMA;
 #define COM3 0x3e8
 #define COM4 0x2e8
 
+// gs holds the base of this cpu's struct cpu_local whenever we are in the kernel, entry paths
+// coming from ring 3 swapgs before touching any of these
+#define CORE_LOCAL_OFFSET(field) __builtin_offsetof(struct cpu_local, field)
+
+#define CORE_LOCAL_READ(field) ({ \
+	__typeof__(((struct cpu_local*)0)->field) __ret; \
+	asm volatile ("mov %%gs:%c1, %0" : "=r"(__ret) : "i"(CORE_LOCAL_OFFSET(field)) : "memory"); \
+	__ret; \
+})
+
+#define CORE_LOCAL_WRITE(field, value) ({ \
+	__typeof__(((struct cpu_local*)0)->field) __value = (value); \
+	asm volatile ("mov %0, %%gs:%c1" :: "r"(__value), "i"(CORE_LOCAL_OFFSET(field)) : "memory"); \
+})
+
+#define CORE_LOCAL_ADD(field, value) ({ \
+	__typeof__(((struct cpu_local*)0)->field) __value = (value); \
+	asm volatile ("add %0, %%gs:%c1" :: "r"(__value), "i"(CORE_LOCAL_OFFSET(field)) : "memory", "cc"); \
+})
+
 #define CORE_LOCAL ({ \
-	(struct cpu_local*)(rdmsr(MSR_GS_BASE)); \
+	struct cpu_local *__self; \
+	asm volatile ("mov %%gs:%c1, %0" : "=r"(__self) : "i"(CORE_LOCAL_OFFSET(self))); \
+	__self; \
 })
 
 struct registers {
@@ -112,6 +134,12 @@ static inline void wrmsr(uint32_t msr, uint64_t data) {
 	asm volatile ("wrmsr" :: "a"(rax), "d"(rdx), "c"(msr));
 }
 
+static inline uint64_t rdtsc() {
+	uint64_t rax, rdx;
+	asm volatile ("rdtsc" : "=a"(rax), "=d"(rdx));
+	return (rdx << 32) | rax;
+}
+
 static inline void swapgs(void) {
 	asm volatile ("swapgs" ::: "memory");
 }
@@ -141,11 +169,11 @@ static inline void invlpg(uint64_t vaddr) {
 }
 
 static inline void set_errno(uint64_t code) {
-	CORE_LOCAL->errno = code;
+	CORE_LOCAL_WRITE(errno, code);
 }
 
 static inline uint64_t get_errno() {
-	return CORE_LOCAL->errno;
+	return CORE_LOCAL_READ(errno);
 }
 
 struct cpuid_state cpuid(size_t leaf, size_t subleaf);
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <lock.h>
+#include <klog.h>
 
 struct elf_file kernel_file; 
 
@@ -32,18 +33,19 @@ void stacktrace(uint64_t *rbp) {
 	}
 }
 
-static void serial_write(uint8_t data) {
-	while((inb(COM1 + 5) & (1 << 5)) == 0);
+struct print_buffer {
+	char *data;
+	size_t length;
+	size_t size;
+};
 
-	// use '__builtin_expect' to assume 'data' isn't a newline
-	if (__builtin_expect(data == '\n', 0)) {
-		outb(COM1, '\r');
+static void print_char(struct print_buffer *buffer, char c) {
+	if(buffer->length < buffer->size) {
+		buffer->data[buffer->length++] = c;
 	}
-
-	outb(COM1, data);
 }
 
-static void serial_print_number(size_t number, int base) {
+static void print_number(struct print_buffer *buffer, size_t number, int base) {
 	static char characters[] = "0123456789ABCDEF";
 	int arr[50], cnt = 0;
 
@@ -53,80 +55,133 @@ static void serial_print_number(size_t number, int base) {
 	} while(number);
 
 	for(int i = cnt - 1; i > -1; i--) {
-		serial_write(characters[arr[i]]);
+		print_char(buffer, characters[arr[i]]);
 	}
 }
 
-static void print_internal(const char *str, va_list arg) {
+// formats into a record sized buffer, whatever does not fit is cut
+static size_t print_internal(char *data, size_t size, const char *str, va_list arg) {
+	struct print_buffer buffer = {
+		.data = data,
+		.size = size
+	};
+
 	for(size_t i = 0; i < strlen(str); i++) {
 		if(str[i] != '%') {
-			serial_write(str[i]);
+			print_char(&buffer, str[i]);
 		} else {
 			switch(str[++i]) {
 				case 'd': {
 					uint64_t number = va_arg(arg, uint64_t);
-					serial_print_number(number, 10);
+					print_number(&buffer, number, 10);
 					break;
 				}
 				case 's': {
 					const char *str = va_arg(arg, const char*);
 
 					for(size_t i = 0; i < strlen(str); i++) {
-						serial_write(str[i]);
+						print_char(&buffer, str[i]);
 					}
 
 					break;
 				}
 				case 'c': {
 					char c = va_arg(arg, int);
-					serial_write(c);
+					print_char(&buffer, c);
 					break;
 				}
 				case 'x': {
 					uint64_t number = va_arg(arg, uint64_t);
-					serial_print_number(number, 16);
+					print_number(&buffer, number, 16);
 
 					break;
 				}
 				case 'b': {
 					uint64_t number = va_arg(arg, uint64_t);
-					serial_print_number(number, 2);
+					print_number(&buffer, number, 2);
 					break;
 				}
 			}
 		}
 	}
+
+	return buffer.length;
 }
 
-static struct spinlock print_lock;
+// the caller never waits on the serial port, the message goes into the log and is sent from there
+void klog(int level, const char *str, ...) {
+	char text[KLOG_LINE];
+
+	va_list arg;
+	va_start(arg, str);
+
+	size_t length = print_internal(text, sizeof(text), str, arg);
+
+	va_end(arg);
+
+	klog_write(level, text, length);
+}
 
 void print(const char *str, ...) {
+	char text[KLOG_LINE];
+
 	va_list arg;
 	va_start(arg, str);
 
-	spinlock_irqsave(&print_lock);
-	print_internal(str, arg);
-	spinrelease_irqsave(&print_lock);
+	size_t length = print_internal(text, sizeof(text), str, arg);
 
 	va_end(arg);
+
+	klog_write(KLOG_INFO, text, length);
+}
+
+// the first call of an interval reports how many were held back in the one before
+bool klog_ratelimit(struct klog_ratelimit *ratelimit) {
+	uint64_t now = klog_timestamp();
+
+	if(now == 0 || now - ratelimit->window >= KLOG_RATELIMIT_INTERVAL) {
+		int missed = ratelimit->missed;
+
+		ratelimit->window = now;
+		ratelimit->printed = 0;
+		ratelimit->missed = 0;
+
+		if(missed) {
+			klog(KLOG_WARN, "klog: %d messages suppressed\n", missed);
+		}
+	}
+
+	if(ratelimit->printed < KLOG_RATELIMIT_BURST) {
+		ratelimit->printed++;
+		return true;
+	}
+
+	ratelimit->missed++;
+
+	return false;
 }
 
 void panic(const char *str, ...) {
-	print("KERNEL PANIC: < ");
+	char text[KLOG_LINE];
+	size_t length = sprint(text, "KERNEL PANIC: < ");
 
 	va_list arg;
 	va_start(arg, str);
 
-	print_internal(str, arg);
+	length += print_internal(text + length, sizeof(text) - length - 12, str, arg);
 
 	va_end(arg);
 
-	print(" > HALTING\n");
+	length += sprint(text + length, " > HALTING\n");
+
+	klog_write(KLOG_ERR, text, length);
 
 	uint64_t rbp;
 	asm volatile ("mov %%rbp, %0" : "=r"(rbp));
 	stacktrace((void*)rbp);
 
+	klog_flush();
+
 	for(;;)
 		asm volatile ("cli\nhlt");
 }
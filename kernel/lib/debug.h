@@ -4,9 +4,32 @@
 
 //..................#define SYSCALL_DEBUG
 
+// lower is more urgent, print logs at KLOG_INFO
+#define KLOG_ERR 3
+#define KLOG_WARN 4
+#define KLOG_INFO 6
+#define KLOG_DEBUG 7
+
+#define KLOG_RATELIMIT_BURST 10 // messages a call site may log per interval
+#define KLOG_RATELIMIT_INTERVAL 5000000000ull
+
 struct registers;
 
+struct klog_ratelimit {
+	uint64_t window; // when the current interval started
+	int printed;
+	int missed;
+};
+
+// logs from a noisy call site at most KLOG_RATELIMIT_BURST times per interval
+#define klog_ratelimited(level, ...) ({ \
+	static struct klog_ratelimit __ratelimit; \
+	if(klog_ratelimit(&__ratelimit)) klog(level, __VA_ARGS__); \
+})
+
 void print(const char *str, ...);
+void klog(int level, const char *str, ...);
+bool klog_ratelimit(struct klog_ratelimit *ratelimit);
 void panic(const char *str, ...);
 void view_registers(struct registers *regs);
 void stacktrace(uint64_t *rbp);
@@ -20,6 +20,7 @@
 #define ELF_AT_PHDR 3
 #define ELF_AT_PHENT 4
 #define ELF_AT_PHNUM 5
+#define ELF_AT_SYSINFO_EHDR 33
 
 #define ELF_PT_NULL 0x0
 #define ELF_PT_LOAD 0x1
@@ -0,0 +1,270 @@
+#include <idr.h>
+#include <mm/slab.h>
+
+static size_t idr_limit(struct idr *idr) {
+	return idr->limit ? idr->limit : INT32_MAX;
+}
+
+static size_t idr_capacity(struct idr *idr) {
+	return idr->layers ? 1ull << (idr->layers * IDR_BITS) : 0;
+}
+
+// puts a new layer on top, the old tree becomes its first child
+static void idr_grow(struct idr *idr) {
+	struct idr_layer *layer = alloc(sizeof(struct idr_layer));
+
+	if(idr->top) {
+		layer->slots[0] = idr->top;
+		layer->count = 1;
+
+		if(idr->top->full == ~0ull) {
+			layer->full = 1;
+		}
+	}
+
+	idr->top = layer;
+	idr->layers++;
+}
+
+// lowest free id at or above start within the subtree, relative to it, or -1
+static ssize_t idr_layer_free(struct idr_layer *layer, int level, size_t start) {
+	int shift = level * IDR_BITS;
+	size_t index = start >> shift;
+	size_t offset = start & ((1ull << shift) - 1);
+
+	for(; index < IDR_SIZE; index++, offset = 0) {
+		if(layer->full & (1ull << index)) {
+			continue;
+		}
+
+		struct idr_layer *child = layer->slots[index];
+
+		if(level == 0 || child == NULL) {
+			return (index << shift) + offset;
+		}
+
+		ssize_t id = idr_layer_free(child, level - 1, offset);
+		if(id != -1) {
+			return (index << shift) + id;
+		}
+	}
+
+	return -1;
+}
+
+// lowest id at or above start that is in use within the subtree, relative to it, or -1
+static ssize_t idr_layer_used(struct idr_layer *layer, int level, size_t start) {
+	int shift = level * IDR_BITS;
+	size_t index = start >> shift;
+	size_t offset = start & ((1ull << shift) - 1);
+
+	for(; index < IDR_SIZE; index++, offset = 0) {
+		struct idr_layer *child = layer->slots[index];
+		if(child == NULL) {
+			continue;
+		}
+
+		if(level == 0) {
+			return index;
+		}
+
+		ssize_t id = idr_layer_used(child, level - 1, offset);
+		if(id != -1) {
+			return (index << shift) + id;
+		}
+	}
+
+	return -1;
+}
+
+static ssize_t idr_alloc_from(struct idr *idr, void *ptr, size_t start) {
+	size_t limit = idr_limit(idr);
+
+	if(start >= limit) {
+		return -1;
+	}
+
+	for(;;) {
+		if(start < idr_capacity(idr)) {
+			ssize_t id = idr_layer_free(idr->top, idr->layers - 1, start);
+
+			if(id != -1 && id < limit) {
+				idr_insert(idr, id, ptr);
+				return id;
+			}
+
+			if(id != -1 || idr_capacity(idr) >= limit) {
+				return -1;
+			}
+		}
+
+		idr_grow(idr);
+	}
+}
+
+// lowest free id, what file descriptors need
+ssize_t idr_alloc(struct idr *idr, void *ptr) {
+	return idr_alloc_from(idr, ptr, 0);
+}
+
+// next free id after the last one handed out, wrapping at the limit, so a freed id is not reused right away
+ssize_t idr_alloc_cyclic(struct idr *idr, void *ptr) {
+	ssize_t id = idr_alloc_from(idr, ptr, idr->next);
+
+	if(id == -1 && idr->next) {
+		id = idr_alloc_from(idr, ptr, 0);
+	}
+
+	if(id != -1) {
+		idr->next = id + 1;
+	}
+
+	return id;
+}
+
+// fails when the id is taken
+int idr_insert(struct idr *idr, size_t id, void *ptr) {
+	if(ptr == NULL || id >= idr_limit(idr)) {
+		return -1;
+	}
+
+	while(id >= idr_capacity(idr)) {
+		idr_grow(idr);
+	}
+
+	struct idr_layer *path[IDR_MAX_LAYERS];
+	struct idr_layer *layer = idr->top;
+
+	for(int level = idr->layers - 1; level > 0; level--) {
+		size_t index = (id >> (level * IDR_BITS)) & IDR_MASK;
+
+		path[level] = layer;
+
+		if(layer->slots[index] == NULL) {
+			layer->slots[index] = alloc(sizeof(struct idr_layer));
+			layer->count++;
+		}
+
+		layer = layer->slots[index];
+	}
+
+	size_t index = id & IDR_MASK;
+
+	if(layer->slots[index]) {
+		return -1;
+	}
+
+	layer->slots[index] = ptr;
+	layer->full |= 1ull << index;
+	layer->count++;
+	path[0] = layer;
+
+	for(int level = 0; level < idr->layers - 1 && path[level]->full == ~0ull; level++) {
+		path[level + 1]->full |= 1ull << ((id >> ((level + 1) * IDR_BITS)) & IDR_MASK);
+	}
+
+	idr->count++;
+
+	return 0;
+}
+
+static void **idr_slot(struct idr *idr, size_t id) {
+	if(id >= idr_capacity(idr)) {
+		return NULL;
+	}
+
+	struct idr_layer *layer = idr->top;
+
+	for(int level = idr->layers - 1; level > 0; level--) {
+		layer = layer->slots[(id >> (level * IDR_BITS)) & IDR_MASK];
+
+		if(layer == NULL) {
+			return NULL;
+		}
+	}
+
+	return &layer->slots[id & IDR_MASK];
+}
+
+void *idr_find(struct idr *idr, size_t id) {
+	void **slot = idr_slot(idr, id);
+
+	return slot ? *slot : NULL;
+}
+
+// swaps the pointer an id in use maps to, returns the old one or NULL when the id is free
+void *idr_replace(struct idr *idr, size_t id, void *ptr) {
+	void **slot = idr_slot(idr, id);
+	if(slot == NULL || *slot == NULL || ptr == NULL) {
+		return NULL;
+	}
+
+	void *old = *slot;
+	*slot = ptr;
+
+	return old;
+}
+
+void *idr_remove(struct idr *idr, size_t id) {
+	if(id >= idr_capacity(idr)) {
+		return NULL;
+	}
+
+	struct idr_layer *path[IDR_MAX_LAYERS];
+	struct idr_layer *layer = idr->top;
+
+	for(int level = idr->layers - 1; level > 0; level--) {
+		path[level] = layer;
+		layer = layer->slots[(id >> (level * IDR_BITS)) & IDR_MASK];
+
+		if(layer == NULL) {
+			return NULL;
+		}
+	}
+
+	size_t index = id & IDR_MASK;
+	void *ptr = layer->slots[index];
+
+	if(ptr == NULL) {
+		return NULL;
+	}
+
+	layer->slots[index] = NULL;
+	layer->full &= ~(1ull << index);
+	layer->count--;
+	path[0] = layer;
+
+	// every layer on the way up has room again, empty ones go away
+	for(int level = 1; level < idr->layers; level++) {
+		struct idr_layer *parent = path[level];
+		size_t slot = (id >> (level * IDR_BITS)) & IDR_MASK;
+
+		parent->full &= ~(1ull << slot);
+
+		if(path[level - 1]->count == 0) {
+			free(path[level - 1]);
+			parent->slots[slot] = NULL;
+			parent->count--;
+		}
+	}
+
+	idr->count--;
+
+	return ptr;
+}
+
+// the first id in use at or above *id, stored back into it, NULL once there are none left
+void *idr_next(struct idr *idr, size_t *id) {
+	if(*id >= idr_capacity(idr)) {
+		return NULL;
+	}
+
+	ssize_t next = idr_layer_used(idr->top, idr->layers - 1, *id);
+	if(next == -1) {
+		return NULL;
+	}
+
+	*id = next;
+
+	return idr_find(idr, next);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <types.h>
+
+// radix tree mapping small integer ids to pointers, every layer resolves IDR_BITS of the id
+#define IDR_BITS 6
+#define IDR_SIZE (1 << IDR_BITS)
+#define IDR_MASK (IDR_SIZE - 1)
+#define IDR_MAX_LAYERS 6 // 36 bits, past any limit an int id can have
+
+struct idr_layer {
+	uint64_t full; // leaf: slots in use, otherwise: children with no free id left
+	int count; // slots in use, a layer is freed once it drops to zero
+	void *slots[IDR_SIZE];
+};
+
+struct idr {
+	struct idr_layer *top;
+	int layers; // height of the tree, 0 while it is empty
+
+	size_t next; // where cyclic allocation resumes
+	size_t limit; // ids stay below it, 0 for the largest int
+	size_t count;
+};
+
+ssize_t idr_alloc(struct idr *idr, void *ptr);
+ssize_t idr_alloc_cyclic(struct idr *idr, void *ptr);
+int idr_insert(struct idr *idr, size_t id, void *ptr);
+void *idr_replace(struct idr *idr, size_t id, void *ptr);
+void *idr_remove(struct idr *idr, size_t id);
+void *idr_find(struct idr *idr, size_t id);
+void *idr_next(struct idr *idr, size_t *id);
@@ -0,0 +1,318 @@
+#include <klog.h>
+#include <debug.h>
+#include <cpu.h>
+#include <string.h>
+#include <lock.h>
+#include <time.h>
+#include <errno.h>
+#include <int/idt.h>
+#include <int/apic.h>
+#include <fs/cdev.h>
+
+#define KLOG_SERIAL_FIFO 16 // bytes the 16550 takes per transmitter interrupt
+#define KLOG_SERIAL_IRQ 4
+
+static struct klog_record klog_records[KLOG_RECORDS];
+static uint64_t klog_head; // next sequence number handed out
+
+static bool klog_clock; // records get a timestamp once the clock is up
+static bool klog_async; // the port is drained from its interrupt, before that every write polls it
+
+// the serial port is the one consumer, under the lock
+static struct spinlock klog_serial_lock;
+static struct klog_record klog_serial_record; // copy of the record going out
+static bool klog_serial_loaded;
+static uint64_t klog_serial_seq; // next record to send
+static size_t klog_serial_pos;
+static bool klog_serial_cr; // the '\r' in front of a '\n' went out
+static size_t klog_serial_lost; // records the port fell so far behind on that they were overwritten
+static bool klog_tx_active; // the transmitter interrupt is enabled and will pick up new records
+
+// copies a record out, 1 when it is there, 0 when it is not written yet, -1 when it was overwritten
+static int klog_fetch(uint64_t seq, struct klog_record *out) {
+	struct klog_record *record = &klog_records[seq % KLOG_RECORDS];
+	uint64_t stamp = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+
+	if(stamp != seq + 1) {
+		if(stamp > seq + 1 || __atomic_load_n(&klog_head, __ATOMIC_RELAXED) > seq + KLOG_RECORDS) {
+			return -1;
+		}
+
+		return 0;
+	}
+
+	memcpy(out, record, sizeof(struct klog_record));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&record->seq, __ATOMIC_RELAXED) == stamp ? 1 : -1; // a writer lapped us mid copy
+}
+
+// next byte for the port, false once everything logged so far went out
+static bool klog_serial_next(char *c) {
+	for(;;) {
+		if(!klog_serial_loaded) {
+			int status = klog_fetch(klog_serial_seq, &klog_serial_record);
+
+			if(status == 0) {
+				return false;
+			}
+
+			if(status == -1) {
+				uint64_t head = __atomic_load_n(&klog_head, __ATOMIC_RELAXED);
+				uint64_t oldest = head > KLOG_RECORDS ? head - KLOG_RECORDS : 0;
+
+				if(oldest > klog_serial_seq) {
+					klog_serial_lost += oldest - klog_serial_seq;
+					klog_serial_seq = oldest;
+				} else {
+					klog_serial_lost++;
+					klog_serial_seq++;
+				}
+
+				continue;
+			}
+
+			klog_serial_seq++;
+			klog_serial_pos = 0;
+			klog_serial_loaded = klog_serial_record.level <= KLOG_CONSOLE_LEVEL;
+
+			continue;
+		}
+
+		if(klog_serial_pos == klog_serial_record.length) {
+			klog_serial_loaded = false;
+			continue;
+		}
+
+		char next = klog_serial_record.text[klog_serial_pos];
+
+		if(next == '\n' && !klog_serial_cr) {
+			klog_serial_cr = true;
+			*c = '\r';
+			return true;
+		}
+
+		klog_serial_cr = false;
+		klog_serial_pos++;
+		*c = next;
+
+		return true;
+	}
+}
+
+static bool klog_serial_pending() {
+	struct klog_record *record = &klog_records[klog_serial_seq % KLOG_RECORDS];
+
+	return klog_serial_loaded || __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) == klog_serial_seq + 1;
+}
+
+static void klog_serial_poll() {
+	char c;
+
+	while(klog_serial_next(&c)) {
+		while((inb(COM1 + 5) & (1 << 5)) == 0);
+		outb(COM1, c);
+	}
+}
+
+// the transmitter holding register ran empty, refill the fifo or switch the interrupt off once there is nothing left
+static void klog_serial_handler(struct registers*, void*) {
+	spinlock_irqsave(&klog_serial_lock);
+
+	inb(COM1 + 2); // reading the identification register acknowledges a transmitter interrupt
+
+	if((inb(COM1 + 5) & (1 << 5)) == 0) { // still sending, another interrupt follows
+		spinrelease_irqsave(&klog_serial_lock);
+		return;
+	}
+
+	size_t sent = 0;
+	char c;
+
+	while(sent < KLOG_SERIAL_FIFO && klog_serial_next(&c)) {
+		outb(COM1, c);
+		sent++;
+	}
+
+	if(sent == 0) {
+		outb(COM1 + 1, 0);
+		__atomic_store_n(&klog_tx_active, false, __ATOMIC_SEQ_CST);
+
+		// a writer that saw the interrupt still on left its record to us
+		if(klog_serial_pending() && !__atomic_exchange_n(&klog_tx_active, true, __ATOMIC_ACQ_REL)) {
+			outb(COM1 + 1, 1 << 1);
+		}
+	}
+
+	spinrelease_irqsave(&klog_serial_lock);
+}
+
+static void klog_kick() {
+	if(!__atomic_load_n(&klog_async, __ATOMIC_ACQUIRE)) {
+		spinlock_irqsave(&klog_serial_lock);
+		klog_serial_poll();
+		spinrelease_irqsave(&klog_serial_lock);
+		return;
+	}
+
+	if(!__atomic_exchange_n(&klog_tx_active, true, __ATOMIC_ACQ_REL)) {
+		outb(COM1 + 1, 1 << 1); // the holding register is empty, so this raises the interrupt right away
+	}
+}
+
+uint64_t klog_timestamp() {
+	return klog_clock ? clock_nanoseconds() : 0;
+}
+
+// never blocks on the port, writers only claim a slot and fill it in
+void klog_write(int level, const char *text, size_t length) {
+	if(length > KLOG_LINE) {
+		length = KLOG_LINE;
+	}
+
+	uint64_t seq = __atomic_fetch_add(&klog_head, 1, __ATOMIC_RELAXED);
+	struct klog_record *record = &klog_records[seq % KLOG_RECORDS];
+
+	__atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	record->timestamp = klog_timestamp();
+	record->length = length;
+	record->level = level;
+	memcpy(record->text, text, length);
+
+	__atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+
+	klog_kick();
+}
+
+// panics and exceptions, the interrupt may never come again. the lock is left alone, the cpu that died may hold it
+void klog_flush() {
+	__atomic_store_n(&klog_async, false, __ATOMIC_RELEASE);
+
+	klog_serial_poll();
+}
+
+void klog_init() {
+	klog_clock = true;
+
+	int vector = idt_alloc_vector(klog_serial_handler, NULL);
+	ioapic_set_irq_redirection(xapic_read(XAPIC_ID_REG_OFF), vector, KLOG_SERIAL_IRQ, false);
+
+	outb(COM1 + 4, 1 << 3); // out2 gates the port's interrupt line
+
+	__atomic_store_n(&klog_async, true, __ATOMIC_RELEASE);
+}
+
+static ssize_t kmsg_read(struct file_handle *file, void *buf, size_t cnt, off_t offset);
+static ssize_t kmsg_write(struct file_handle *file, const void *buf, size_t cnt, off_t offset);
+
+static struct file_ops kmsg_ops = {
+	.read = kmsg_read,
+	.write = kmsg_write
+};
+
+// "<level>[seconds.microseconds] text", the way dmesg shows it
+static size_t klog_render(struct klog_record *record, char *line) {
+	uint64_t micro = record->timestamp / 1000;
+
+	char fraction[16];
+	int digits = sprint(fraction, "%d", micro % 1000000);
+
+	size_t length = sprint(line, "<%d>[%d.", record->level, micro / 1000000);
+
+	for(int i = digits; i < 6; i++) {
+		line[length++] = '0';
+	}
+
+	memcpy(line + length, fraction, digits);
+	length += digits;
+
+	line[length++] = ']';
+	line[length++] = ' ';
+
+	memcpy(line + length, record->text, record->length);
+
+	return length + record->length;
+}
+
+// each open handle walks the log from the oldest record still there, whole records per read
+static ssize_t kmsg_read(struct file_handle *file, void *buf, size_t cnt, off_t) {
+	uint64_t head = __atomic_load_n(&klog_head, __ATOMIC_ACQUIRE);
+	uint64_t oldest = head > KLOG_RECORDS ? head - KLOG_RECORDS : 0;
+	uint64_t seq = (uintptr_t)file->private_data;
+
+	if(seq < oldest) {
+		seq = oldest;
+	}
+
+	char line[KLOG_LINE + 64];
+	size_t length = 0;
+
+	while(seq < head) {
+		struct klog_record record;
+		int status = klog_fetch(seq, &record);
+
+		if(status == 0) {
+			break;
+		}
+
+		if(status == -1) {
+			seq++;
+			continue;
+		}
+
+		size_t line_length = klog_render(&record, line);
+
+		if(length + line_length > cnt) {
+			if(length == 0) { // a buffer smaller than one record gets what fits
+				memcpy(buf, line, cnt);
+				length = cnt;
+				seq++;
+			}
+
+			break;
+		}
+
+		memcpy(buf + length, line, line_length);
+		length += line_length;
+		seq++;
+	}
+
+	file->private_data = (void*)(uintptr_t)seq;
+
+	return length;
+}
+
+// user space logs through here, an optional "<level>" in front picks the level
+static ssize_t kmsg_write(struct file_handle*, const void *buf, size_t cnt, off_t) {
+	const char *text = buf;
+	size_t length = cnt;
+	int level = KLOG_INFO;
+
+	if(length >= 3 && text[0] == '<' && text[1] >= '0' && text[1] <= '7' && text[2] == '>') {
+		level = text[1] - '0';
+		text += 3;
+		length -= 3;
+	}
+
+	klog_write(level, text, length);
+
+	return cnt;
+}
+
+int klog_dev_init() {
+	struct cdev *cdev = alloc(sizeof(struct cdev));
+	cdev->fops = &kmsg_ops;
+	cdev->rdev = makedev(KLOG_MAJOR, 0);
+	if(cdev_register(cdev) == -1)
+		return -1;
+
+	struct stat *stat = alloc(sizeof(struct stat));
+	stat_init(stat);
+	stat->st_mode = S_IFCHR | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+	stat->st_rdev = makedev(KLOG_MAJOR, 0);
+	vfs_create_node_deep(NULL, NULL, NULL, stat, "/dev/kmsg");
+
+	return 0;
+}
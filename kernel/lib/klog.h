@@ -0,0 +1,27 @@
+#pragma once
+
+#include <types.h>
+#include <debug.h>
+
+#define KLOG_MAJOR 243
+
+#define KLOG_RECORDS 1024 // the log keeps the most recent ones
+#define KLOG_LINE 232 // longer messages are cut
+
+#define KLOG_CONSOLE_LEVEL KLOG_INFO // less urgent messages only go to /dev/kmsg, not the serial port
+
+// one print call, slots are reused once the log wraps
+struct klog_record {
+	uint64_t seq; // seq + 1 once the record is complete, 0 while it is written
+	uint64_t timestamp; // monotonic nanoseconds, 0 before the clock is up
+	uint16_t length;
+	uint8_t level;
+	char text[KLOG_LINE];
+};
+
+void klog_write(int level, const char *text, size_t length);
+uint64_t klog_timestamp();
+void klog_flush();
+
+void klog_init();
+int klog_dev_init();
@@ -11,32 +11,67 @@ static inline void raw_spinlock(void *lock) {
 	while(__atomic_test_and_set(lock, __ATOMIC_ACQUIRE));
 }
 
+static inline bool raw_spintrylock(void *lock) {
+	return !__atomic_test_and_set(lock, __ATOMIC_ACQUIRE);
+}
+
 static inline void raw_spinrelease(void *lock) {
 	__atomic_clear(lock, __ATOMIC_RELEASE);
 }
 
 bool get_interrupt_state();
 
+// holding a spinlock keeps the task on its cpu, see sched/preempt.c
+void preempt_disable();
+void preempt_enable();
+
 static inline void spinlock_irqdef(struct spinlock *spinlock) {
+	preempt_disable();
 	raw_spinlock(&spinlock->lock);
 }
 
 static inline void spinrelease_irqdef(struct spinlock *spinlock) {
 	raw_spinrelease(&spinlock->lock);
+	preempt_enable();
 }
 
 static inline void spinlock_irqsave(struct spinlock *spinlock) {
-	spinlock->interrupts = get_interrupt_state();
+	bool interrupts = get_interrupt_state();
 	asm volatile ("cli");
+	preempt_disable();
 	raw_spinlock(&spinlock->lock);
+
+	spinlock->interrupts = interrupts; // only the holder may touch the saved state
 }
 
 static inline void spinrelease_irqsave(struct spinlock *spinlock) {
+	bool interrupts = spinlock->interrupts;
+
 	raw_spinrelease(&spinlock->lock);
 
-	if(spinlock->interrupts) {
+	if(interrupts) {
 		asm volatile ("sti");
 	} else {
 		asm volatile ("cli");
 	}
+
+	preempt_enable();
+}
+
+static inline bool spintrylock_irqsave(struct spinlock *spinlock) {
+	bool interrupts = get_interrupt_state();
+	asm volatile ("cli");
+	preempt_disable();
+
+	if(!raw_spintrylock(&spinlock->lock)) {
+		if(interrupts) {
+			asm volatile ("sti");
+		}
+		preempt_enable();
+		return false;
+	}
+
+	spinlock->interrupts = interrupts;
+
+	return true;
 }
@@ -1,73 +1,115 @@
 #include <priority_heap.h>
 #include <stddef.h>
 
-#define HEAP_ROOT 1
-
-#define HEAP_PARENT(heap, index) ({ \
-	struct priority_heap_node *_child = NULL; \
-	int _index = (index) / 2 - 1; \
-	if(_index < (heap)->nodes.length) { \
-		_child = (heap)->nodes.data[_index]; \
-	} \
-	_child; \
-})
-
-#define HEAP_LEFT(heap, index) ({ \
-	struct priority_heap_node *_child = NULL; \
-	int _index = (index) * 2 - 1; \
-	if(_index < (heap)->nodes.length) { \
-		_child = (heap)->nodes.data[_index]; \
-	} \
-	_child; \
-})
-
-#define HEAP_RIGHT(heap, index) ({ \
-	struct priority_heap_node *_child = NULL; \
-	int _index = (index) * 2; \
-	if(_index < (heap)->nodes.length) { \
-		_child = (heap)->nodes.data[_index]; \
-	} \
-	_child; \
-})
-
-static void max_heapify(struct priority_heap *heap, int index) {
-	struct priority_heap_node *root = heap->nodes.data[index - 1];
-
-	struct priority_heap_node *left = HEAP_LEFT(heap, index);
-	struct priority_heap_node *right = HEAP_RIGHT(heap, index);
-	struct priority_heap_node *largest_child = left;
-	
-	if(!left && !right) {
-		return;
-	} else if(!left && right) {
-		largest_child = right;
-	} else if(left && !right) {
-		largest_child = left;
-	} else if(right->key > left->key) {
-		largest_child = right;
+static struct priority_heap_node *priority_heap_meld(struct priority_heap_node *a, struct priority_heap_node *b) {
+	if(a == NULL) return b;
+	if(b == NULL) return a;
+
+	if(b->key < a->key) {
+		struct priority_heap_node *tmp = a;
+		a = b;
+		b = tmp;
 	}
 
-	if(largest_child->key > root->key) { // max heap property violation	
-		struct priority_heap_node tmp = *root;
+	b->prev = a;
+	b->next = a->child;
+
+	if(a->child) {
+		a->child->prev = b;
+	}
+
+	a->child = b;
+
+	return a;
+}
+
+static struct priority_heap_node *priority_heap_merge_pairs(struct priority_heap_node *first) {
+	struct priority_heap_node *pairs = NULL;
+
+	while(first) { // meld siblings pairwise from the left
+		struct priority_heap_node *a = first;
+		struct priority_heap_node *b = first->next;
+
+		first = b ? b->next : NULL;
 
-		*root = *largest_child;
-		*largest_child = tmp;
+		a->next = a->prev = NULL;
+		if(b) b->next = b->prev = NULL;
 
-		int index_tmp = root->index;
+		struct priority_heap_node *pair = priority_heap_meld(a, b);
+		pair->next = pairs;
+		pairs = pair;
+	}
 
-		root->index = largest_child->index;
-		largest_child->index = index_tmp;
+	struct priority_heap_node *root = NULL;
 
-		max_heapify(heap, largest_child->index);
+	while(pairs) { // then fold the pairs back from the right
+		struct priority_heap_node *next = pairs->next;
+		pairs->next = NULL;
+		root = priority_heap_meld(root, pairs);
+		pairs = next;
 	}
+
+	return root;
+}
+
+void priority_heap_insert(struct priority_heap *heap, struct priority_heap_node *node) {
+	node->child = node->next = node->prev = NULL;
+
+	heap->root = priority_heap_meld(heap->root, node);
+	heap->length++;
 }
 
 void priority_heap_delete(struct priority_heap *heap, struct priority_heap_node *node) {
-	size_t index = VECTOR_REMOVE_BY_VALUE(heap->nodes, node) + 1;
-	max_heapify(heap, index);
+	if(node == heap->root) {
+		heap->root = priority_heap_merge_pairs(node->child);
+	} else {
+		if(node->prev->child == node) node->prev->child = node->next;
+		else node->prev->next = node->next;
+
+		if(node->next) node->next->prev = node->prev;
+
+		heap->root = priority_heap_meld(heap->root, priority_heap_merge_pairs(node->child));
+	}
+
+	if(heap->root) {
+		heap->root->prev = heap->root->next = NULL;
+	}
+
+	node->child = node->next = node->prev = NULL;
+	heap->length--;
 }
 
-void priority_heap_insert(struct priority_heap *heap, struct priority_heap_node *node) {
-	VECTOR_PUSH(heap->nodes, node);
-	max_heapify(heap, heap->nodes.length);
+struct priority_heap_node *priority_heap_pop(struct priority_heap *heap) {
+	struct priority_heap_node *node = heap->root;
+
+	if(node) {
+		priority_heap_delete(heap, node);
+	}
+
+	return node;
+}
+
+// pre-order walk over every node, starting from NULL, the heap must not change in between
+struct priority_heap_node *priority_heap_next(struct priority_heap *heap, struct priority_heap_node *node) {
+	if(node == NULL) {
+		return heap->root;
+	}
+
+	if(node->child) {
+		return node->child;
+	}
+
+	while(node) {
+		if(node->next) {
+			return node->next;
+		}
+
+		while(node->prev && node->prev->child != node) { // back to the first sibling, its prev is the parent
+			node = node->prev;
+		}
+
+		node = node->prev;
+	}
+
+	return NULL;
 }
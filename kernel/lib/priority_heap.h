@@ -1,16 +1,28 @@
 #pragma once
 
-#include <vector.h>
+#include <types.h>
+
+// intrusive min pairing heap, nodes live inside their owner so no operation allocates
 
 struct priority_heap_node {
-	int key;
-	int index;
+	uint64_t key;
 	void *data;
+
+	struct priority_heap_node *child;
+	struct priority_heap_node *next;
+	struct priority_heap_node *prev; // parent for the first child, left sibling otherwise
 };
 
 struct priority_heap {
-	VECTOR(struct priority_heap_node*) nodes;
+	struct priority_heap_node *root;
+	size_t length;
 };
 
-void priority_heap_delete(struct priority_heap *heap, struct priority_heap_node *node);
+static inline struct priority_heap_node *priority_heap_min(struct priority_heap *heap) {
+	return heap->root;
+}
+
 void priority_heap_insert(struct priority_heap *heap, struct priority_heap_node *node);
+void priority_heap_delete(struct priority_heap *heap, struct priority_heap_node *node);
+struct priority_heap_node *priority_heap_pop(struct priority_heap *heap);
+struct priority_heap_node *priority_heap_next(struct priority_heap *heap, struct priority_heap_node *node);
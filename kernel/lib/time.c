@@ -0,0 +1,400 @@
+#include <sched/sched.h>
+#include <sched/smp.h>
+#include <sched/runqueue.h>
+#include <int/clockevent.h>
+#include <drivers/hpet.h>
+#include <time.h>
+#include <lock.h>
+#include <cpu.h>
+#include <debug.h>
+#include <errno.h>
+#include <limine.h>
+#include <vdso/vdso.h>
+
+static int64_t clock_epoch;
+
+static bool clock_tsc;
+static uint64_t clock_tsc_base;
+static uint64_t clock_tsc_mult;
+static uint64_t clock_ns_base;
+
+static volatile struct limine_boot_time_request limine_boot_time_request = {
+	.id = LIMINE_BOOT_TIME_REQUEST,
+	.revision = 0
+};
+
+struct timespec timespec_add(struct timespec a, struct timespec b) {
+	struct timespec ret = {
+		.tv_nsec = a.tv_nsec + b.tv_nsec,
+		.tv_sec = a.tv_sec + b.tv_sec
+	};
+
+	if(ret.tv_nsec >= TIMER_HZ) {
+		ret.tv_nsec -= TIMER_HZ;
+		ret.tv_sec++;
+	}
+
+	return ret;
+}
+
+struct timespec timespec_sub(struct timespec a, struct timespec b) {
+	struct timespec ret = {
+		.tv_nsec = a.tv_nsec - b.tv_nsec,
+		.tv_sec = a.tv_sec - b.tv_sec
+	};
+
+	if(ret.tv_nsec < 0) {
+		ret.tv_nsec += TIMER_HZ;
+		ret.tv_sec--;
+	}
+
+	if(ret.tv_sec < 0) {
+		ret.tv_nsec = 0;
+		ret.tv_sec = 0;
+	}
+
+	return ret;
+}
+
+struct timespec timespec_convert_ms(int ms) {
+	struct timespec ret = {
+		.tv_nsec = (ms % 1000) * 1000000,
+		.tv_sec = ms / 1000
+	};
+
+	return ret;
+}
+
+uint64_t timespec_nanoseconds(struct timespec timespec) {
+	if(timespec.tv_sec < 0 || timespec.tv_nsec < 0) {
+		return 0;
+	}
+
+	return timespec.tv_sec * TIMER_HZ + timespec.tv_nsec;
+}
+
+struct timespec timespec_from_nanoseconds(uint64_t ns) {
+	struct timespec ret = {
+		.tv_nsec = ns % TIMER_HZ,
+		.tv_sec = ns / TIMER_HZ
+	};
+
+	return ret;
+}
+
+// monotonic nanoseconds since the hpet was started, from the tsc when it ticks at a constant rate
+uint64_t clock_nanoseconds() {
+	if(!clock_tsc) {
+		return hpet_nanoseconds();
+	}
+
+	uint64_t tsc = rdtsc();
+	uint64_t delta = tsc > clock_tsc_base ? tsc - clock_tsc_base : 0;
+
+	return clock_ns_base + (uint64_t)(((unsigned __int128)delta * clock_tsc_mult) >> VDSO_TSC_SHIFT);
+}
+
+struct timespec clock_get(clockid_t clock) {
+	struct timespec monotonic = timespec_from_nanoseconds(clock_nanoseconds());
+
+	if(clock == CLOCK_MONOTONIC) {
+		return monotonic;
+	}
+
+	monotonic.tv_sec += clock_epoch;
+
+	return monotonic;
+}
+
+static void timer_link(struct timer **head, struct timer *timer) {
+	timer->head = head;
+	timer->prev = NULL;
+	timer->next = *head;
+
+	if(*head) {
+		(*head)->prev = timer;
+	}
+
+	*head = timer;
+}
+
+static void timer_unlink(struct timer_base *base, struct timer *timer) {
+	if(timer->prev) timer->prev->next = timer->next;
+	else *timer->head = timer->next;
+
+	if(timer->next) timer->next->prev = timer->prev;
+
+	if(*timer->head == NULL && timer->head != &base->expired) { // emptied a wheel slot
+		size_t index = timer->head - &base->wheel[0][0];
+		base->pending[index / TIMER_WHEEL_SIZE] &= ~(1ull << (index % TIMER_WHEEL_SIZE));
+	}
+
+	timer->head = NULL;
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
+static void timer_enqueue(struct timer_base *base, struct timer *timer) {
+	uint64_t delta = timer->expires - base->clk;
+	int level = 0;
+
+	// a level only takes timers that round up to less than a full revolution ahead of the clock
+	while(level < TIMER_WHEEL_DEPTH - 1 && delta >= ((uint64_t)(TIMER_WHEEL_SIZE - 1) << (level * TIMER_WHEEL_LEVEL_SHIFT))) {
+		level++;
+	}
+
+	int shift = level * TIMER_WHEEL_LEVEL_SHIFT;
+	uint64_t start = (base->clk + (1ull << shift) - 1) >> shift;
+	uint64_t slot = (timer->expires + (1ull << shift) - 1) >> shift;
+
+	if(slot > start + TIMER_WHEEL_SIZE - 1) { // past the last level, requeued when the slot comes up
+		slot = start + TIMER_WHEEL_SIZE - 1;
+	}
+
+	size_t index = slot & (TIMER_WHEEL_SIZE - 1);
+
+	timer_link(&base->wheel[level][index], timer);
+	base->pending[level] |= 1ull << index;
+}
+
+// wheel clock unit at which the first non empty slot comes up
+static uint64_t timer_base_next(struct timer_base *base) {
+	uint64_t next = TIMER_NONE;
+
+	for(int level = 0; level < TIMER_WHEEL_DEPTH; level++) {
+		uint64_t pending = base->pending[level];
+		if(pending == 0) {
+			continue;
+		}
+
+		int shift = level * TIMER_WHEEL_LEVEL_SHIFT;
+		uint64_t start = (base->clk + (1ull << shift) - 1) >> shift;
+		int position = start & (TIMER_WHEEL_SIZE - 1);
+
+		uint64_t rotated = (pending >> position) | (position ? pending << (TIMER_WHEEL_SIZE - position) : 0);
+		uint64_t due = (start + __builtin_ctzll(rotated)) << shift;
+
+		if(due < next) {
+			next = due;
+		}
+	}
+
+	return next;
+}
+
+// moves every slot that comes up between the wheel clock and now over to the expired list
+static void timer_base_advance(struct timer_base *base, uint64_t now) {
+	uint64_t clk = now >> TIMER_WHEEL_SHIFT;
+
+	while(base->clk <= clk) {
+		uint64_t next = timer_base_next(base);
+
+		if(next > clk) { // nothing else due, skip the idle stretch in one go
+			base->clk = clk + 1;
+			break;
+		}
+
+		base->clk = next;
+
+		for(int level = 0; level < TIMER_WHEEL_DEPTH; level++) {
+			int shift = level * TIMER_WHEEL_LEVEL_SHIFT;
+
+			if(base->clk & ((1ull << shift) - 1)) { // coarser levels only come up on their boundaries
+				break;
+			}
+
+			size_t index = (base->clk >> shift) & (TIMER_WHEEL_SIZE - 1);
+			struct timer *timer;
+
+			while((timer = base->wheel[level][index])) {
+				timer_unlink(base, timer);
+				timer_link(&base->expired, timer);
+			}
+		}
+
+		base->clk++;
+	}
+
+	// timers clamped onto the last level come up before they are due, put them back in
+	struct timer *timer = base->expired;
+	while(timer) {
+		struct timer *next = timer->next;
+
+		if(timer->expires > clk) {
+			timer_unlink(base, timer);
+			timer_enqueue(base, timer);
+		}
+
+		timer = next;
+	}
+}
+
+// a wheel that sat idle has a stale clock, catch it up so new timers do not land on a coarse level
+static void timer_base_forward(struct timer_base *base, uint64_t now) {
+	uint64_t clk = now >> TIMER_WHEEL_SHIFT;
+	uint64_t next = timer_base_next(base);
+
+	if(next < clk) {
+		clk = next;
+	}
+
+	if(clk > base->clk) {
+		base->clk = clk;
+	}
+}
+
+void timer_base_init(struct cpu_local *cpu_local, int cpu) {
+	struct timer_base *base = alloc(sizeof(struct timer_base));
+
+	base->cpu = cpu;
+
+	cpu_local->timers = base;
+}
+
+void timer_arm(struct timer *timer, struct timespec timespec) {
+	timer_cancel(timer);
+
+	struct timer_base *base = CORE_LOCAL->timers;
+
+	spinlock_irqsave(&base->lock);
+
+	uint64_t now = clock_nanoseconds();
+
+	timer_base_forward(base, now);
+
+	timer->deadline = now + timespec_nanoseconds(timespec);
+	timer->expires = (timer->deadline + (1ull << TIMER_WHEEL_SHIFT) - 1) >> TIMER_WHEEL_SHIFT;
+	timer->base = base;
+
+	if(timer->expires < base->clk) {
+		timer->expires = base->clk;
+	}
+
+	timer_enqueue(base, timer);
+
+	base->armed_cnt++;
+
+	uint64_t next = timer_base_next(base) << TIMER_WHEEL_SHIFT;
+	if(next < CORE_LOCAL->clockevent->deadline) {
+		clockevent_program(next);
+	}
+
+	spinrelease_irqsave(&base->lock);
+}
+
+// returns whether the timer was still pending, once it returns the function is not running anywhere
+bool timer_cancel(struct timer *timer) {
+	struct timer_base *base = timer->base;
+	if(base == NULL) {
+		return false;
+	}
+
+	spinlock_irqsave(&base->lock);
+
+	bool pending = timer->head != NULL;
+
+	if(pending) {
+		timer_unlink(base, timer);
+		base->cancel_cnt++;
+	}
+
+	while(base->running == timer) {
+		spinrelease_irqsave(&base->lock);
+		asm volatile ("pause");
+		spinlock_irqsave(&base->lock);
+	}
+
+	spinrelease_irqsave(&base->lock);
+
+	return pending;
+}
+
+void timer_expire(uint64_t now) {
+	struct timer_base *base = CORE_LOCAL->timers;
+
+	spinlock_irqsave(&base->lock);
+
+	timer_base_advance(base, now);
+
+	// the functions wake tasks and take scheduler locks, so they run without the base lock
+	struct timer *timer;
+	while((timer = base->expired)) {
+		timer_unlink(base, timer);
+		base->running = timer;
+		base->fired_cnt++;
+
+		spinrelease_irqsave(&base->lock);
+		timer->function(timer);
+		spinlock_irqsave(&base->lock);
+
+		base->running = NULL;
+	}
+
+	spinrelease_irqsave(&base->lock);
+}
+
+uint64_t timer_next(int cpu) {
+	struct timer_base *base = cpu_list.data[cpu]->timers;
+
+	spinlock_irqsave(&base->lock);
+	uint64_t next = timer_base_next(base);
+	spinrelease_irqsave(&base->lock);
+
+	return next == TIMER_NONE ? TIMER_NONE : next << TIMER_WHEEL_SHIFT;
+}
+
+// seqlock write side, readers in the vdso retry while seq is odd or has moved
+void clock_vdso_publish(struct vdso_time *time) {
+	__atomic_store_n(&time->seq, time->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	time->mode = clock_tsc ? VDSO_CLOCK_TSC : VDSO_CLOCK_SYSCALL;
+	time->tsc_base = clock_tsc_base;
+	time->monotonic_base = clock_ns_base;
+	time->mult = clock_tsc_mult;
+	time->epoch = clock_epoch;
+
+	__atomic_store_n(&time->seq, time->seq + 1, __ATOMIC_RELEASE);
+}
+
+void clock_init() {
+	clock_epoch = limine_boot_time_request.response->boot_time;
+
+	struct cpuid_state cpuid_state = cpuid(0x80000007, 0);
+
+	if(cpuid_state.rdx & (1 << 8)) { // invariant tsc, constant rate across p-states and c-states
+		uint64_t start = hpet_nanoseconds();
+		uint64_t tsc = rdtsc();
+
+		msleep(CLOCK_CALIBRATE_MS);
+
+		uint64_t end = hpet_nanoseconds();
+		uint64_t now = rdtsc();
+
+		clock_tsc_mult = ((end - start) << VDSO_TSC_SHIFT) / (now - tsc);
+		clock_tsc_base = now;
+		clock_ns_base = end;
+		clock_tsc = true;
+	}
+
+	print("clock: %s clocksource, epoch %x\n", clock_tsc ? "tsc" : "hpet", clock_epoch);
+}
+
+void syscall_clock_gettime(struct registers *regs) {
+	clockid_t clock = regs->rdi;
+	struct timespec *timespec = (void*)regs->rsi;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] clock_gettime: clock {%x}, timespec {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, clock, timespec);
+#endif
+
+	if(clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC) {
+		set_errno(EINVAL);
+		regs->rax = -1;
+		return;
+	}
+
+	*timespec = clock_get(clock);
+
+	regs->rax = 0;
+}
@@ -2,21 +2,73 @@
 
 #include <types.h>
 #include <vector.h>
+#include <lock.h>
 
 #define TIMER_HZ 1000000000
 
-struct waitq_trigger;
+#define CLOCK_REALTIME 0
+#define CLOCK_MONOTONIC 1
+
+#define TIMER_NONE (~0ull)
+
+#define CLOCK_CALIBRATE_MS 20
+
+// hierarchical timer wheel, level n has TIMER_WHEEL_SIZE slots each 8^n wheel clock units wide, timers are
+// rounded up to the granularity of the level they land on, so they never fire early and at most ~1/8 late
+#define TIMER_WHEEL_SHIFT 20 // a wheel clock unit is 2^20ns, ~1ms
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVEL_SHIFT 3
+#define TIMER_WHEEL_DEPTH 8 // ~36 hours, anything further out is requeued from the last level
+
+struct cpu_local;
+struct timer_base;
+struct vdso_time;
 
 struct timer {
-	struct timespec timespec;
-	VECTOR(struct waitq_trigger*) triggers;
+	uint64_t deadline; // monotonic nanoseconds
+	uint64_t expires; // wheel clock units the timer is due at
+
+	void (*function)(struct timer *timer); // runs from the tick of the cpu that armed it
+	void *data;
+
+	struct timer_base *base;
+	struct timer **head; // list the timer is linked on, NULL when it is not pending
+	struct timer *next;
+	struct timer *prev;
 };
 
-extern VECTOR(struct timer*) timer_list;
+struct timer_base {
+	struct spinlock lock;
+	int cpu;
+
+	uint64_t clk; // next wheel clock unit to process
+	uint64_t pending[TIMER_WHEEL_DEPTH]; // bitmap of the non empty slots of each level
+	struct timer *wheel[TIMER_WHEEL_DEPTH][TIMER_WHEEL_SIZE];
 
-extern struct timespec clock_realtime;
-extern struct timespec clock_monotonic;
+	struct timer *expired;
+	struct timer *running;
+
+	size_t armed_cnt;
+	size_t fired_cnt;
+	size_t cancel_cnt;
+};
 
 struct timespec timespec_add(struct timespec a, struct timespec b);
 struct timespec timespec_sub(struct timespec a, struct timespec b);
 struct timespec timespec_convert_ms(int ms);
+
+uint64_t timespec_nanoseconds(struct timespec timespec);
+struct timespec timespec_from_nanoseconds(uint64_t ns);
+
+uint64_t clock_nanoseconds();
+struct timespec clock_get(clockid_t clock);
+void clock_vdso_publish(struct vdso_time *time);
+
+void timer_base_init(struct cpu_local *cpu_local, int cpu);
+void timer_arm(struct timer *timer, struct timespec timespec);
+bool timer_cancel(struct timer *timer);
+void timer_expire(uint64_t now);
+uint64_t timer_next(int cpu);
+
+void clock_init();
@@ -177,9 +177,9 @@ struct stat {
 
 
 static inline void stat_init(struct stat *st) {
-	st->st_atim = clock_realtime;
-	st->st_ctim = clock_realtime;
-	st->st_mtim = clock_realtime;
+	st->st_atim = clock_get(CLOCK_REALTIME);
+	st->st_ctim = clock_get(CLOCK_REALTIME);
+	st->st_mtim = clock_get(CLOCK_REALTIME);
 }
 
 struct dirent {
@@ -5,15 +5,22 @@
 #include <mm/vmm.h>
 #include <mm/mmap.h>
 #include <mm/slab.h>
+#include <mm/reclaim.h>
 #include <int/apic.h>
 #include <int/gdt.h>
 #include <int/idt.h>
+#include <int/clockevent.h>
 #include <sched/smp.h>
 #include <sched/ehfi.h>
+#include <sched/vdso.h>
+#include <sched/preempt.h>
+#include <sched/workqueue.h>
+#include <int/trace.h>
+#include <int/sysprof.h>
+#include <klog.h>
 #include <acpi/rsdp.h>
 #include <drivers/hpet.h>
 #include <drivers/pci.h>
-#include <drivers/pit.h>
 #include <drivers/iommu/intel/vtd.h>
 #include <drivers/tty/limine_term.h>
 #include <drivers/fbdev.h>
@@ -52,6 +59,9 @@ static volatile struct limine_kernel_file_request limine_kernel_file_request = {
 	.revision = 0
 };
 
+// stands in for the cpu_local of the bsp until boot_aps, so CORE_LOCAL reads NULL instead of faulting through gs
+static struct cpu_local boot_cpu_local;
+
 static ssize_t kernel_file_read(struct elf_file*, void *buffer, off_t offset, size_t cnt) {
 	struct limine_file *file = limine_kernel_file_request.response->kernel_file;
 
@@ -81,7 +91,7 @@ void init_process() {
 	};
 
 	struct task *task = alloc(sizeof(struct task));
-	sched_default_task(task, CURRENT_TASK->namespace, 1);
+	sched_default_task(task, CURRENT_TASK->namespace);
 
 	int ret = sched_load_program(task, argv[0]);
 	if(ret == -1) panic("unable to start init process");
@@ -100,9 +110,10 @@ void init_process() {
 
 	VECTOR_PUSH(task->group->process_list, task);
 
-	task->sched_status = TASK_WAITING;
 	task->signal_queue.active = true;
 
+	sched_requeue(task);
+
 	sched_dequeue(CURRENT_TASK);
 
 	for(;;)
@@ -118,6 +129,15 @@ void pastoral_thread() {
 	limine_terminals_init();
 	self_tty_init();
 	pty_init();
+	schedstat_init();
+	ehfi_dev_init();
+	workqueue_init();
+	workqueue_dev_init();
+	trace_init();
+	trace_dev_init();
+	sysprof_init();
+	sysprof_dev_init();
+	klog_dev_init();
 
 	struct limine_framebuffer **framebuffers = limine_framebuffer_request.response->framebuffers;
 	uint64_t framebuffer_count = limine_framebuffer_request.response->framebuffer_count;
@@ -136,6 +156,7 @@ void pastoral_thread() {
 	}
 
 	ps2_init();
+	reclaim_init();
 
 	init_process();
 
@@ -171,6 +192,9 @@ void pastoral_entry(void) {
 	gdt_init();
 	idt_init();
 
+	wrmsr(MSR_GS_BASE, (uintptr_t)&boot_cpu_local);
+	preempt_init();
+
 	kernel_file.read = kernel_file_read;
 	if(elf64_file_init(&kernel_file) == -1) {
 		panic("could not parse kernel file");
@@ -188,19 +212,21 @@ void pastoral_entry(void) {
 
 	fadt = acpi_find_sdt("FACP");
 
+	hpet_init();
+	clock_init();
+	vdso_init();
+
 	vfs_init();
 
-	hpet_init();
 	apic_init();
 	boot_aps();
 	pci_init();
-	pit_init();
-
-	apic_timer_init(20);
+	clockevent_init();
+	ehfi_init();
 
 	struct pid_namespace *namespace = sched_default_namespace();
 	struct task *kernel_task = alloc(sizeof(struct task));
-	sched_default_task(kernel_task, namespace, 1);
+	sched_default_task(kernel_task, namespace);
 
 	kernel_task->regs.cs = 0x28;
 	kernel_task->regs.ss = 0x30;
@@ -214,7 +240,9 @@ void pastoral_entry(void) {
 
 	task_create_session(kernel_task, true);
 
-	kernel_task->sched_status = TASK_WAITING;
+	sched_requeue(kernel_task);
+
+	klog_init();
 
 	asm ("sti");
 
@@ -7,7 +7,9 @@
 #include <bst.h>
 #include <string.h>
 #include <fs/vfs.h>
+#include <fs/fd.h>
 #include <mm/pmm.h>
+#include <mm/reclaim.h>
 
 static ssize_t validate_region(struct page_table *page_table, uint64_t base, uint64_t length) {
 	struct mmap_region *root = page_table->mmap_region_root;
@@ -49,14 +51,100 @@ static struct mmap_region *mmap_search_region(struct page_table *page_table, uin
 	return root;
 }
 
-static int mmap_shared_pages(struct page_table *page_table, uintptr_t vaddr, int fd, off_t offset, int length, int prot) {
-	struct fd_handle *handle = fd_translate(fd);
-	if(handle == NULL) {
-		set_errno(EBADF);
-		return -1;
+// some region overlapping the range, NULL when it is free
+static struct mmap_region *mmap_range_region(struct mmap_region *root, uint64_t base, uint64_t length) {
+	while(root) {
+		if(root->base >= base + length) {
+			root = root->left;
+		} else if(root->base + root->limit <= base) {
+			root = root->right;
+		} else {
+			return root;
+		}
+	}
+
+	return NULL;
+}
+
+static bool mmap_range_conflict(struct mmap_region *root, uint64_t base, uint64_t length) {
+	return mmap_range_region(root, base, length) != NULL;
+}
+
+// a new region for [base, base + limit) of region, with its own reference on the file
+static struct mmap_region *mmap_region_split(struct mmap_region *region, uint64_t base, size_t limit) {
+	struct mmap_region *split = alloc(sizeof(struct mmap_region));
+
+	*split = (struct mmap_region) {
+		.base = base,
+		.limit = limit,
+		.prot = region->prot,
+		.flags = region->flags,
+		.file = region->file,
+		.offset = region->offset + (base - region->base)
+	};
+
+	if(split->file) {
+		file_get(split->file);
+	}
+
+	return split;
+}
+
+static void mmap_region_free(struct mmap_region *region) {
+	if(region->file) {
+		file_put(region->file);
+	}
+
+	free(region);
+}
+
+static uint64_t mmap_find_base(struct page_table *page_table, uint64_t length) {
+	uint64_t base = page_table->mmap_bump_base;
+
+	for(;;) {
+		ssize_t conflict_offset = validate_region(page_table, base, length);
+
+		if(conflict_offset == -1) {
+			break;
+		}
+
+		base += conflict_offset;
+	}
+
+	page_table->mmap_bump_base = base;
+	page_table->mmap_bump_base += length;
+
+	return base;
+}
+
+static void mmap_release_pages(struct page_table *page_table, uint64_t base, size_t cnt) {
+	for(size_t i = 0; i < cnt; i++) {
+		struct page *page = hash_table_search(page_table->pages, &base, sizeof(base));
+
+		if(page) {
+			if(page->flags & VMM_SHARE_FLAG) {
+				(*page->reference)--;
+
+				if(*page->reference == 0 && page->file) {
+					if(page->file->ops->shared == NULL) {
+						page->file->ops->write(page->file, (void*)(page->frame->addr + HIGH_VMA), PAGE_SIZE, page->offset);
+					}
+
+					hash_table_delete(&page->file->vfs_node->shared_pages, &page->vaddr, sizeof(page->vaddr));
+				}
+			}
+
+			hash_table_delete(page_table->pages, &base, sizeof(base));
+			reclaim_page_release(page);
+		}
+
+		page_table->unmap_page(page_table, base);
+		base += PAGE_SIZE;
 	}
+}
 
-	file_get(handle->file_handle);
+static int mmap_shared_pages(struct page_table *page_table, uintptr_t vaddr, struct file_handle *file, off_t offset, int length, int prot) {
+	file_get(file);
 	offset = offset & ~(0xfff);
 
 	uint64_t flags = VMM_FILE_FLAG | VMM_SHARE_FLAG | VMM_FLAGS_NX;
@@ -66,7 +154,7 @@ static int mmap_shared_pages(struct page_table *page_table, uintptr_t vaddr, int
 	if(prot & MMAP_PROT_EXEC) flags &= ~(VMM_FLAGS_NX);
 
 	for(size_t i = 0; i < DIV_ROUNDUP(length, PAGE_SIZE); i++) {
-		struct page *page = hash_table_search(&handle->file_handle->vfs_node->shared_pages, &offset, sizeof(offset));
+		struct page *page = hash_table_search(&file->vfs_node->shared_pages, &offset, sizeof(offset));
 		struct page *new_page = alloc(sizeof(struct page));
 
 		if(page) {
@@ -87,10 +175,10 @@ static int mmap_shared_pages(struct page_table *page_table, uintptr_t vaddr, int
 			struct frame *frame = alloc(sizeof(struct frame));
 			uint64_t extra_flags = 0;
 
-			if(handle->file_handle->ops->shared == NULL) {
+			if(file->ops->shared == NULL) {
 				frame->addr = pmm_alloc(1, 1);
 			} else {
-				frame->addr = (uint64_t)handle->file_handle->ops->shared(handle->file_handle, NULL, offset);
+				frame->addr = (uint64_t)file->ops->shared(file, NULL, offset);
 				extra_flags |= VMM_FLAGS_P;
 			}
 
@@ -99,7 +187,7 @@ static int mmap_shared_pages(struct page_table *page_table, uintptr_t vaddr, int
 				.frame = frame,
 				.size = PAGE_SIZE,
 				.flags = flags | extra_flags,
-				.file = handle->file_handle,
+				.file = file,
 				.offset = offset,
 				.pml_entry = page_table->map_page(page_table, vaddr, frame->addr, flags | extra_flags),
 				.reference = alloc(sizeof(int))
@@ -109,7 +197,7 @@ static int mmap_shared_pages(struct page_table *page_table, uintptr_t vaddr, int
 		}
 
 		hash_table_push(page_table->pages, &new_page->vaddr, new_page, sizeof(new_page->vaddr));
-		hash_table_push(&handle->file_handle->vfs_node->shared_pages, &new_page->offset, new_page, sizeof(new_page->vaddr));
+		hash_table_push(&file->vfs_node->shared_pages, &new_page->offset, new_page, sizeof(new_page->vaddr));
 
 		offset += PAGE_SIZE;
 		vaddr += PAGE_SIZE;
@@ -118,14 +206,8 @@ static int mmap_shared_pages(struct page_table *page_table, uintptr_t vaddr, int
 	return 0;
 }
 
-static int mmap_private_pages(struct page_table *page_table, uintptr_t vaddr, int fd, off_t offset, int length, int prot) {
-	struct fd_handle *handle = fd_translate(fd);
-	if(handle == NULL) {
-		set_errno(EBADF);
-		return -1;
-	}
-
-	file_get(handle->file_handle);
+static int mmap_private_pages(struct page_table *page_table, uintptr_t vaddr, struct file_handle *file, off_t offset, int length, int prot) {
+	file_get(file);
 	offset = offset & ~(0xfff);
 
 	uint64_t flags = VMM_FILE_FLAG | VMM_FLAGS_NX;
@@ -145,7 +227,7 @@ static int mmap_private_pages(struct page_table *page_table, uintptr_t vaddr, in
 			.frame = frame,
 			.size = PAGE_SIZE,
 			.flags = flags,
-			.file = handle->file_handle,
+			.file = file,
 			.offset = offset,
 			.pml_entry = page_table->map_page(page_table, vaddr, frame->addr, flags),
 			.reference = alloc(sizeof(int))
@@ -154,6 +236,7 @@ static int mmap_private_pages(struct page_table *page_table, uintptr_t vaddr, in
 		(*page->reference) = 1;
 
 		hash_table_push(page_table->pages, &page->vaddr, page, sizeof(page->vaddr));
+		reclaim_lru_add(page_table, page);
 
 		offset += PAGE_SIZE;
 		vaddr += PAGE_SIZE;
@@ -170,20 +253,7 @@ void *mmap(struct page_table *page_table, void *addr, size_t length, int prot, i
 	if(flags & MMAP_MAP_FIXED) {
 		base = (uintptr_t)addr;
 	} else {
-		base = page_table->mmap_bump_base;
-
-		for(;;) {
-			ssize_t conflict_offset = validate_region(page_table, base, length);
-
-			if(conflict_offset == -1) {
-				break;
-			}
-
-			base += conflict_offset;
-		}
-
-		page_table->mmap_bump_base = base;
-		page_table->mmap_bump_base += length;
+		base = mmap_find_base(page_table, length);
 	}
 
 	if(length == 0 || base == 0) {
@@ -196,19 +266,28 @@ void *mmap(struct page_table *page_table, void *addr, size_t length, int prot, i
 		return (void*)-1;
 	}
 
+	struct file_handle *file = NULL;
+
+	// the region keeps the file itself, the fd is usually closed right after the mmap
 	if(!(flags & MMAP_MAP_ANONYMOUS)) {
-		if(flags & MMAP_MAP_SHARED) {
-			if(mmap_shared_pages(page_table, base, fd, offset, length, prot) == -1) {
-				return (void*)-1;
-			}
-		} else if(flags & MMAP_MAP_PRIVATE) {
-			if(mmap_private_pages(page_table, base, fd, offset, length, prot) == -1) {
-				return (void*)-1;
-			}
-		} else {
+		if(!(flags & (MMAP_MAP_SHARED | MMAP_MAP_PRIVATE))) {
 			set_errno(EINVAL);
 			return (void*)-1;
 		}
+
+		file = fd_file_get(fd);
+		if(file == NULL) {
+			set_errno(EBADF);
+			return (void*)-1;
+		}
+
+		int ret = (flags & MMAP_MAP_SHARED) ? mmap_shared_pages(page_table, base, file, offset, length, prot) :
+			mmap_private_pages(page_table, base, file, offset, length, prot);
+
+		if(ret == -1) {
+			file_put(file);
+			return (void*)-1;
+		}
 	}
 
 	struct mmap_region *region = alloc(sizeof(struct mmap_region));
@@ -218,7 +297,7 @@ void *mmap(struct page_table *page_table, void *addr, size_t length, int prot, i
 		.limit = length,
 		.prot = prot,
 		.flags = flags,
-		.fd = fd,
+		.file = file,
 		.offset = offset
 	};
 
@@ -268,74 +347,199 @@ int munmap(struct page_table *page_table, void *addr, size_t length) {
 		return -1;
 	}
 
-	struct mmap_region *region = mmap_search_region(page_table, base);
+	uint64_t end = base + length;
+	struct mmap_region *region;
+
+	// every region the range touches loses its overlap, whatever sticks out on either side stays mapped
+	while((region = mmap_range_region(page_table->mmap_region_root, base, length))) {
+		uint64_t region_end = region->base + region->limit;
+		uint64_t unmap_base = region->base > base ? region->base : base;
+		uint64_t unmap_end = region_end < end ? region_end : end;
+
+		BST_GENERIC_DELETE(page_table->mmap_region_root, base, region);
+
+		if(region->base < unmap_base) {
+			struct mmap_region *lower_split = mmap_region_split(region, region->base, unmap_base - region->base);
+			BST_GENERIC_INSERT(page_table->mmap_region_root, base, lower_split);
+		}
+
+		if(region_end > unmap_end) {
+			struct mmap_region *upper_split = mmap_region_split(region, unmap_end, region_end - unmap_end);
+			BST_GENERIC_INSERT(page_table->mmap_region_root, base, upper_split);
+		}
+
+		mmap_release_pages(page_table, unmap_base, (unmap_end - unmap_base) / PAGE_SIZE);
+		mmap_region_free(region);
+	}
+
+	return 0;
+}
+
+static void mremap_move_pages(struct page_table *page_table, uint64_t old_base, uint64_t new_base, size_t cnt) {
+	for(size_t i = 0; i < cnt; i++) {
+		uint64_t old_vaddr = old_base + i * PAGE_SIZE;
+		uint64_t new_vaddr = new_base + i * PAGE_SIZE;
+
+		struct page *page = hash_table_search(page_table->pages, &old_vaddr, sizeof(old_vaddr));
+		if(page == NULL) { // never faulted in, the new range will demand page it
+			continue;
+		}
+
+		hash_table_delete(page_table->pages, &old_vaddr, sizeof(old_vaddr));
+
+		uint64_t entry = *page->pml_entry;
+
+		*page->pml_entry = 0;
+		invlpg(old_vaddr);
+
+		page->vaddr = new_vaddr;
+		page->pml_entry = page_table->map_page(page_table, new_vaddr, entry & VMM_ADDR_MASK, entry & ~VMM_ADDR_MASK);
+
+		hash_table_push(page_table->pages, &page->vaddr, page, sizeof(page->vaddr));
+	}
+}
 
-	if(region == NULL) {
+static int mremap_extend_file(struct page_table *page_table, struct mmap_region *region, uint64_t base, size_t length) {
+	if(region->file == NULL) {
 		return 0;
 	}
 
-	if(length > region->limit) {
-		munmap(page_table, (void*)(base + region->limit), length - region->limit);
-		length = region->limit;
+	off_t offset = region->offset + (base - region->base);
+
+	if(region->flags & MMAP_MAP_SHARED) {
+		return mmap_shared_pages(page_table, base, region->file, offset, length, region->prot);
 	}
 
-	struct mmap_region *lower_split = NULL;
-	struct mmap_region *upper_split = NULL;
+	return mmap_private_pages(page_table, base, region->file, offset, length, region->prot);
+}
 
-	if(region->base > base) {
-		lower_split = alloc(sizeof(struct mmap_region));
+void *mremap(struct page_table *page_table, void *old_address, size_t old_size, size_t new_size, int flags, void *new_address) {
+	uint64_t old_base = (uint64_t)old_address;
 
-		*lower_split = (struct mmap_region) {
-			.base = region->base,
-			.limit = region->base - base,
-			.prot = region->prot,
-			.flags = region->flags,
-			.fd = region->fd,
-			.offset = region->offset
-		};
+	old_size = ALIGN_UP(old_size, PAGE_SIZE);
+	new_size = ALIGN_UP(new_size, PAGE_SIZE);
+
+	if((old_base % PAGE_SIZE != 0) || new_size == 0 || (flags & ~(MREMAP_MAYMOVE | MREMAP_FIXED))) {
+		set_errno(EINVAL);
+		return (void*)-1;
 	}
 
-	if(region->limit > length) {
-		upper_split = alloc(sizeof(struct mmap_region));
+	if((flags & MREMAP_FIXED) && (!(flags & MREMAP_MAYMOVE) || ((uint64_t)new_address % PAGE_SIZE != 0))) {
+		set_errno(EINVAL);
+		return (void*)-1;
+	}
 
-		*upper_split = (struct mmap_region) {
-			.base = region->base + length,
-			.limit = length - region->limit,
-			.prot = region->prot,
-			.flags = region->flags,
-			.fd = region->fd,
-			.offset = region->offset
-		};
+	struct mmap_region *region = mmap_search_region(page_table, old_base);
+	if(region == NULL || old_size == 0 || (old_base + old_size) > (region->base + region->limit)) {
+		set_errno(EFAULT);
+		return (void*)-1;
 	}
 
-	BST_GENERIC_DELETE(page_table->mmap_region_root, base, region);
-	BST_GENERIC_INSERT(page_table->mmap_region_root, base, lower_split);
-	BST_GENERIC_INSERT(page_table->mmap_region_root, base, upper_split);
+	bool region_tail = (old_base + old_size) == (region->base + region->limit);
 
-	for(size_t i = 0; i < region->limit / PAGE_SIZE; i++) {
-		struct page *page = hash_table_search(CURRENT_TASK->page_table->pages, &base, sizeof(base));
+	if(!(flags & MREMAP_FIXED)) {
+		if(new_size <= old_size) {
+			if(new_size == old_size) {
+				return old_address;
+			}
 
-		if(page) {
-			if(page->flags & VMM_SHARE_FLAG) {
-				(*page->reference)--;
+			if(region_tail) {
+				region->limit -= old_size - new_size;
+				mmap_release_pages(page_table, old_base + new_size, (old_size - new_size) / PAGE_SIZE);
+				return old_address;
+			}
 
-				if(*page->reference == 0 && page->file) {
-					if(page->file->ops->shared == NULL) {
-						page->file->ops->write(page->file, (void*)(page->frame->addr + HIGH_VMA), PAGE_SIZE, page->offset);
-					}
+			if(munmap(page_table, (void*)(old_base + new_size), old_size - new_size) == -1) {
+				return (void*)-1;
+			}
 
-					hash_table_delete(&page->file->vfs_node->shared_pages, &page->vaddr, sizeof(page->vaddr));
-				}
+			return old_address;
+		}
+
+		// grow in place when the gap after the region is free, nothing has to move
+
+		size_t growth = new_size - old_size;
+
+		if(region_tail && !mmap_range_conflict(page_table->mmap_region_root, old_base + old_size, growth)) {
+			if(mremap_extend_file(page_table, region, old_base + old_size, growth) == -1) {
+				return (void*)-1;
+			}
+
+			region->limit += growth;
+
+			if(page_table->mmap_bump_base < region->base + region->limit) {
+				page_table->mmap_bump_base = region->base + region->limit;
 			}
 
-			hash_table_delete(CURRENT_TASK->page_table->pages, &base, sizeof(base));
+			return old_address;
 		}
 
-		page_table->unmap_page(page_table, base);
-		base += PAGE_SIZE;
+		if(!(flags & MREMAP_MAYMOVE)) {
+			set_errno(ENOMEM);
+			return (void*)-1;
+		}
 	}
 
-	return 0;
+	uint64_t new_base;
+
+	if(flags & MREMAP_FIXED) {
+		new_base = (uint64_t)new_address;
+
+		if(new_base < old_base + old_size && old_base < new_base + new_size) {
+			set_errno(EINVAL);
+			return (void*)-1;
+		}
+
+		if(mmap_range_conflict(page_table->mmap_region_root, new_base, new_size)) {
+			munmap(page_table, (void*)new_base, new_size);
+		}
+	} else {
+		new_base = mmap_find_base(page_table, new_size);
+	}
+
+	// relocate the page table entries, the frames themselves are never copied
+
+	size_t move_size = old_size < new_size ? old_size : new_size;
+
+	struct mmap_region *new_region = mmap_region_split(region, old_base, new_size);
+	new_region->base = new_base;
+
+	// the only step that can fail goes first, the old mapping is still whole if it does
+	if(new_size > old_size) {
+		if(mremap_extend_file(page_table, new_region, new_base + old_size, new_size - old_size) == -1) {
+			mmap_release_pages(page_table, new_base + old_size, (new_size - old_size) / PAGE_SIZE);
+			mmap_region_free(new_region);
+			return (void*)-1;
+		}
+	}
+
+	mremap_move_pages(page_table, old_base, new_base, move_size / PAGE_SIZE);
+
+	if(old_size > new_size) {
+		mmap_release_pages(page_table, old_base + new_size, (old_size - new_size) / PAGE_SIZE);
+	}
+
+	if(old_base == region->base && old_size == region->limit) {
+		BST_GENERIC_DELETE(page_table->mmap_region_root, base, region);
+		mmap_region_free(region);
+	} else if(region_tail) {
+		region->limit -= old_size;
+	} else if(old_base == region->base) {
+		region->base += old_size;
+		region->limit -= old_size;
+		region->offset += old_size;
+	} else {
+		struct mmap_region *upper_split = mmap_region_split(region, old_base + old_size,
+			region->base + region->limit - (old_base + old_size));
+
+		region->limit = old_base - region->base;
+
+		BST_GENERIC_INSERT(page_table->mmap_region_root, base, upper_split);
+	}
+
+	BST_GENERIC_INSERT(page_table->mmap_region_root, base, new_region);
+
+	return (void*)new_base;
 }
 
 extern void syscall_mmap(struct registers *regs) {
@@ -352,7 +556,7 @@ extern void syscall_mmap(struct registers *regs) {
 	int fd = regs->r8;
 	off_t offset = regs->r9;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] mmap: addr {%x}, length {%x}, prot {%x}, flags {%x}, fd {%x}, offset {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, (uintptr_t)addr, length, prot, flags, fd, offset);
 #endif
 
@@ -369,9 +573,29 @@ extern void syscall_munmap(struct registers *regs) {
 	void *addr = (void*)regs->rdi;
 	size_t length = regs->rsi;
 
-#ifndef SYSCALL_DBEUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] munmap: addr {%x}, length {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, (uintptr_t)addr, length);
 #endif
 
 	regs->rax = munmap(page_table, addr, length);
 }
+
+extern void syscall_mremap(struct registers *regs) {
+	struct task *current_task = CURRENT_TASK;
+	if(current_task == NULL) {
+		panic("cant find current task");
+	}
+
+	struct page_table *page_table = current_task->page_table;
+	void *old_address = (void*)regs->rdi;
+	size_t old_size = regs->rsi;
+	size_t new_size = regs->rdx;
+	int flags = regs->r10;
+	void *new_address = (void*)regs->r8;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] mremap: old_address {%x}, old_size {%x}, new_size {%x}, flags {%x}, new_address {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, (uintptr_t)old_address, old_size, new_size, flags, (uintptr_t)new_address);
+#endif
+
+	regs->rax = (uint64_t)mremap(page_table, old_address, old_size, new_size, flags, new_address);
+}
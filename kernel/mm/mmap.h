@@ -15,5 +15,10 @@
 #define MMAP_PROT_EXEC 0x4
 #define MMAP_PROT_USER 0x8
 
+#define MREMAP_MAYMOVE 0x1
+#define MREMAP_FIXED 0x2
+
+
 void *mmap(struct page_table *page_table, void *addr, size_t length, int prot, int flags, int fd, off_t offset);
 int munmap(struct page_table *page_table, void *addr, size_t length);
+void *mremap(struct page_table *page_table, void *old_address, size_t old_size, size_t new_size, int flags, void *new_address);
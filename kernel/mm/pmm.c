@@ -5,6 +5,9 @@
 #include <string.h>
 #include <limine.h>
 #include <lock.h>
+#include <mm/reclaim.h>
+
+#define PMM_RECLAIM_RETRIES 4
 
 struct pmm_module {
 	struct limine_memmap_entry *mmap_entry;
@@ -22,6 +25,9 @@ struct pmm_module {
 static struct pmm_module *root_module;
 static void *meta_buffer;
 
+uint64_t pmm_total_pages;
+uint64_t pmm_free_pages;
+
 volatile struct limine_memmap_request limine_memmap_request = {
 	.id = LIMINE_MEMMAP_REQUEST,
 	.revision = 0
@@ -38,6 +44,9 @@ static void pmm_init_module(struct pmm_module *module, struct limine_memmap_entr
 	memset8(module->bitmap, 0, module->bitmap_size);
 
 	meta_buffer += module->bitmap_size;
+
+	pmm_total_pages += page_cnt;
+	pmm_free_pages += page_cnt;
 }
 
 static uint64_t pmm_module_alloc(struct pmm_module *module, uint64_t cnt, uint64_t align) {
@@ -63,6 +72,8 @@ static uint64_t pmm_module_alloc(struct pmm_module *module, uint64_t cnt, uint64
 					BIT_SET(module->bitmap, i + z);
 				}
 
+				__atomic_sub_fetch(&pmm_free_pages, count, __ATOMIC_RELAXED);
+
 				module->last_free = 0;
 
 				for(size_t z = j; z < module->bitmap_entry_cnt; z++) {
@@ -87,8 +98,17 @@ static uint64_t pmm_module_alloc(struct pmm_module *module, uint64_t cnt, uint64
 static void pmm_module_free(struct pmm_module *module, uint64_t base, uint64_t cnt) {
 	spinlock_irqsave(&module->lock);
 
-	for(size_t i = DIV_ROUNDUP(base, PAGE_SIZE); i < (DIV_ROUNDUP(base, PAGE_SIZE) + cnt); i++) {
-		BIT_CLEAR(module->bitmap, i);
+	size_t index = DIV_ROUNDUP(base, PAGE_SIZE);
+
+	for(size_t i = index; i < (index + cnt); i++) {
+		if(BIT_TEST(module->bitmap, i)) {
+			BIT_CLEAR(module->bitmap, i);
+			__atomic_add_fetch(&pmm_free_pages, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	if(index < module->last_free) { // allocations only scan forward from last_free
+		module->last_free = index;
 	}
 
 	spinrelease_irqsave(&module->lock);
@@ -161,7 +181,7 @@ void pmm_init() {
 }
 
 
-uint64_t pmm_alloc(uint64_t cnt, uint64_t align) {
+static uint64_t pmm_try_alloc(uint64_t cnt, uint64_t align) {
 	struct pmm_module *module = root_module;
 
 	do {
@@ -180,6 +200,21 @@ uint64_t pmm_alloc(uint64_t cnt, uint64_t align) {
 	return -1;
 }
 
+uint64_t pmm_alloc(uint64_t cnt, uint64_t align) {
+	for(int i = 0; i < PMM_RECLAIM_RETRIES; i++) {
+		uint64_t alloc = pmm_try_alloc(cnt, align);
+		if(alloc != -1) {
+			return alloc;
+		}
+
+		if(reclaim_direct(cnt) == 0) {
+			break;
+		}
+	}
+
+	return -1;
+}
+
 void pmm_free(uint64_t base, uint64_t cnt) {
 	struct pmm_module *module = root_module;
 
@@ -6,4 +6,7 @@ void pmm_init();
 uint64_t pmm_alloc(uint64_t cnt, uint64_t align);
 void pmm_free(uint64_t base, uint64_t cnt);
 
+extern uint64_t pmm_total_pages;
+extern uint64_t pmm_free_pages;
+
 extern volatile struct limine_memmap_request limine_memmap_request;
@@ -0,0 +1,328 @@
+#include <mm/reclaim.h>
+#include <mm/swap.h>
+#include <mm/pmm.h>
+#include <sched/sched.h>
+#include <cpu.h>
+#include <debug.h>
+#include <lock.h>
+
+struct lru_list {
+	struct page *head;
+	struct page *tail;
+	size_t length;
+};
+
+static struct lru_list lru_active;
+static struct lru_list lru_inactive;
+
+static struct spinlock reclaim_lock;
+
+static uint64_t reclaim_low_pages;
+static uint64_t reclaim_high_pages;
+
+static struct task *kswapd_task;
+static struct waitq kswapd_waitq;
+
+static struct lru_list *lru_get(int lru) {
+	return lru == LRU_ACTIVE ? &lru_active : &lru_inactive;
+}
+
+static void lru_remove(struct page *page) {
+	if(page->lru == LRU_NONE) {
+		return;
+	}
+
+	struct lru_list *list = lru_get(page->lru);
+
+	if(page->lru_prev) page->lru_prev->lru_next = page->lru_next;
+	else list->head = page->lru_next;
+
+	if(page->lru_next) page->lru_next->lru_prev = page->lru_prev;
+	else list->tail = page->lru_prev;
+
+	page->lru_next = NULL;
+	page->lru_prev = NULL;
+	page->lru = LRU_NONE;
+
+	list->length--;
+}
+
+static void lru_push(struct page *page, int lru) {
+	lru_remove(page);
+
+	struct lru_list *list = lru_get(lru);
+
+	page->lru_prev = NULL;
+	page->lru_next = list->head;
+
+	if(list->head) list->head->lru_prev = page;
+	else list->tail = page;
+
+	list->head = page;
+	list->length++;
+
+	page->lru = lru;
+}
+
+static bool reclaim_page_referenced(struct page *page) {
+	return __atomic_fetch_and(page->pml_entry, ~VMM_FLAGS_A, __ATOMIC_SEQ_CST) & VMM_FLAGS_A;
+}
+
+static bool reclaim_page_evictable(struct page *page) {
+	if(page->flags & VMM_SHARE_FLAG || *page->reference > 1) {
+		return false;
+	}
+
+	return page->frame->locks.length == 0; // futexes are keyed on the physical address
+}
+
+static int reclaim_evict(struct page *page, int flags) {
+	uint64_t entry = __atomic_fetch_and(page->pml_entry, ~VMM_FLAGS_P, __ATOMIC_SEQ_CST);
+	uint64_t stripped = entry & ~(VMM_ADDR_MASK | VMM_FLAGS_P | VMM_FLAGS_A | VMM_FLAGS_D);
+
+	if(!(entry & VMM_FLAGS_P) && !(entry & VMM_FILE_FLAG)) {
+		return -1;
+	}
+
+	if((entry & VMM_FILE_FLAG) && !(entry & VMM_FLAGS_D)) { // clean file pages are read back from the file
+		*page->pml_entry = stripped;
+		pmm_free(page->frame->addr, 1);
+		page->frame->addr = 0;
+		return 0;
+	}
+
+	uint64_t neighbour_vaddr = page->vaddr - PAGE_SIZE;
+	struct page *neighbour = hash_table_search(page->page_table->pages, &neighbour_vaddr, sizeof(neighbour_vaddr));
+
+	struct swap_device *hint_device = NULL;
+	uint64_t hint = 0;
+
+	if(neighbour && neighbour->swap) {
+		hint_device = neighbour->swap;
+		hint = neighbour->swap_slot + 1;
+	}
+
+	uint64_t slot;
+	struct swap_device *device = swap_slot_alloc(hint_device, hint, &slot, flags);
+	if(device == NULL) {
+		*page->pml_entry = entry;
+		return -1;
+	}
+
+	if(swap_write(device, slot, page->frame->addr) == -1) {
+		swap_slot_free(device, slot);
+		*page->pml_entry = entry;
+		return -1;
+	}
+
+	*page->pml_entry = stripped | VMM_SWAP_FLAG;
+
+	page->swap = device;
+	page->swap_slot = slot;
+
+	pmm_free(page->frame->addr, 1);
+	page->frame->addr = 0;
+
+	return 0;
+}
+
+static int reclaim_scan(int flags) {
+	if(lru_inactive.length < lru_active.length) {
+		struct page *page = lru_active.tail;
+		lru_push(page, reclaim_page_referenced(page) ? LRU_ACTIVE : LRU_INACTIVE);
+	}
+
+	struct page *page = lru_inactive.tail;
+	if(page == NULL) {
+		return -1;
+	}
+
+	if(reclaim_page_referenced(page)) {
+		lru_push(page, LRU_ACTIVE);
+		return 0;
+	}
+
+	// there is no tlb shootdown, so only address spaces that no cpu has loaded can be unmapped,
+	// and holding the table's lock keeps any cpu from loading it until the entry is settled
+	struct page_table *page_table = page->page_table;
+	spinlock_irqsave(&page_table->lock);
+
+	int ret = -1;
+	if(__atomic_load_n(&page_table->loaded, __ATOMIC_SEQ_CST) == 0 && reclaim_page_evictable(page)) {
+		ret = reclaim_evict(page, flags);
+	}
+
+	spinrelease_irqsave(&page_table->lock);
+
+	if(ret == -1) {
+		lru_push(page, LRU_INACTIVE);
+		return 0;
+	}
+
+	lru_remove(page);
+
+	return 1;
+}
+
+static size_t reclaim_shrink(size_t target, int flags, bool direct) {
+	size_t reclaimed = 0;
+	size_t budget = (lru_active.length + lru_inactive.length) * 2;
+
+	for(size_t scanned = 0; reclaimed < target && scanned < budget; scanned++) {
+		if(!direct) {
+			spinlock_irqsave(&reclaim_lock);
+		} else if(!spintrylock_irqsave(&reclaim_lock)) { // the holder may be waiting on a lock our caller owns, or be us
+			break;
+		}
+
+		int ret = reclaim_scan(flags);
+		spinrelease_irqsave(&reclaim_lock);
+
+		if(ret == -1) {
+			break;
+		}
+
+		reclaimed += ret;
+	}
+
+	return reclaimed;
+}
+
+size_t reclaim_direct(size_t cnt) {
+	if(kswapd_task == NULL) {
+		return 0;
+	}
+
+	// file backed swap goes through the slab allocator, leave that to kswapd
+	return reclaim_shrink(cnt > RECLAIM_BATCH ? cnt : RECLAIM_BATCH, 0, true);
+}
+
+static void kswapd(void*) {
+	struct timespec interval = { .tv_sec = 0, .tv_nsec = KSWAPD_INTERVAL * 1000000 };
+
+	for(;;) {
+		waitq_set_timer(&kswapd_waitq, interval);
+		waitq_wait(&kswapd_waitq, EVENT_TIMER);
+		waitq_release(&kswapd_waitq, EVENT_TIMER);
+		waitq_clear_timer(&kswapd_waitq);
+
+		if(pmm_free_pages >= reclaim_low_pages) {
+			continue;
+		}
+
+		while(pmm_free_pages < reclaim_high_pages) {
+			if(reclaim_shrink(RECLAIM_BATCH, SWAP_ALLOW_FILE, false) == 0) {
+				break;
+			}
+		}
+	}
+}
+
+static int reclaim_swap_in(struct page_table *page_table, struct page *page) {
+	struct swap_device *device = page->swap;
+	struct page *cluster[SWAP_CLUSTER_MAX] = { page };
+	size_t cnt = 1;
+
+	for(; cnt < SWAP_CLUSTER_MAX; cnt++) { // read-ahead the neighbours that were swapped out next to this page
+		uint64_t vaddr = page->vaddr + cnt * PAGE_SIZE;
+
+		struct page *next = hash_table_search(page_table->pages, &vaddr, sizeof(vaddr));
+		if(next == NULL || next->swap != device || next->swap_slot != page->swap_slot + cnt) {
+			break;
+		}
+
+		cluster[cnt] = next;
+	}
+
+	uint64_t base = pmm_alloc(cnt, 1);
+	if(base == -1 && cnt > 1) {
+		cnt = 1;
+		base = pmm_alloc(1, 1);
+	}
+
+	if(base == -1) {
+		return -1;
+	}
+
+	if(swap_read(device, page->swap_slot, cnt, base) == -1) {
+		pmm_free(base, cnt);
+		return -1;
+	}
+
+	for(size_t i = 0; i < cnt; i++) {
+		struct page *swapped = cluster[i];
+
+		swapped->frame->addr = base + i * PAGE_SIZE;
+		*swapped->pml_entry = (*swapped->pml_entry & ~(VMM_SWAP_FLAG)) | swapped->frame->addr | VMM_FLAGS_P;
+
+		swap_slot_free(device, swapped->swap_slot);
+
+		swapped->swap = NULL;
+		swapped->swap_slot = 0;
+
+		lru_push(swapped, i == 0 ? LRU_ACTIVE : LRU_INACTIVE);
+	}
+
+	return 0;
+}
+
+int reclaim_swap_fault(struct page_table *page_table, uintptr_t vaddr) {
+	spinlock_irqsave(&reclaim_lock);
+
+	struct page *page = hash_table_search(page_table->pages, &vaddr, sizeof(vaddr));
+	int ret = page == NULL ? -1 : 0;
+
+	if(page && page->swap) {
+		ret = reclaim_swap_in(page_table, page);
+	}
+
+	spinrelease_irqsave(&reclaim_lock);
+
+	return ret;
+}
+
+int reclaim_page_restore(struct page_table *page_table, struct page *page) {
+	int ret = 0;
+
+	spinlock_irqsave(&reclaim_lock);
+
+	if(page->swap) {
+		ret = reclaim_swap_in(page_table, page);
+	}
+
+	spinrelease_irqsave(&reclaim_lock);
+
+	return ret;
+}
+
+void reclaim_lru_add(struct page_table *page_table, struct page *page) {
+	spinlock_irqsave(&reclaim_lock);
+
+	page->page_table = page_table;
+	lru_push(page, LRU_ACTIVE);
+
+	spinrelease_irqsave(&reclaim_lock);
+}
+
+void reclaim_page_release(struct page *page) {
+	spinlock_irqsave(&reclaim_lock);
+
+	lru_remove(page);
+
+	if(page->swap) {
+		swap_slot_free(page->swap, page->swap_slot);
+		*page->pml_entry &= ~(VMM_SWAP_FLAG);
+		page->swap = NULL;
+	}
+
+	spinrelease_irqsave(&reclaim_lock);
+}
+
+void reclaim_init() {
+	reclaim_low_pages = pmm_total_pages / 64;
+	reclaim_high_pages = pmm_total_pages / 32;
+
+	kswapd_task = sched_kernel_task(kswapd, NULL);
+
+	print("reclaim: watermarks low %x high %x\n", reclaim_low_pages, reclaim_high_pages);
+}
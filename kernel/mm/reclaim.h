@@ -0,0 +1,17 @@
+#pragma once
+
+#include <mm/vmm.h>
+
+#define LRU_NONE 0
+#define LRU_ACTIVE 1
+#define LRU_INACTIVE 2
+
+#define KSWAPD_INTERVAL 100 // ms
+#define RECLAIM_BATCH 32
+
+void reclaim_init();
+void reclaim_lru_add(struct page_table *page_table, struct page *page);
+void reclaim_page_release(struct page *page);
+int reclaim_page_restore(struct page_table *page_table, struct page *page);
+int reclaim_swap_fault(struct page_table *page_table, uintptr_t vaddr);
+size_t reclaim_direct(size_t cnt);
@@ -0,0 +1,261 @@
+#include <mm/swap.h>
+#include <mm/pmm.h>
+#include <sched/sched.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+
+static struct swap_device *swap_list;
+static struct spinlock swap_lock;
+
+static struct swap_device *swap_device_create(size_t size) {
+	size_t slot_cnt = size / PAGE_SIZE;
+
+	if(slot_cnt <= 1) {
+		return NULL;
+	}
+
+	struct swap_device *device = alloc(sizeof(struct swap_device));
+
+	device->slot_cnt = slot_cnt;
+	device->free_cnt = slot_cnt - 1;
+	device->last_free = 1;
+	device->slot_bitmap = (void*)(pmm_alloc(DIV_ROUNDUP(DIV_ROUNDUP(slot_cnt, 8), PAGE_SIZE), 1) + HIGH_VMA);
+
+	BIT_SET(device->slot_bitmap, 0); // the first page holds the swap header
+
+	return device;
+}
+
+static void swap_device_register(struct swap_device *device) {
+	spinlock_irqsave(&swap_lock);
+
+	device->next = swap_list;
+	swap_list = device;
+
+	spinrelease_irqsave(&swap_lock);
+
+	print("swap: %x pages available on %s\n", device->free_cnt, device->cdev ? "partition" : "file");
+}
+
+int swap_add_device(struct cdev *cdev, size_t size) {
+	struct swap_device *device = swap_device_create(size);
+	if(device == NULL) {
+		return -1;
+	}
+
+	device->cdev = cdev;
+
+	swap_device_register(device);
+
+	return 0;
+}
+
+int swap_add_file(struct file_handle *file, size_t size) {
+	struct swap_device *device = swap_device_create(size);
+	if(device == NULL) {
+		return -1;
+	}
+
+	device->file = file;
+
+	swap_device_register(device);
+
+	return 0;
+}
+
+static bool swap_slot_take(struct swap_device *device, uint64_t slot) {
+	if(slot == 0 || slot >= device->slot_cnt || BIT_TEST(device->slot_bitmap, slot)) {
+		return false;
+	}
+
+	BIT_SET(device->slot_bitmap, slot);
+	device->free_cnt--;
+
+	if(slot == device->last_free) {
+		device->last_free++;
+	}
+
+	return true;
+}
+
+static ssize_t swap_slot_search(struct swap_device *device) {
+	if(device->free_cnt == 0) {
+		return -1;
+	}
+
+	for(size_t i = device->last_free; i < device->slot_cnt; i++) {
+		if(!BIT_TEST(device->slot_bitmap, i)) {
+			return i;
+		}
+	}
+
+	for(size_t i = 1; i < device->last_free; i++) {
+		if(!BIT_TEST(device->slot_bitmap, i)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+struct swap_device *swap_slot_alloc(struct swap_device *hint_device, uint64_t hint, uint64_t *slot, int flags) {
+	spinlock_irqsave(&swap_lock);
+
+	if(hint_device && (hint_device->cdev || (flags & SWAP_ALLOW_FILE)) && swap_slot_take(hint_device, hint)) { // keep neighbours contiguous for read-ahead
+		spinrelease_irqsave(&swap_lock);
+		*slot = hint;
+		return hint_device;
+	}
+
+	for(struct swap_device *device = swap_list; device; device = device->next) {
+		if(device->file && !(flags & SWAP_ALLOW_FILE)) {
+			continue;
+		}
+
+		ssize_t index = swap_slot_search(device);
+		if(index == -1) {
+			continue;
+		}
+
+		swap_slot_take(device, index);
+
+		spinrelease_irqsave(&swap_lock);
+
+		*slot = index;
+		return device;
+	}
+
+	spinrelease_irqsave(&swap_lock);
+
+	return NULL;
+}
+
+void swap_slot_free(struct swap_device *device, uint64_t slot) {
+	spinlock_irqsave(&swap_lock);
+
+	if(slot != 0 && slot < device->slot_cnt && BIT_TEST(device->slot_bitmap, slot)) {
+		BIT_CLEAR(device->slot_bitmap, slot);
+		device->free_cnt++;
+
+		if(slot < device->last_free) {
+			device->last_free = slot;
+		}
+	}
+
+	spinrelease_irqsave(&swap_lock);
+}
+
+int swap_write(struct swap_device *device, uint64_t slot, uint64_t paddr) {
+	void *buffer = (void*)(paddr + HIGH_VMA);
+	off_t offset = slot * PAGE_SIZE;
+	ssize_t ret;
+
+	if(device->cdev) {
+		ret = device->cdev->bops->write(device->cdev, buffer, PAGE_SIZE, offset);
+	} else {
+		ret = device->file->ops->write(device->file, buffer, PAGE_SIZE, offset);
+	}
+
+	return ret == -1 ? -1 : 0;
+}
+
+int swap_read(struct swap_device *device, uint64_t slot, size_t cnt, uint64_t paddr) {
+	void *buffer = (void*)(paddr + HIGH_VMA);
+	off_t offset = slot * PAGE_SIZE;
+	ssize_t ret;
+
+	if(device->cdev) {
+		ret = device->cdev->bops->read(device->cdev, buffer, cnt * PAGE_SIZE, offset);
+	} else {
+		ret = device->file->ops->read(device->file, buffer, cnt * PAGE_SIZE, offset);
+	}
+
+	return ret == -1 ? -1 : 0;
+}
+
+static bool swap_device_active(struct cdev *cdev, struct vfs_node *node) {
+	spinlock_irqsave(&swap_lock);
+
+	for(struct swap_device *device = swap_list; device; device = device->next) {
+		if((cdev && device->cdev == cdev) || (node && device->file && device->file->vfs_node == node)) {
+			spinrelease_irqsave(&swap_lock);
+			return true;
+		}
+	}
+
+	spinrelease_irqsave(&swap_lock);
+
+	return false;
+}
+
+static int swapon(const char *path) {
+	if(CURRENT_TASK->effective_uid != 0) {
+		set_errno(EPERM);
+		return -1;
+	}
+
+	struct stat stat;
+	if(fd_statat(AT_FDCWD, path, &stat, 0) == -1) {
+		return -1;
+	}
+
+	if(S_ISCHR(stat.st_mode)) {
+		struct cdev *cdev = cdev_search(stat.st_rdev);
+		if(cdev == NULL || cdev->bops == NULL) {
+			set_errno(ENOTBLK);
+			return -1;
+		}
+
+		if(swap_device_active(cdev, NULL)) {
+			set_errno(EBUSY);
+			return -1;
+		}
+
+		if(swap_add_device(cdev, stat.st_size) == -1) {
+			set_errno(EINVAL);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if(!S_ISREG(stat.st_mode)) {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	int fd = fd_openat(AT_FDCWD, path, O_RDWR, 0);
+	if(fd == -1) {
+		return -1;
+	}
+
+	struct file_handle *file = fd_translate(fd)->file_handle;
+
+	if(swap_device_active(NULL, file->vfs_node)) {
+		fd_close(fd);
+		set_errno(EBUSY);
+		return -1;
+	}
+
+	file_get(file);
+	fd_close(fd);
+
+	if(swap_add_file(file, stat.st_size) == -1) {
+		file_put(file);
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	return 0;
+}
+
+void syscall_swapon(struct registers *regs) {
+	const char *path = (const char*)regs->rdi;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] swapon: path {%s}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, path);
+#endif
+
+	regs->rax = swapon(path);
+}
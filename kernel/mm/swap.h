@@ -0,0 +1,32 @@
+#pragma once
+
+#include <types.h>
+#include <lock.h>
+#include <fs/fd.h>
+#include <fs/cdev.h>
+
+#define SWAP_PARTITION_TYPE 0x82 // linux swap mbr type
+#define SWAP_CLUSTER_MAX 8
+
+#define SWAP_ALLOW_FILE (1 << 0)
+
+struct swap_device {
+	struct cdev *cdev;
+	struct file_handle *file;
+
+	size_t slot_cnt;
+	size_t free_cnt;
+	size_t last_free;
+	uint8_t *slot_bitmap;
+
+	struct swap_device *next;
+};
+
+int swap_add_device(struct cdev *cdev, size_t size);
+int swap_add_file(struct file_handle *file, size_t size);
+
+struct swap_device *swap_slot_alloc(struct swap_device *hint_device, uint64_t hint, uint64_t *slot, int flags);
+void swap_slot_free(struct swap_device *device, uint64_t slot);
+
+int swap_write(struct swap_device *device, uint64_t slot, uint64_t paddr);
+int swap_read(struct swap_device *device, uint64_t slot, size_t cnt, uint64_t paddr);
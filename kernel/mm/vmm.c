@@ -3,9 +3,13 @@
 #include <cpu.h>
 #include <string.h>
 #include <sched/sched.h>
+#include <sched/preempt.h>
 #include <mm/mmap.h>
+#include <mm/reclaim.h>
 #include <debug.h>
 #include <limine.h>
+#include <errno.h>
+#include <fs/fd.h>
 
 #define PML5_FLAGS_MASK ~(VMM_FLAGS_PS | VMM_FLAGS_G | VMM_FLAGS_NX)
 #define PML4_FLAGS_MASK ~(VMM_FLAGS_PS | VMM_FLAGS_G | VMM_FLAGS_NX)
@@ -307,13 +311,30 @@ void vmm_unmap_range(struct page_table *page_table, uintptr_t vaddr, uint64_t cn
 	}
 }
 
+// reclaim evicts under the lock from tables nobody has loaded, so a cpu can't pick up an entry it is clearing
 void vmm_init_page_table(struct page_table *page_table) {
+	spinlock_irqsave(&page_table->lock);
+
+	__atomic_add_fetch(&page_table->loaded, 1, __ATOMIC_SEQ_CST);
+
 	asm volatile ("mov %0, %%cr3" :: "r"((uint64_t)page_table->pml_high - HIGH_VMA) : "memory");
+
+	// the old table's tlb entries went with the cr3 write
+	struct page_table *previous = CORE_LOCAL->cr3_table;
+	CORE_LOCAL->cr3_table = page_table;
+
+	if(previous) {
+		__atomic_sub_fetch(&previous->loaded, 1, __ATOMIC_SEQ_CST);
+	}
+
+	spinrelease_irqsave(&page_table->lock);
 }
 
 void vmm_init() {
 	vmm_default_table(&kernel_mappings);
-	vmm_init_page_table(&kernel_mappings);
+
+	// gs isn't set up yet, nothing to count the load against and no lock to take
+	asm volatile ("mov %0, %%cr3" :: "r"((uint64_t)kernel_mappings.pml_high - HIGH_VMA) : "memory");
 }
 
 static volatile struct limine_kernel_address_request limine_kernel_address_request = {
@@ -366,7 +387,7 @@ void vmm_default_table(struct page_table *page_table) {
 	page_table->mmap_bump_base = MMAP_MAP_MIN_ADDR;
 }
 
-struct mmap_region *vmm_copy_region_tree(struct mmap_region *root) {
+struct mmap_region *vmm_copy_region_tree(struct mmap_region *root, struct mmap_region *parent) {
 	if(root == NULL) {
 		return NULL;
 	}
@@ -374,12 +395,78 @@ struct mmap_region *vmm_copy_region_tree(struct mmap_region *root) {
 	struct mmap_region *region = alloc(sizeof(struct mmap_region));
 	*region = *root;
 
-	region->left = vmm_copy_region_tree(root->left);
-	region->right = vmm_copy_region_tree(root->right);
+	region->parent = parent;
+	region->left = vmm_copy_region_tree(root->left, region);
+	region->right = vmm_copy_region_tree(root->right, region);
+
+	if(region->file) {
+		file_get(region->file);
+	}
 
 	return region;
 }
 
+void vmm_free_region_tree(struct mmap_region *root) {
+	if(root == NULL) {
+		return;
+	}
+
+	vmm_free_region_tree(root->left);
+	vmm_free_region_tree(root->right);
+
+	if(root->file) {
+		file_put(root->file);
+	}
+
+	free(root);
+}
+
+static void vmm_free_level(uint64_t *table, int level) {
+	for(size_t i = 0; level > 1 && i < 512; i++) {
+		if((table[i] & VMM_FLAGS_P) && !(table[i] & VMM_FLAGS_PS)) {
+			vmm_free_level((uint64_t*)((table[i] & VMM_ADDR_MASK) + HIGH_VMA), level - 1);
+		}
+	}
+
+	pmm_free((uintptr_t)table - HIGH_VMA, 1);
+}
+
+// hands back everything a fork built so far, the parent keeps its pages with one reference less
+static void vmm_fork_unwind(struct page_table *new_table) {
+	struct hash_table *pages = new_table->pages;
+
+	for(size_t i = 0; i < pages->capacity; i++) {
+		struct page *new_page = pages->data[i];
+
+		if(new_page == NULL) {
+			continue;
+		}
+
+		reclaim_page_release(new_page);
+
+		if(new_page->frame->addr == 0) { // a dropped file page got its own frame and reference
+			free(new_page->frame);
+			free(new_page->reference);
+		} else {
+			(*new_page->reference)--;
+		}
+
+		free(new_page);
+	}
+
+	if(pages->capacity) {
+		size_t table_pages = DIV_ROUNDUP(pages->capacity * sizeof(void*), PAGE_SIZE);
+
+		pmm_free((uintptr_t)pages->data - HIGH_VMA, table_pages);
+		pmm_free((uintptr_t)pages->keys - HIGH_VMA, table_pages);
+	}
+
+	vmm_free_level(new_table->pml_high, new_table->map_page == pml5_map_page ? 5 : 4);
+
+	free(pages);
+	free(new_table);
+}
+
 struct page_table *vmm_fork_page_table(struct page_table *page_table) {
 	struct page_table *new_table = alloc(sizeof(struct page_table));
 
@@ -388,7 +475,37 @@ struct page_table *vmm_fork_page_table(struct page_table *page_table) {
 	for(size_t i = 0; i < page_table->pages->capacity; i++) {
 		struct page *page = page_table->pages->data[i];
 
+		if((i % VMM_FORK_BATCH) == VMM_FORK_BATCH - 1) { // a big address space would hold the cpu for a long time
+			cond_resched();
+		}
+
 		if(page) {
+			if(reclaim_page_restore(page_table, page) == -1) {
+				vmm_fork_unwind(new_table);
+				set_errno(ENOMEM);
+				return NULL;
+			}
+
+			struct page *new_page = alloc(sizeof(struct page));
+			*new_page = *page;
+
+			new_page->lru = LRU_NONE;
+			new_page->lru_next = NULL;
+			new_page->lru_prev = NULL;
+
+			if(page->frame->addr == 0) { // file page dropped by reclaim, both sides read it back on their own
+				new_page->frame = alloc(sizeof(struct frame));
+				new_page->reference = alloc(sizeof(int));
+				*new_page->reference = 1;
+
+				new_page->pml_entry = new_table->map_page(new_table, page->vaddr, 0, *page->pml_entry);
+
+				hash_table_push(new_table->pages, &new_page->vaddr, new_page, sizeof(new_page->vaddr));
+				reclaim_lru_add(new_table, new_page);
+
+				continue;
+			}
+
 			if(!(*page->pml_entry & VMM_SHARE_FLAG)) {
 				*page->pml_entry &= ~(VMM_FLAGS_RW);
 				*page->pml_entry |= VMM_COW_FLAG;
@@ -400,12 +517,14 @@ struct page_table *vmm_fork_page_table(struct page_table *page_table) {
 
 			invlpg(page->vaddr);
 
-			struct page *new_page = alloc(sizeof(struct page));
-			*new_page = *page;
-
+			new_page->flags = page->flags;
 			new_page->pml_entry = new_table->map_page(new_table, page->vaddr, page->frame->addr, page->flags);
 
 			hash_table_push(new_table->pages, &new_page->vaddr, new_page, sizeof(new_page->vaddr));
+
+			if(!(page->flags & VMM_SHARE_FLAG)) {
+				reclaim_lru_add(new_table, new_page);
+			}
 		}
 	}
 
@@ -413,7 +532,7 @@ struct page_table *vmm_fork_page_table(struct page_table *page_table) {
 	asm volatile ("mov %%cr3, %0" : "=a"(cr3));
 	asm volatile ("mov %0, %%cr3" :: "r"(cr3) : "memory");
 
-	new_table->mmap_region_root = vmm_copy_region_tree(page_table->mmap_region_root);
+	new_table->mmap_region_root = vmm_copy_region_tree(page_table->mmap_region_root, NULL);
 
 	return new_table;
 }
@@ -436,6 +555,12 @@ int vmm_file_map(struct page_table *page_table, uintptr_t address) {
 
 			invlpg(address);
 
+			if(page->frame->addr == 0) { // dropped by reclaim
+				page->frame->addr = pmm_alloc(1, 1);
+				*lowest_level = (*lowest_level & ~(VMM_ADDR_MASK)) | page->frame->addr;
+				reclaim_lru_add(page_table, page);
+			}
+
 			int ret = page->file->ops->read(page->file, (void*)(page->frame->addr + HIGH_VMA), PAGE_SIZE, page->offset) == -1 ? 0 : 1;
 			if(ret) {
 				*lowest_level = *lowest_level | VMM_FLAGS_P;
@@ -491,6 +616,7 @@ int vmm_anon_map(struct page_table *page_table, uintptr_t address) {
 			*(new_page->reference) = 1;
 
 			hash_table_push(page_table->pages, &new_page->vaddr, new_page, sizeof(new_page->vaddr));
+			reclaim_lru_add(page_table, new_page);
 
 			return 0;
 		}
@@ -519,6 +645,9 @@ int vmm_pf_handler(struct registers *regs) {
 	uint64_t pmll_entry = lowest_level == NULL ? 0 : *lowest_level;
 
 	if((regs->error_code & VMM_FLAGS_P) == 0) {
+		if(pmll_entry & VMM_SWAP_FLAG) {
+			return reclaim_swap_fault(task->page_table, faulting_page);
+		}
 		if(pmll_entry & VMM_FILE_FLAG) {
 			return vmm_file_map(task->page_table, faulting_address);
 		}
@@ -25,12 +25,19 @@
 #define VMM_COW_FLAG (1 << 9)
 #define VMM_FILE_FLAG (1 << 10)
 #define VMM_SHARE_FLAG (1 << 11)
+#define VMM_SWAP_FLAG (1ull << 52)
 
-struct futex;
+#define VMM_ADDR_MASK 0x000ffffffffff000ull
+
+#define VMM_FORK_BATCH 256 // page slots copied between preemption points
+
+struct futex_waiter;
+struct swap_device;
+struct page_table;
 
 struct frame {
 	uint64_t addr;
-	VECTOR(struct futex*) locks;
+	VECTOR(struct futex_waiter*) locks; // waiters keyed on the physical address
 };
 
 struct page {
@@ -45,6 +52,14 @@ struct page {
 	uint64_t *pml_entry;
 
 	int *reference;
+
+	struct page_table *page_table;
+	struct page *lru_next;
+	struct page *lru_prev;
+	int lru;
+
+	struct swap_device *swap;
+	uint64_t swap_slot;
 };
 
 struct mmap_region {
@@ -52,7 +67,7 @@ struct mmap_region {
 	size_t limit;
 	int flags;
 	int prot;
-	int fd;
+	struct file_handle *file; // referenced for as long as the region exists, NULL when anonymous
 	off_t offset;
 
 	struct mmap_region *left;
@@ -73,6 +88,7 @@ struct page_table {
 	uint64_t *pml_high;
 
 	int refcnt;
+	int loaded; // cpus with the table in cr3, only raised under lock
 	struct spinlock lock;
 };
 
@@ -85,3 +101,4 @@ void vmm_unmap_range(struct page_table *page_table, uintptr_t vaddr, uint64_t cn
 void vmm_default_table(struct page_table *page_table);
 
 struct page_table *vmm_fork_page_table(struct page_table *page_table);
+void vmm_free_region_tree(struct mmap_region *root);
@@ -1,24 +1,56 @@
 #include <sched/ehfi.h>
 #include <sched/smp.h>
+#include <sched/runqueue.h>
 #include <int/apic.h>
 #include <int/idt.h>
+#include <fs/cdev.h>
 #include <mm/slab.h>
 #include <mm/pmm.h>
 #include <debug.h>
 #include <string.h>
+#include <errno.h>
+#include <lock.h>
 #include <cpu.h>
 
 static struct ehfi_structure *ehfi_structure;
+static size_t ehfi_row_cnt;
+static bool ehfi_hardware;
+static struct spinlock ehfi_lock;
+
+bool ehfi_active;
+
+// copies the table over to the run queues and moves work around to match it
+static void ehfi_update() {
+	spinlock_irqsave(&ehfi_lock);
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *queue = cpu_list.data[i]->queue;
+
+		if(queue->ehfi_index >= ehfi_row_cnt) {
+			continue;
+		}
+
+		queue->perf_capability = ehfi_structure->entries[queue->ehfi_index].perf_capability;
+		queue->energy_capability = ehfi_structure->entries[queue->ehfi_index].energy_capability;
+	}
+
+	ehfi_active = true;
+
+	spinrelease_irqsave(&ehfi_lock);
+
+	sched_queue_rebalance();
+}
 
 static void ehfi_notification(struct registers*, void*) {
 	uint64_t therm_status_package = rdmsr(MSR_PACKAGE_THERM_STATUS);
 
 	if(therm_status_package & (1 << 26)) {
-		print("EHFI structure has been updated\n");
-		for(size_t i = 0; i < logical_processor_cnt; i++) {
-			print("proc %d: performance capability %d energy efficency capability %d\n",
-			ehfi_structure->entries[i].perf_capability,
-			ehfi_structure->entries[i].energy_capability);
+		ehfi_update();
+
+		for(size_t i = 0; i < cpu_list.length; i++) {
+			struct sched_queue *queue = cpu_list.data[i]->queue;
+			print("ehfi: cpu %d performance capability %d energy efficency capability %d\n",
+				queue->cpu, queue->perf_capability, queue->energy_capability);
 		}
 	}
 
@@ -33,26 +65,50 @@ static int thermal_lvt_init() {
 	}
 
 	uint32_t thermal_sensor_interrupt = xapic_read(XAPIC_THERMAL_LVT_OFF);
+	thermal_sensor_interrupt &= ~(0xff | (1 << 16)); // firmware may have left its own vector there
 	thermal_sensor_interrupt |= vec;
-	thermal_sensor_interrupt &= ~(1 << 16);
 	xapic_write(XAPIC_THERMAL_LVT_OFF, thermal_sensor_interrupt);
 
 	return 0;
 }
 
+// the row of each logical processor is only reported on that processor
+void ehfi_cpu_init() {
+	struct cpuid_state cpuid_state = cpuid(6, 0);
+	if(!(cpuid_state.rax & (1 << 19))) {
+		return;
+	}
+
+	CORE_LOCAL->queue->ehfi_index = cpuid_state.rdx >> 16;
+}
+
 int ehfi_init() {
+	ehfi_row_cnt = logical_processor_cnt;
+	ehfi_cpu_init();
+
 	struct cpuid_state cpuid_state = cpuid(6, 0);
 	if(!(cpuid_state.rax & (1 << 19))) {
-		print("ehfi: not supported\n");
+		// nothing writes the table, /dev/ehfi fills it in so placement can be exercised anyway
+		ehfi_structure = alloc(sizeof(struct ehfi_hdr) + sizeof(struct ehfi_entry) * ehfi_row_cnt);
+
+		// rows nobody wrote keep the run queue default, a zero would read as a cpu that can't run anything
+		for(size_t i = 0; i < ehfi_row_cnt; i++) {
+			ehfi_structure->entries[i].perf_capability = UINT8_MAX;
+			ehfi_structure->entries[i].energy_capability = UINT8_MAX;
+		}
+
+		print("ehfi: not supported, using a mock table\n");
 		return -1;
 	}
 
-	size_t page_cnt = DIV_ROUNDUP(sizeof(struct ehfi_hdr) + sizeof(struct ehfi_entry) * logical_processor_cnt, PAGE_SIZE);
+	// the processor writes as many pages as it reports, which can be more than one row per logical processor needs
+	size_t page_cnt = ((cpuid_state.rdx >> 8) & 0xf) + 1;
 	ehfi_structure = (struct ehfi_structure*)(pmm_alloc(page_cnt, 1) + HIGH_VMA);
+	ehfi_row_cnt = (page_cnt * PAGE_SIZE - sizeof(struct ehfi_hdr)) / sizeof(struct ehfi_entry);
+	ehfi_hardware = true;
 
-	uint64_t feedback_ptr = rdmsr(MSR_HW_FEEDBACK_PTR);
-	feedback_ptr |= (1 << 0) | (((uintptr_t)ehfi_structure - HIGH_VMA) << 11);
-	wrmsr(MSR_HW_FEEDBACK_PTR, feedback_ptr);
+	// page aligned physical address with the valid bit, nothing of the old value is kept
+	wrmsr(MSR_HW_FEEDBACK_PTR, ((uintptr_t)ehfi_structure - HIGH_VMA) | (1 << 0));
 
 	uint64_t feedback_config = rdmsr(MSR_HW_FEEDBACK_CONFIG);
 	feedback_config |= (1 << 0);
@@ -72,3 +128,111 @@ int ehfi_init() {
 
 	return 0;
 }
+
+static ssize_t ehfi_read(struct file_handle *file, void *buf, size_t cnt, off_t offset);
+static ssize_t ehfi_write(struct file_handle *file, const void *buf, size_t cnt, off_t offset);
+
+static struct file_ops ehfi_ops = {
+	.read = ehfi_read,
+	.write = ehfi_write
+};
+
+static ssize_t ehfi_read(struct file_handle*, void *buf, size_t cnt, off_t offset) {
+	size_t size = cpu_list.length * 64 + 1;
+	char *text = alloc(size);
+	size_t length = 0;
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *queue = cpu_list.data[i]->queue;
+
+		length += sprint(text + length, "cpu%d row %d perf %d energy %d\n",
+			queue->cpu, queue->ehfi_index, queue->perf_capability, queue->energy_capability);
+	}
+
+	if(offset >= length) {
+		free(text);
+		return 0;
+	}
+
+	if(cnt > length - offset) {
+		cnt = length - offset;
+	}
+
+	memcpy(buf, text + offset, cnt);
+	free(text);
+
+	return cnt;
+}
+
+static const char *ehfi_parse(const char *text, const char *end, size_t *ret) {
+	while(text < end && (*text == ' ' || *text == '\t')) text++;
+
+	if(text == end || *text < '0' || *text > '9') {
+		return NULL;
+	}
+
+	*ret = 0;
+	while(text < end && *text >= '0' && *text <= '9') {
+		*ret = *ret * 10 + (*text++ - '0');
+	}
+
+	return text;
+}
+
+// takes "cpu perf energy" lines while there is no hardware table, each write is one table update
+static ssize_t ehfi_write(struct file_handle*, const void *buf, size_t cnt, off_t) {
+	if(ehfi_hardware) {
+		set_errno(EPERM);
+		return -1;
+	}
+
+	const char *text = buf;
+	const char *end = text + cnt;
+
+	while(text < end) {
+		size_t cpu, perf, energy;
+
+		if((text = ehfi_parse(text, end, &cpu)) == NULL
+			|| (text = ehfi_parse(text, end, &perf)) == NULL
+			|| (text = ehfi_parse(text, end, &energy)) == NULL
+			|| cpu >= cpu_list.length || perf > UINT8_MAX || energy > UINT8_MAX) {
+			set_errno(EINVAL);
+			return -1;
+		}
+
+		int row = cpu_list.data[cpu]->queue->ehfi_index;
+		if(row >= ehfi_row_cnt) {
+			set_errno(EINVAL);
+			return -1;
+		}
+
+		ehfi_structure->entries[row].perf_capability = perf;
+		ehfi_structure->entries[row].energy_capability = energy;
+
+		while(text < end && (*text == ' ' || *text == '\t' || *text == '\n')) text++;
+	}
+
+	ehfi_update();
+
+	return cnt;
+}
+
+int ehfi_dev_init() {
+	if(ehfi_structure == NULL) {
+		return -1;
+	}
+
+	struct cdev *cdev = alloc(sizeof(struct cdev));
+	cdev->fops = &ehfi_ops;
+	cdev->rdev = makedev(EHFI_MAJOR, 0);
+	if(cdev_register(cdev) == -1)
+		return -1;
+
+	struct stat *stat = alloc(sizeof(struct stat));
+	stat_init(stat);
+	stat->st_mode = S_IFCHR | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+	stat->st_rdev = makedev(EHFI_MAJOR, 0);
+	vfs_create_node_deep(NULL, NULL, NULL, stat, "/dev/ehfi");
+
+	return 0;
+}
@@ -2,6 +2,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+
+#define EHFI_MAJOR 239
 
 struct ehfi_hdr {
 	uint64_t timestamp;
@@ -21,4 +24,8 @@ struct ehfi_structure {
 	struct ehfi_entry entries[];
 };
 
+extern bool ehfi_active;
+
 int ehfi_init();
+void ehfi_cpu_init();
+int ehfi_dev_init();
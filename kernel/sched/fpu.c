@@ -0,0 +1,215 @@
+#include <sched/fpu.h>
+#include <sched/sched.h>
+#include <sched/smp.h>
+#include <mm/pmm.h>
+#include <string.h>
+#include <debug.h>
+#include <cpu.h>
+
+// user fpu state is switched lazily, cr0.ts is set whenever the registers do not hold the state of
+// the running task, so only tasks that touch the fpu during a slice pay for the save and the restore
+
+static int fpu_mode;
+static uint64_t fpu_xstate;
+static size_t fpu_area_size = FPU_FXSAVE_SIZE;
+
+static inline void fpu_clts() {
+	asm volatile ("clts");
+}
+
+static inline void fpu_stts() {
+	uint64_t cr0;
+	asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+
+	if(!(cr0 & (1 << 3))) {
+		asm volatile ("mov %0, %%cr0" :: "r"(cr0 | (1 << 3)));
+	}
+}
+
+static void fpu_save(void *area) {
+	uint32_t low = fpu_xstate, high = fpu_xstate >> 32;
+
+	switch(fpu_mode) {
+		case FPU_MODE_XSAVEOPT:
+			asm volatile ("xsaveopt64 (%0)" :: "r"(area), "a"(low), "d"(high) : "memory");
+			break;
+		case FPU_MODE_XSAVE:
+			asm volatile ("xsave64 (%0)" :: "r"(area), "a"(low), "d"(high) : "memory");
+			break;
+		default:
+			asm volatile ("fxsave64 (%0)" :: "r"(area) : "memory");
+	}
+}
+
+static void fpu_restore(void *area) {
+	uint32_t low = fpu_xstate, high = fpu_xstate >> 32;
+
+	if(fpu_mode == FPU_MODE_FXSAVE) {
+		asm volatile ("fxrstor64 (%0)" :: "r"(area) : "memory");
+	} else {
+		asm volatile ("xrstor64 (%0)" :: "r"(area), "a"(low), "d"(high) : "memory");
+	}
+}
+
+// an empty xsave header puts every component in its initial state, the legacy area still supplies mxcsr
+static void fpu_area_reset(void *area) {
+	memset(area, 0, fpu_area_size);
+
+	*(uint16_t*)area = FPU_FCW_DEFAULT;
+	*(uint32_t*)(area + 24) = FPU_MXCSR_DEFAULT;
+}
+
+// xsave wants 64 byte alignment, so areas come straight from the page allocator
+static void *fpu_area_alloc() {
+	return (void*)(pmm_alloc(DIV_ROUNDUP(fpu_area_size, PAGE_SIZE), 1) + HIGH_VMA);
+}
+
+void fpu_init() {
+	uint64_t cr0;
+	asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+	cr0 |= (1 << 5) | (1 << 3); // native x87 errors, and trap the first use
+	asm volatile ("mov %0, %%cr0" :: "r"(cr0));
+
+	struct cpuid_state cpuid_state = cpuid(1, 0);
+	if(!(cpuid_state.rcx & (1 << 26))) { // no xsave, fxsave covers x87 and sse
+		fpu_mode = FPU_MODE_FXSAVE;
+		return;
+	}
+
+	uint64_t cr4;
+	asm volatile ("mov %%cr4, %0" : "=r"(cr4));
+	cr4 |= (1 << 18); // OSXSAVE
+	asm volatile ("mov %0, %%cr4" :: "r"(cr4));
+
+	cpuid_state = cpuid(0xd, 0);
+	uint64_t xstate = ((cpuid_state.rdx << 32) | (uint32_t)cpuid_state.rax) & FPU_XSTATE_USER;
+
+	if((xstate & (FPU_XSTATE_OPMASK | FPU_XSTATE_ZMM_HI256 | FPU_XSTATE_HI16_ZMM))
+		!= (FPU_XSTATE_OPMASK | FPU_XSTATE_ZMM_HI256 | FPU_XSTATE_HI16_ZMM)) { // avx-512 goes all or nothing
+		xstate &= ~(FPU_XSTATE_OPMASK | FPU_XSTATE_ZMM_HI256 | FPU_XSTATE_HI16_ZMM);
+	}
+
+	asm volatile ("xsetbv" :: "c"(0), "a"((uint32_t)xstate), "d"((uint32_t)(xstate >> 32)));
+
+	fpu_xstate = xstate;
+	fpu_area_size = cpuid(0xd, 0).rbx; // size for what xcr0 now enables
+	fpu_mode = cpuid(0xd, 1).rax & (1 << 0) ? FPU_MODE_XSAVEOPT : FPU_MODE_XSAVE;
+}
+
+// the cpu is leaving last_task, NULL when its state is of no use anymore (exit, execve)
+void fpu_switch(struct task *last_task) {
+	struct task *owner = CORE_LOCAL_READ(fpu_owner);
+
+	if(owner) {
+		if(owner == last_task) {
+			fpu_save(owner->fpu_area);
+		}
+
+		CORE_LOCAL_WRITE(fpu_owner, NULL);
+	}
+
+	fpu_stts();
+}
+
+// #NM, the running task touched the fpu for the first time this slice
+int fpu_trap(struct registers *regs) {
+	if(!(regs->cs & 0x3)) { // the kernel may only use it between kernel_fpu_begin and kernel_fpu_end
+		return -1;
+	}
+
+	struct task *task = CURRENT_TASK;
+	if(task == NULL) {
+		return -1;
+	}
+
+	fpu_clts();
+
+	if(task->fpu_area == NULL) {
+		task->fpu_area = fpu_area_alloc();
+	}
+
+	if(!task->fpu_valid) {
+		fpu_area_reset(task->fpu_area);
+		task->fpu_valid = true;
+	}
+
+	fpu_restore(task->fpu_area);
+
+	CORE_LOCAL_WRITE(fpu_owner, task);
+
+	return 0;
+}
+
+void fpu_fork(struct task *parent, struct task *child) {
+	if(!parent->fpu_valid) {
+		return;
+	}
+
+	if(CORE_LOCAL_READ(fpu_owner) == parent) { // the registers stay live, this only brings the area up to date
+		fpu_save(parent->fpu_area);
+	}
+
+	child->fpu_area = fpu_area_alloc();
+	child->fpu_valid = true;
+
+	memcpy(child->fpu_area, parent->fpu_area, fpu_area_size);
+}
+
+// the handler starts from a clean state, the interrupted one is parked until sigreturn
+void fpu_signal_enter(struct task *task) {
+	if(CORE_LOCAL_READ(fpu_owner) == task) {
+		fpu_save(task->fpu_area);
+		CORE_LOCAL_WRITE(fpu_owner, NULL);
+		fpu_stts();
+	}
+
+	void *area = task->fpu_signal_area;
+
+	task->fpu_signal_area = task->fpu_area;
+	task->fpu_signal_valid = task->fpu_valid;
+
+	task->fpu_area = area;
+	task->fpu_valid = false;
+}
+
+void fpu_signal_leave(struct task *task) {
+	if(CORE_LOCAL_READ(fpu_owner) == task) { // whatever the handler left behind is dropped
+		CORE_LOCAL_WRITE(fpu_owner, NULL);
+		fpu_stts();
+	}
+
+	void *area = task->fpu_area;
+
+	task->fpu_area = task->fpu_signal_area;
+	task->fpu_valid = task->fpu_signal_valid;
+
+	task->fpu_signal_area = area;
+	task->fpu_signal_valid = false;
+}
+
+// code built with simd enabled has to run between these, interrupts stay off in between
+void kernel_fpu_begin() {
+	bool interrupts = get_interrupt_state();
+	asm volatile ("cli");
+
+	struct task *owner = CORE_LOCAL_READ(fpu_owner);
+	if(owner) {
+		fpu_save(owner->fpu_area);
+		CORE_LOCAL_WRITE(fpu_owner, NULL);
+	}
+
+	fpu_clts();
+
+	uint32_t mxcsr = FPU_MXCSR_DEFAULT;
+	asm volatile ("fninit\n\tldmxcsr %0" :: "m"(mxcsr));
+
+	CORE_LOCAL_WRITE(fpu_interrupts, interrupts);
+}
+
+void kernel_fpu_end() {
+	fpu_stts(); // the owner reloads its state on its next use
+
+	if(CORE_LOCAL_READ(fpu_interrupts)) {
+		asm volatile ("sti");
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <types.h>
+
+#define FPU_XSTATE_X87 (1 << 0)
+#define FPU_XSTATE_SSE (1 << 1)
+#define FPU_XSTATE_AVX (1 << 2)
+#define FPU_XSTATE_OPMASK (1 << 5)
+#define FPU_XSTATE_ZMM_HI256 (1 << 6)
+#define FPU_XSTATE_HI16_ZMM (1 << 7)
+
+#define FPU_XSTATE_USER (FPU_XSTATE_X87 | FPU_XSTATE_SSE | FPU_XSTATE_AVX | \
+	FPU_XSTATE_OPMASK | FPU_XSTATE_ZMM_HI256 | FPU_XSTATE_HI16_ZMM)
+
+#define FPU_FXSAVE_SIZE 512
+
+#define FPU_FCW_DEFAULT 0x37f
+#define FPU_MXCSR_DEFAULT 0x1f80
+
+#define FPU_MODE_FXSAVE 0
+#define FPU_MODE_XSAVE 1
+#define FPU_MODE_XSAVEOPT 2
+
+struct task;
+struct registers;
+
+void fpu_init();
+void fpu_switch(struct task *last_task);
+int fpu_trap(struct registers *regs);
+void fpu_fork(struct task *parent, struct task *child);
+void fpu_signal_enter(struct task *task);
+void fpu_signal_leave(struct task *task);
+
+void kernel_fpu_begin();
+void kernel_fpu_end();
@@ -3,12 +3,29 @@
 #include <debug.h>
 #include <errno.h>
 
-static struct hash_table futex_list;
+static struct futex_bucket futex_buckets[FUTEX_HASH_SIZE];
+static struct spinlock futex_pin_lock;
 
-int futex(uintptr_t uaddr, int ops, int expected, const struct timespec *timeout) {
+// every pi state and priority boost, chains cross futexes and contended pi locks are rare enough for one lock
+static struct spinlock futex_pi_lock;
+
+static struct futex_bucket *futex_hash(struct futex_key *key) {
+	uint64_t hash = ((uintptr_t)key->mm ^ key->address) * 0x9e3779b97f4a7c15ull;
+
+	return &futex_buckets[hash >> (64 - FUTEX_HASH_BITS)];
+}
+
+static bool futex_key_equal(struct futex_key *a, struct futex_key *b) {
+	return a->mm == b->mm && a->address == b->address;
+}
+
+// the word is touched before any lock is held, a swapped out page comes back here and not under a bucket lock
+static int futex_get_key(uintptr_t uaddr, bool private, struct futex_key *key, struct frame **frame) {
 	struct task *task = CURRENT_TASK;
-	if(task == NULL) {
-		panic("");
+
+	if(uaddr & 0x3) {
+		set_errno(EINVAL);
+		return -1;
 	}
 
 	uint64_t uaddr_page = uaddr & ~(0xfff);
@@ -18,74 +35,1002 @@ int futex(uintptr_t uaddr, int ops, int expected, const struct timespec *timeout
 		return -1;
 	}
 
-	uint64_t futex_paddr = page->frame->addr + (uaddr & (0xfff));
+	(void)*(volatile uint32_t*)uaddr;
+
+	if(private) {
+		key->mm = task->page_table;
+		key->address = uaddr;
+		*frame = NULL;
+	} else {
+		key->mm = NULL;
+		key->address = page->frame->addr + (uaddr & 0xfff);
+		*frame = page->frame;
+	}
+
+	return 0;
+}
+
+// shared futexes are keyed on the physical address, reclaim leaves frames with waiters alone
+static void futex_pin(struct frame *frame, struct futex_waiter *waiter) {
+	waiter->frame = frame;
+
+	if(frame == NULL) {
+		return;
+	}
+
+	spinlock_irqsave(&futex_pin_lock);
+	VECTOR_PUSH(frame->locks, waiter);
+	spinrelease_irqsave(&futex_pin_lock);
+}
+
+static void futex_unpin(struct futex_waiter *waiter) {
+	struct frame *frame = waiter->frame;
+	if(frame == NULL) {
+		return;
+	}
+
+	spinlock_irqsave(&futex_pin_lock);
+	VECTOR_REMOVE_BY_VALUE(frame->locks, waiter);
+	spinrelease_irqsave(&futex_pin_lock);
+
+	waiter->frame = NULL;
+}
+
+static void futex_enqueue(struct futex_bucket *bucket, struct futex_waiter *waiter) {
+	waiter->bucket = bucket;
+	waiter->next = NULL;
+	waiter->prev = bucket->tail;
+
+	if(bucket->tail) {
+		bucket->tail->next = waiter;
+	} else {
+		bucket->head = waiter;
+	}
+
+	bucket->tail = waiter;
+	bucket->waiters++;
+}
+
+static void futex_dequeue(struct futex_bucket *bucket, struct futex_waiter *waiter) {
+	if(waiter->prev) waiter->prev->next = waiter->next;
+	else bucket->head = waiter->next;
+
+	if(waiter->next) waiter->next->prev = waiter->prev;
+	else bucket->tail = waiter->prev;
+
+	waiter->next = NULL;
+	waiter->prev = NULL;
+	bucket->waiters--;
+}
+
+// the waiter leaves its bucket before the lock drops, it must not be touched once the lock is released
+static void futex_wake_waiter(struct futex_bucket *bucket, struct futex_waiter *waiter) {
+	struct task *task = waiter->task;
+
+	futex_dequeue(bucket, waiter);
+	waiter->woken = true;
+
+	task->blocking = false;
+	sched_requeue(task);
+}
+
+// a requeue may move the waiter to another bucket while we wait for the lock
+static struct futex_bucket *futex_lock_waiter(struct futex_waiter *waiter) {
+	for(;;) {
+		struct futex_bucket *bucket = __atomic_load_n(&waiter->bucket, __ATOMIC_ACQUIRE);
+
+		spinlock_irqsave(&bucket->lock);
+
+		if(bucket == waiter->bucket) {
+			return bucket;
+		}
+
+		spinrelease_irqsave(&bucket->lock);
+	}
+}
+
+// takes a waiter that is done sleeping off its bucket, unless a wake up or its timeout already did. true when woken
+static bool futex_unqueue(struct futex_waiter *waiter) {
+	struct futex_bucket *bucket = futex_lock_waiter(waiter);
+	bool woken = waiter->woken;
+
+	if(!woken && !waiter->timed_out) {
+		futex_dequeue(bucket, waiter);
+	}
+
+	spinrelease_irqsave(&bucket->lock);
+
+	futex_unpin(waiter);
+
+	return woken;
+}
 
-	switch(ops) {
-		case FUTEX_WAIT: {
-			if(*(uint32_t*)uaddr != expected) {
-				set_errno(EAGAIN);
-				return -1;
+static void futex_lock_pair(struct futex_bucket *a, struct futex_bucket *b) {
+	if(a == b) {
+		spinlock_irqsave(&a->lock);
+	} else if(a < b) {
+		spinlock_irqsave(&a->lock);
+		spinlock_irqsave(&b->lock);
+	} else {
+		spinlock_irqsave(&b->lock);
+		spinlock_irqsave(&a->lock);
+	}
+}
+
+static void futex_unlock_pair(struct futex_bucket *a, struct futex_bucket *b) {
+	if(a != b) {
+		spinrelease_irqsave(&b->lock);
+	}
+
+	spinrelease_irqsave(&a->lock);
+}
+
+static void futex_timeout(struct timer *timer) {
+	struct futex_waiter *waiter = timer->data;
+	struct futex_bucket *bucket = futex_lock_waiter(waiter);
+
+	if(!waiter->woken) {
+		struct task *task = waiter->task;
+
+		futex_dequeue(bucket, waiter);
+		waiter->timed_out = true;
+
+		task->blocking = false;
+		sched_requeue(task);
+	}
+
+	spinrelease_irqsave(&bucket->lock);
+}
+
+// timeout is in nanoseconds from now, TIMER_NONE waits for good
+static int futex_wait(uintptr_t uaddr, bool private, uint32_t val, uint32_t bitset, uint64_t timeout) {
+	struct task *task = CURRENT_TASK;
+
+	if(bitset == 0) {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	struct futex_waiter waiter = {
+		.task = task,
+		.bitset = bitset
+	};
+
+	struct frame *frame;
+	if(futex_get_key(uaddr, private, &waiter.key, &frame) == -1) {
+		return -1;
+	}
+
+	struct futex_bucket *bucket = futex_hash(&waiter.key);
+
+	futex_pin(frame, &waiter);
+
+	spinlock_irqsave(&bucket->lock);
+
+	// the waker changes the word before it takes this lock, so checking under it cannot miss a wake up
+	if(*(volatile uint32_t*)uaddr != val || timeout == 0) {
+		spinrelease_irqsave(&bucket->lock);
+		futex_unpin(&waiter);
+		set_errno(timeout == 0 ? ETIMEDOUT : EAGAIN);
+		return -1;
+	}
+
+	futex_enqueue(bucket, &waiter);
+	task->futex_waiter = &waiter;
+	task->futex_waiter_cnt = 1;
+	task->blocking = true;
+
+	if(timeout != TIMER_NONE) {
+		waiter.timer.function = futex_timeout;
+		waiter.timer.data = &waiter;
+		timer_arm(&waiter.timer, timespec_from_nanoseconds(timeout));
+	}
+
+	spinrelease_irqsave(&bucket->lock);
+
+	task->signal_queue.active = true;
+	sched_block(task);
+	task->signal_queue.active = false;
+
+	if(timeout != TIMER_NONE) {
+		timer_cancel(&waiter.timer); // once it returns the callback is done with the waiter
+	}
+
+	bucket = futex_lock_waiter(&waiter);
+
+	bool woken = waiter.woken;
+	bool timed_out = waiter.timed_out;
+
+	if(!woken && !timed_out) {
+		futex_dequeue(bucket, &waiter);
+	}
+
+	task->futex_waiter = NULL;
+
+	spinrelease_irqsave(&bucket->lock);
+
+	futex_unpin(&waiter); // no requeue can move it now
+
+	task->blocking = false;
+
+	if(woken) {
+		return 0;
+	}
+
+	if(timed_out) {
+		set_errno(ETIMEDOUT);
+		return -1;
+	}
+
+	if(task->signal_release_block) {
+		task->signal_release_block = false;
+		set_errno(EINTR);
+		return -1;
+	}
+
+	return 0; // spurious, the caller checks the word again anyway
+}
+
+static int futex_wake(uintptr_t uaddr, bool private, int nr_wake, uint32_t bitset) {
+	if(bitset == 0) {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	struct futex_key key;
+	struct frame *frame;
+
+	if(futex_get_key(uaddr, private, &key, &frame) == -1) {
+		return -1;
+	}
+
+	struct futex_bucket *bucket = futex_hash(&key);
+
+	spinlock_irqsave(&bucket->lock);
+
+	int woken = 0;
+	struct futex_waiter *waiter = bucket->head;
+
+	while(waiter && woken < nr_wake) {
+		struct futex_waiter *next = waiter->next;
+
+		if(futex_key_equal(&waiter->key, &key) && (waiter->bitset & bitset)) {
+			futex_wake_waiter(bucket, waiter);
+			woken++;
+		}
+
+		waiter = next;
+	}
+
+	bucket->wake_cnt += woken;
+
+	spinrelease_irqsave(&bucket->lock);
+
+	return woken;
+}
+
+// wakes nr_wake waiters on uaddr and moves up to nr_requeue of the rest over to uaddr2 without waking them
+static int futex_requeue(uintptr_t uaddr, uintptr_t uaddr2, bool private, int nr_wake, int nr_requeue,
+	bool compare, uint32_t val3) {
+	struct futex_key key, key2;
+	struct frame *frame, *frame2;
+
+	if(futex_get_key(uaddr, private, &key, &frame) == -1 || futex_get_key(uaddr2, private, &key2, &frame2) == -1) {
+		return -1;
+	}
+
+	struct futex_bucket *bucket = futex_hash(&key);
+	struct futex_bucket *bucket2 = futex_hash(&key2);
+
+	futex_lock_pair(bucket, bucket2);
+
+	if(compare && *(volatile uint32_t*)uaddr != val3) {
+		futex_unlock_pair(bucket, bucket2);
+		set_errno(EAGAIN);
+		return -1;
+	}
+
+	int woken = 0, requeued = 0;
+	struct futex_waiter *waiter = bucket->head;
+
+	while(waiter && (woken < nr_wake || requeued < nr_requeue)) {
+		struct futex_waiter *next = waiter->next;
+
+		if(!futex_key_equal(&waiter->key, &key)) {
+			waiter = next;
+			continue;
+		}
+
+		if(woken < nr_wake) {
+			futex_wake_waiter(bucket, waiter);
+			woken++;
+		} else {
+			futex_dequeue(bucket, waiter);
+			waiter->key = key2;
+			futex_enqueue(bucket2, waiter);
+			requeued++;
+
+			// the pin follows the word the waiter now sleeps on
+			if(waiter->frame != frame2) {
+				futex_unpin(waiter);
+				futex_pin(frame2, waiter);
 			}
+		}
+
+		waiter = next;
+	}
+
+	bucket->wake_cnt += woken;
+	bucket->requeue_cnt += requeued;
+
+	futex_unlock_pair(bucket, bucket2);
+
+	return woken + requeued;
+}
+
+// owners are named by thread id, which only means something within a process, so pi futexes are always private
+static int futex_pi_get_key(uintptr_t uaddr, struct futex_key *key) {
+	struct frame *frame;
+
+	if(futex_get_key(uaddr, true, key, &frame) == -1) {
+		return -1;
+	}
+
+	__atomic_fetch_or((uint32_t*)uaddr, 0, __ATOMIC_RELAXED); // the word is written under the pi lock, break cow first
+
+	return 0;
+}
 
-			struct futex *futex = hash_table_search(&futex_list, &futex_paddr, sizeof(futex_paddr));
-			if(futex == NULL) {
-				futex = alloc(sizeof(struct futex));
+static struct futex_pi_state *futex_pi_find(struct futex_key *key) {
+	struct futex_bucket *bucket = futex_hash(key);
 
-				futex->paddr = futex_paddr;
+	for(struct futex_pi_state *state = bucket->pi_head; state; state = state->next) {
+		if(futex_key_equal(&state->key, key)) {
+			return state;
+		}
+	}
+
+	return NULL;
+}
+
+static void futex_pi_set_owner(struct futex_pi_state *state, struct task *owner) {
+	if(state->owner) {
+		struct futex_pi_state **link = &state->owner->pi_owned;
+
+		while(*link != state) {
+			link = &(*link)->owner_next;
+		}
+
+		*link = state->owner_next;
+	}
+
+	state->owner = owner;
+	state->owner_next = NULL;
+
+	if(owner) {
+		state->owner_next = owner->pi_owned;
+		owner->pi_owned = state;
+	}
+}
+
+static struct futex_pi_state *futex_pi_alloc(struct futex_key *key, uintptr_t uaddr, struct task *owner) {
+	struct futex_bucket *bucket = futex_hash(key);
+	struct futex_pi_state *state = alloc(sizeof(struct futex_pi_state));
+
+	state->key = *key;
+	state->uaddr = uaddr;
+
+	state->next = bucket->pi_head;
+	if(bucket->pi_head) {
+		bucket->pi_head->prev = state;
+	}
+
+	bucket->pi_head = state;
+
+	futex_pi_set_owner(state, owner);
+
+	return state;
+}
+
+// the last waiter is gone, the word keeps whatever owner it names
+static void futex_pi_free(struct futex_pi_state *state) {
+	struct futex_bucket *bucket = futex_hash(&state->key);
+
+	if(state->prev) state->prev->next = state->next;
+	else bucket->pi_head = state->next;
+
+	if(state->next) state->next->prev = state->prev;
+
+	futex_pi_set_owner(state, NULL);
+	free(state);
+}
 
-				hash_table_push(&futex_list, &futex->paddr, futex, sizeof(futex->paddr));
-				VECTOR_PUSH(page->frame->locks, futex);
+// waiters are kept by priority, fifo among equals
+static void futex_pi_enqueue(struct futex_pi_state *state, struct futex_waiter *waiter) {
+	struct futex_waiter *prev = NULL, *next = state->head;
+
+	while(next && next->task->rt_priority >= waiter->task->rt_priority) {
+		prev = next;
+		next = next->next;
+	}
+
+	waiter->pi_state = state;
+	waiter->prev = prev;
+	waiter->next = next;
+
+	if(prev) prev->next = waiter;
+	else state->head = waiter;
+
+	if(next) next->prev = waiter;
+}
+
+static void futex_pi_dequeue(struct futex_pi_state *state, struct futex_waiter *waiter) {
+	if(waiter->prev) waiter->prev->next = waiter->next;
+	else state->head = waiter->next;
+
+	if(waiter->next) waiter->next->prev = waiter->prev;
+
+	waiter->next = NULL;
+	waiter->prev = NULL;
+}
+
+// most urgent waiter still after the lock, one whose timeout fired is on its way out
+static struct futex_waiter *futex_pi_top(struct futex_pi_state *state) {
+	struct futex_waiter *waiter = state->head;
+
+	while(waiter && waiter->timed_out) {
+		waiter = waiter->next;
+	}
+
+	return waiter;
+}
+
+// a task runs at its own priority or at that of the most urgent task waiting on a pi futex it holds, whichever is
+// higher. a change is carried along the chain of pi futexes the task itself waits on. only real time waiters boost,
+// a fair owner waiting out a fair waiter keeps its weight. true when the current task has to reschedule
+static bool futex_pi_adjust(struct task *task, bool force) {
+	bool resched = false;
+
+	for(int depth = 0; task && depth < FUTEX_PI_CHAIN_MAX; depth++) {
+		int policy = task->normal_policy;
+		int priority = task->normal_rt_priority;
+
+		for(struct futex_pi_state *state = task->pi_owned; state; state = state->owner_next) {
+			struct futex_waiter *top = futex_pi_top(state);
+
+			if(top && top->task->rt_priority > priority) {
+				priority = top->task->rt_priority;
+				if(policy == SCHED_OTHER) {
+					policy = SCHED_FIFO;
+				}
 			}
+		}
+
+		if(!force && policy == task->policy && priority == task->rt_priority) {
+			break;
+		}
 
-			futex->expected = expected;
-			futex->operation = ops;
-			futex->paddr = futex_paddr;
+		force = false;
+		resched |= sched_task_set_prio(task, policy, priority);
 
-			if(timeout) {
-				waitq_set_timer(&futex->waitq, *timeout);
+		struct futex_pi_state *blocked = task->pi_blocked_on;
+		if(blocked == NULL) {
+			break;
+		}
+
+		// its place among the waiters follows its priority
+		futex_pi_dequeue(blocked, task->futex_waiter);
+		futex_pi_enqueue(blocked, task->futex_waiter);
+
+		task = blocked->owner;
+	}
+
+	return resched;
+}
+
+// hands the futex to its most urgent waiter, the word names the new owner before that one runs. true when the old
+// owner is the current task and has to reschedule now that it gave back its boost
+static bool futex_pi_handoff(struct futex_pi_state *state, uint32_t flags) {
+	struct task *owner = state->owner;
+	struct futex_waiter *waiter = futex_pi_top(state);
+
+	if(waiter == NULL) { // only waiters that timed out are left, they clean up after themselves
+		*(volatile uint32_t*)state->uaddr = state->head ? FUTEX_WAITERS | flags : flags;
+		futex_pi_set_owner(state, NULL);
+		return futex_pi_adjust(owner, false);
+	}
+
+	struct task *task = waiter->task;
+
+	futex_pi_dequeue(state, waiter);
+	task->pi_blocked_on = NULL;
+
+	*(volatile uint32_t*)state->uaddr = FUTEX_OWNER(task->id.tid) | flags | (state->head ? FUTEX_WAITERS : 0);
+
+	if(state->head) {
+		futex_pi_set_owner(state, task);
+	} else {
+		futex_pi_free(state);
+	}
+
+	waiter->woken = true;
+	task->blocking = false;
+	sched_requeue(task);
+
+	futex_pi_adjust(task, false);
+
+	return futex_pi_adjust(owner, false);
+}
+
+static void futex_pi_timeout(struct timer *timer) {
+	struct futex_waiter *waiter = timer->data;
+
+	spinlock_irqsave(&futex_pi_lock);
+
+	if(!waiter->woken) {
+		struct task *task = waiter->task;
+
+		waiter->timed_out = true; // stays queued, the waiter takes itself off once it runs
+
+		task->blocking = false;
+		sched_requeue(task);
+	}
+
+	spinrelease_irqsave(&futex_pi_lock);
+}
+
+// takes a waiter that gave up off its futex and lets the owner drop a boost it lent
+static void futex_pi_leave(struct futex_pi_state *state, struct futex_waiter *waiter) {
+	struct task *owner = state->owner;
+
+	futex_pi_dequeue(state, waiter);
+	waiter->task->pi_blocked_on = NULL;
+	waiter->task->futex_waiter = NULL;
+
+	if(state->head == NULL) {
+		futex_pi_free(state);
+	}
+
+	futex_pi_adjust(owner, false);
+}
+
+// user space takes an uncontended pi futex with a compare and swap of 0 to its id, this is the contended path.
+// timeout is in nanoseconds from now, TIMER_NONE waits for good
+static int futex_lock_pi(uintptr_t uaddr, uint64_t timeout, bool trylock) {
+	struct task *task = CURRENT_TASK;
+	uint32_t id = FUTEX_OWNER(task->id.tid);
+
+	struct futex_waiter waiter = {
+		.task = task,
+		.bitset = FUTEX_BITSET_MATCH_ANY
+	};
+
+	if(futex_pi_get_key(uaddr, &waiter.key) == -1) {
+		return -1;
+	}
+
+	volatile uint32_t *word = (void*)uaddr;
+
+	spinlock_irqsave(&futex_pi_lock);
+
+	struct futex_pi_state *state = futex_pi_find(&waiter.key);
+	uint32_t val;
+
+	for(;;) {
+		val = *word;
+
+		// free, though waiters or a dead owner may have left their bits behind
+		if((val & FUTEX_TID_MASK) == 0) {
+			if(!__atomic_compare_exchange_n(word, &val, id | (state ? FUTEX_WAITERS : 0), false, __ATOMIC_ACQUIRE,
+				__ATOMIC_RELAXED)) {
+				continue;
 			}
 
-			futex->trigger = waitq_alloc(&futex->waitq, EVENT_LOCK);
-			waitq_add(&futex->waitq, futex->trigger);
+			if(state) {
+				futex_pi_set_owner(state, task);
+				futex_pi_adjust(task, false);
+			}
+
+			spinrelease_irqsave(&futex_pi_lock);
+			return 0;
+		}
 
-			waitq_wait(&futex->waitq, EVENT_LOCK);
-			waitq_release(&futex->waitq, EVENT_LOCK);
+		if((val & FUTEX_TID_MASK) == id) {
+			spinrelease_irqsave(&futex_pi_lock);
+			set_errno(EDEADLK);
+			return -1;
+		}
 
-			waitq_remove(&futex->waitq, futex->trigger);
+		if(trylock) {
+			spinrelease_irqsave(&futex_pi_lock);
+			set_errno(EAGAIN);
+			return -1;
+		}
 
+		// from here on the owner cannot unlock without coming in here
+		if((val & FUTEX_WAITERS) || __atomic_compare_exchange_n(word, &val, val | FUTEX_WAITERS, false,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
 			break;
 		}
-		case FUTEX_WAKE: {
-			struct futex *futex = hash_table_search(&futex_list, &futex_paddr, sizeof(futex_paddr));
-			if(futex == NULL) {
-				set_errno(EINVAL);
-				return -1;
+	}
+
+	if(state == NULL || state->owner == NULL) {
+		struct task *owner = idr_find(&task->thread_group->process_list, (val & FUTEX_TID_MASK) - 1);
+		if(owner == NULL) {
+			spinrelease_irqsave(&futex_pi_lock);
+			set_errno(ESRCH);
+			return -1;
+		}
+
+		if(state) {
+			futex_pi_set_owner(state, owner);
+		} else {
+			state = futex_pi_alloc(&waiter.key, uaddr, owner);
+		}
+	}
+
+	// sleeping on a chain that leads back to us never ends
+	struct task *owner = state->owner;
+	for(int depth = 0; owner && depth < FUTEX_PI_CHAIN_MAX; depth++) {
+		if(owner == task) {
+			if(state->head == NULL) {
+				futex_pi_free(state);
 			}
 
-			hash_table_delete(&futex_list, &futex_paddr, sizeof(futex_paddr));
+			spinrelease_irqsave(&futex_pi_lock);
+			set_errno(EDEADLK);
+			return -1;
+		}
 
-			waitq_wake(futex->trigger);
+		owner = owner->pi_blocked_on ? owner->pi_blocked_on->owner : NULL;
+	}
 
-			break;
+	if(timeout == 0) {
+		if(state->head == NULL) {
+			futex_pi_free(state);
+		}
+
+		spinrelease_irqsave(&futex_pi_lock);
+		set_errno(ETIMEDOUT);
+		return -1;
+	}
+
+	futex_pi_enqueue(state, &waiter);
+	task->pi_blocked_on = state;
+	task->futex_waiter = &waiter;
+	task->futex_waiter_cnt = 1;
+	task->blocking = true;
+
+	futex_pi_adjust(state->owner, false);
+
+	if(timeout != TIMER_NONE) {
+		waiter.timer.function = futex_pi_timeout;
+		waiter.timer.data = &waiter;
+		timer_arm(&waiter.timer, timespec_from_nanoseconds(timeout));
+	}
+
+	spinrelease_irqsave(&futex_pi_lock);
+
+	task->signal_queue.active = true;
+	sched_block(task);
+	task->signal_queue.active = false;
+
+	if(timeout != TIMER_NONE) {
+		timer_cancel(&waiter.timer);
+	}
+
+	spinlock_irqsave(&futex_pi_lock);
+
+	task->blocking = false;
+
+	if(waiter.woken) { // handed over, the word already names us
+		task->futex_waiter = NULL;
+		spinrelease_irqsave(&futex_pi_lock);
+		return 0;
+	}
+
+	futex_pi_leave(waiter.pi_state, &waiter);
+
+	spinrelease_irqsave(&futex_pi_lock);
+
+	if(waiter.timed_out) {
+		set_errno(ETIMEDOUT);
+		return -1;
+	}
+
+	task->signal_release_block = false;
+	set_errno(EINTR); // user space goes back to the compare and swap, as it does after FUTEX_WAIT
+	return -1;
+}
+
+static int futex_unlock_pi(uintptr_t uaddr) {
+	struct task *task = CURRENT_TASK;
+	struct futex_key key;
+
+	if(futex_pi_get_key(uaddr, &key) == -1) {
+		return -1;
+	}
+
+	volatile uint32_t *word = (void*)uaddr;
+
+	spinlock_irqsave(&futex_pi_lock);
+
+	if((*word & FUTEX_TID_MASK) != FUTEX_OWNER(task->id.tid)) {
+		spinrelease_irqsave(&futex_pi_lock);
+		set_errno(EPERM);
+		return -1;
+	}
+
+	struct futex_pi_state *state = futex_pi_find(&key);
+
+	bool resched = false;
+
+	if(state) {
+		if(state->owner != task) {
+			futex_pi_set_owner(state, task);
+		}
+
+		resched = futex_pi_handoff(state, 0);
+	} else {
+		*word = 0; // nobody sleeps on it, the waiters bit was left over
+	}
+
+	spinrelease_irqsave(&futex_pi_lock);
+
+	if(resched) {
+		schedule(); // gave back a boost and something more urgent is runnable
+	}
+
+	return 0;
+}
+
+bool futex_pi_setscheduler(struct task *task, int policy, int priority) {
+	spinlock_irqsave(&futex_pi_lock);
+
+	task->normal_policy = policy;
+	task->normal_rt_priority = priority;
+
+	bool resched = futex_pi_adjust(task, true);
+
+	spinrelease_irqsave(&futex_pi_lock);
+
+	return resched;
+}
+
+// a dying thread leaves whatever futex it sleeps on, and the pi futexes it holds go to their waiters marked as
+// having lost their owner. runs in the address space of the process
+void futex_exit(struct task *task) {
+	struct futex_waiter *waiter = task->futex_waiter;
+
+	if(waiter) {
+		timer_cancel(&waiter->timer);
+	}
+
+	if(waiter && waiter->pi_state == NULL) {
+		for(size_t i = 0; i < task->futex_waiter_cnt; i++) {
+			futex_unqueue(&waiter[i]);
 		}
+
+		task->futex_waiter = NULL;
+	}
+
+	spinlock_irqsave(&futex_pi_lock);
+
+	waiter = task->futex_waiter;
+	if(waiter && !waiter->woken) {
+		futex_pi_leave(waiter->pi_state, waiter);
+	}
+
+	while(task->pi_owned) {
+		futex_pi_handoff(task->pi_owned, FUTEX_OWNER_DIED);
+	}
+
+	task->futex_waiter = NULL;
+
+	spinrelease_irqsave(&futex_pi_lock);
+}
+
+// a relative timeout for FUTEX_WAIT, an absolute one for FUTEX_WAIT_BITSET
+static uint64_t futex_timeout_ns(const struct timespec *timeout, bool absolute, bool realtime) {
+	if(timeout == NULL) {
+		return TIMER_NONE;
+	}
+
+	if(!absolute) {
+		return timespec_nanoseconds(*timeout);
+	}
+
+	struct timespec now = clock_get(realtime ? CLOCK_REALTIME : CLOCK_MONOTONIC);
+
+	return timespec_nanoseconds(timespec_sub(*timeout, now));
+}
+
+int futex(uintptr_t uaddr, int op, uint32_t val, uintptr_t arg, uintptr_t uaddr2, uint32_t val3) {
+	struct task *task = CURRENT_TASK;
+	if(task == NULL) {
+		panic("");
+	}
+
+	bool private = op & FUTEX_PRIVATE_FLAG;
+	bool realtime = op & FUTEX_CLOCK_REALTIME;
+
+	switch(op & FUTEX_CMD_MASK) {
+		case FUTEX_WAIT:
+			return futex_wait(uaddr, private, val, FUTEX_BITSET_MATCH_ANY, futex_timeout_ns((void*)arg, false, false));
+		case FUTEX_WAIT_BITSET:
+			return futex_wait(uaddr, private, val, val3, futex_timeout_ns((void*)arg, true, realtime));
+		case FUTEX_WAKE:
+			return futex_wake(uaddr, private, val, FUTEX_BITSET_MATCH_ANY);
+		case FUTEX_WAKE_BITSET:
+			return futex_wake(uaddr, private, val, val3);
+		case FUTEX_REQUEUE:
+			return futex_requeue(uaddr, uaddr2, private, val, arg, false, 0);
+		case FUTEX_CMP_REQUEUE:
+			return futex_requeue(uaddr, uaddr2, private, val, arg, true, val3);
+		case FUTEX_LOCK_PI:
+			return futex_lock_pi(uaddr, futex_timeout_ns((void*)arg, true, true), false);
+		case FUTEX_TRYLOCK_PI:
+			return futex_lock_pi(uaddr, TIMER_NONE, true);
+		case FUTEX_UNLOCK_PI:
+			return futex_unlock_pi(uaddr);
 		default:
 			set_errno(EINVAL);
 			return -1;
 	}
+}
 
-	return 0;
+// sleeps until any of the words is woken and returns its index. the waiters sit on the same buckets FUTEX_WAIT
+// uses, so plain FUTEX_WAKE calls reach them. timeout is absolute on clock
+int futex_waitv(struct futex_waitv *entries, unsigned int nr, unsigned int flags, const struct timespec *timeout,
+	int clock) {
+	struct task *task = CURRENT_TASK;
+
+	if(entries == NULL || nr == 0 || nr > FUTEX_WAITV_MAX || flags ||
+		(timeout && clock != CLOCK_MONOTONIC && clock != CLOCK_REALTIME)) {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	struct futex_waiter *waiters = alloc(sizeof(struct futex_waiter) * nr);
+	size_t keyed = 0;
+
+	for(; keyed < nr; keyed++) {
+		struct futex_waitv *entry = &entries[keyed];
+		struct futex_waiter *waiter = &waiters[keyed];
+		struct frame *frame;
+
+		if(!(entry->flags & FUTEX2_SIZE_U32) || (entry->flags & ~(FUTEX2_SIZE_U32 | FUTEX2_PRIVATE)) ||
+			entry->reserved || entry->val > UINT32_MAX) {
+			set_errno(EINVAL);
+			break;
+		}
+
+		waiter->task = task;
+		waiter->bitset = FUTEX_BITSET_MATCH_ANY;
+
+		if(futex_get_key(entry->uaddr, entry->flags & FUTEX2_PRIVATE, &waiter->key, &frame) == -1) {
+			break;
+		}
+
+		futex_pin(frame, waiter);
+	}
+
+	if(keyed < nr) {
+		for(size_t i = 0; i < keyed; i++) {
+			futex_unpin(&waiters[i]);
+		}
+
+		free(waiters);
+		return -1;
+	}
+
+	uint64_t ns = futex_timeout_ns(timeout, true, clock == CLOCK_REALTIME);
+
+	// a wake up on a word queued early clears it before we sleep, sched_block then returns at once
+	task->blocking = true;
+
+	size_t queued = 0;
+
+	for(; queued < nr; queued++) {
+		struct futex_bucket *bucket = futex_hash(&waiters[queued].key);
+
+		spinlock_irqsave(&bucket->lock);
+
+		if(*(volatile uint32_t*)entries[queued].uaddr != entries[queued].val) {
+			spinrelease_irqsave(&bucket->lock);
+			break;
+		}
+
+		futex_enqueue(bucket, &waiters[queued]);
+
+		spinrelease_irqsave(&bucket->lock);
+	}
+
+	if(queued == nr && ns != 0) {
+		task->futex_waiter = waiters;
+		task->futex_waiter_cnt = nr;
+
+		if(ns != TIMER_NONE) { // the first waiter carries the timeout for all of them
+			waiters[0].timer.function = futex_timeout;
+			waiters[0].timer.data = &waiters[0];
+			timer_arm(&waiters[0].timer, timespec_from_nanoseconds(ns));
+		}
+
+		task->signal_queue.active = true;
+		sched_block(task);
+		task->signal_queue.active = false;
+
+		timer_cancel(&waiters[0].timer);
+	}
+
+	// every waiter leaves its bucket, the first one found woken is the answer
+	ssize_t index = -1;
+
+	for(size_t i = 0; i < nr; i++) {
+		if(i >= queued) {
+			futex_unpin(&waiters[i]);
+		} else if(futex_unqueue(&waiters[i]) && index == -1) {
+			index = i;
+		}
+	}
+
+	bool timed_out = queued == nr && (ns == 0 || waiters[0].timed_out);
+
+	task->futex_waiter = NULL;
+	task->futex_waiter_cnt = 0;
+	task->blocking = false;
+
+	free(waiters);
+
+	if(index != -1) {
+		return index;
+	}
+
+	if(queued < nr) {
+		set_errno(EAGAIN);
+		return -1;
+	}
+
+	if(timed_out) {
+		set_errno(ETIMEDOUT);
+		return -1;
+	}
+
+	if(task->signal_release_block) {
+		task->signal_release_block = false;
+		set_errno(EINTR);
+		return -1;
+	}
+
+	set_errno(EAGAIN); // spurious, the caller checks the words again
+	return -1;
 }
 
 void syscall_futex(struct registers *regs) {
 	uint32_t *uaddr = (void*)regs->rdi;
 	int op = regs->rsi;
-	uint32_t val = regs->rdx; 
-	const struct timespec *timeout = (void*)regs->r10;
+	uint32_t val = regs->rdx;
+	uintptr_t arg = regs->r10; // the timeout, or how many to requeue
+	uint32_t *uaddr2 = (void*)regs->r8;
+	uint32_t val3 = regs->r9;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] futex: uaddr {%x}, op {%x}, val {%x}, arg {%x}, uaddr2 {%x}, val3 {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, uaddr, op, val, arg, uaddr2, val3);
+#endif
+
+	regs->rax = futex((uintptr_t)uaddr, op, val, arg, (uintptr_t)uaddr2, val3);
+}
+
+void syscall_futex_waitv(struct registers *regs) {
+	struct futex_waitv *entries = (void*)regs->rdi;
+	unsigned int nr = regs->rsi;
+	unsigned int flags = regs->rdx;
+	struct timespec *timeout = (void*)regs->r10;
+	int clock = regs->r8;
 
-#ifndef SYSCALL_DEBUG
-	print("syscall: [pid %x, tid %x] futex: uaddr {%x}, op {%x}, val {%x}, timeout {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, uaddr, op, val, timeout);
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] futex_waitv: entries {%x}, nr {%x}, flags {%x}, timeout {%x}, clock {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, entries, nr, flags, timeout, clock);
 #endif
 
-	regs->rax = futex((uintptr_t)uaddr, op, val, timeout);
-	//regs->rax = 0;
+	regs->rax = futex_waitv(entries, nr, flags, timeout, clock);
 }
@@ -2,16 +2,103 @@
 
 #include <sched/queue.h>
 #include <hash.h>
+#include <time.h>
 #include <lock.h>
 
 #define FUTEX_WAIT 0
 #define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 3
+#define FUTEX_CMP_REQUEUE 4
+#define FUTEX_LOCK_PI 6
+#define FUTEX_UNLOCK_PI 7
+#define FUTEX_TRYLOCK_PI 8
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
 
-struct futex {
+#define FUTEX_PRIVATE_FLAG 128 // keyed on the address space and virtual address, no page table walk
+#define FUTEX_CLOCK_REALTIME 256
+#define FUTEX_CMD_MASK ~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME)
+
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+// a pi futex word holds the owner's thread id plus one, the main thread of a process has id 0
+#define FUTEX_WAITERS 0x80000000
+#define FUTEX_OWNER_DIED 0x40000000
+#define FUTEX_TID_MASK 0x3fffffff
+#define FUTEX_OWNER(tid) ((tid) + 1)
+
+#define FUTEX_PI_CHAIN_MAX 64 // locks a boost is carried across before giving up
+
+#define FUTEX2_SIZE_U32 0x02
+#define FUTEX2_PRIVATE FUTEX_PRIVATE_FLAG
+#define FUTEX_WAITV_MAX 64 // the waiters for one call come from a single slab object
+
+#define FUTEX_HASH_BITS 8
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+struct task;
+struct frame;
+struct futex_pi_state;
+
+// private futexes are (address space, virtual address), shared ones (NULL, physical address)
+struct futex_key {
+	void *mm;
+	uint64_t address;
+};
+
+// one per sleeping task, lives on its kernel stack for as long as it waits
+struct futex_waiter {
+	struct futex_key key;
+	struct task *task;
+	uint32_t bitset;
+
+	struct futex_bucket *bucket; // requeueing moves the waiter, guarded by the bucket lock
+	struct frame *frame; // pinned while a shared futex waits on it
+	struct futex_pi_state *pi_state; // the pi futex it waits to own, NULL on plain futexes
+	struct futex_waiter *next;
+	struct futex_waiter *prev;
+
+	struct timer timer;
+	bool woken;
+	bool timed_out;
+};
+
+// one word of a futex_waitv call, as user space lays it out
+struct futex_waitv {
+	uint64_t val;
+	uint64_t uaddr;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+// kernel side of a contended pi futex, exists while tasks wait on it
+struct futex_pi_state {
+	struct futex_key key;
+	uintptr_t uaddr;
+	struct task *owner;
+
+	struct futex_waiter *head; // most urgent waiter first
+
+	struct futex_pi_state *next; // on the bucket
+	struct futex_pi_state *prev;
+	struct futex_pi_state *owner_next; // other contended pi futexes the owner holds
+};
+
+struct futex_bucket {
 	struct spinlock lock;
-	struct waitq waitq;
-	struct waitq_trigger *trigger;
-	uint64_t paddr;
-	int expected;
-	int operation;
+
+	struct futex_waiter *head;
+	struct futex_waiter *tail;
+	size_t waiters;
+
+	struct futex_pi_state *pi_head; // guarded by the pi lock, not the bucket lock
+
+	size_t wake_cnt;
+	size_t requeue_cnt;
 };
+
+int futex(uintptr_t uaddr, int op, uint32_t val, uintptr_t arg, uintptr_t uaddr2, uint32_t val3);
+int futex_waitv(struct futex_waitv *entries, unsigned int nr, unsigned int flags, const struct timespec *timeout,
+	int clock);
+bool futex_pi_setscheduler(struct task *task, int policy, int priority);
+void futex_exit(struct task *task);
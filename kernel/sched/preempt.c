@@ -0,0 +1,94 @@
+#include <sched/preempt.h>
+#include <sched/sched.h>
+#include <sched/smp.h>
+#include <sched/runqueue.h>
+#include <int/clockevent.h>
+#include <string.h>
+#include <time.h>
+#include <lock.h>
+#include <cpu.h>
+
+// locks are taken long before gs points at the per cpu data, counting starts once it does
+bool preempt_online;
+
+void preempt_init() {
+	preempt_online = true;
+}
+
+void preempt_disable() {
+	if(preempt_online) {
+		CORE_LOCAL_ADD(preempt_count, 1);
+	}
+}
+
+// leaving the outermost section with interrupts on is a preemption point
+void preempt_enable() {
+	if(!preempt_online) {
+		return;
+	}
+
+	CORE_LOCAL_ADD(preempt_count, -1);
+
+	if(CORE_LOCAL_READ(preempt_count) == 0 && CORE_LOCAL_READ(resched_stamp) && get_interrupt_state()) {
+		schedule();
+	}
+}
+
+// asks cpu to reschedule at its next preemption point, the stamp of the first request is kept
+void preempt_request(int cpu, uint64_t now) {
+	uint64_t expected = 0;
+
+	__atomic_compare_exchange_n(&cpu_list.data[cpu]->resched_stamp, &expected, now ? now : 1, false,
+		__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// the cpu is rescheduling now, records how long after the tick or the request that is
+void preempt_account(struct sched_queue *queue, uint64_t now) {
+	struct clockevent *clockevent = CORE_LOCAL->clockevent;
+	uint64_t wanted = CORE_LOCAL_READ(resched_stamp);
+
+	if(wanted == 0 && clockevent && clockevent->deadline != TIMER_NONE) {
+		wanted = clockevent->deadline;
+	}
+
+	if(wanted && wanted <= now && now - wanted > queue->latency_max) {
+		queue->latency_max = now - wanted;
+	}
+
+	CORE_LOCAL_WRITE(resched_stamp, 0);
+}
+
+static bool preempt_due() {
+	if(CORE_LOCAL_READ(resched_stamp)) {
+		return true;
+	}
+
+	struct clockevent *clockevent = CORE_LOCAL->clockevent;
+
+	return clockevent && clock_nanoseconds() >= clockevent->deadline;
+}
+
+// explicit preemption point for long loops. interrupts are masked for the whole of a syscall, so the
+// tick or ipi that is waiting gets a one instruction window to come in
+void cond_resched() {
+	if(!preempt_online || CORE_LOCAL_READ(preempt_count) || !preempt_due()) {
+		return;
+	}
+
+	if(!get_interrupt_state()) {
+		asm volatile ("sti\n\tnop\n\tcli" ::: "memory");
+	}
+
+	if(CORE_LOCAL_READ(resched_stamp)) { // nothing came in, a request from a preempt section is still pending
+		schedule();
+	}
+}
+
+void copy_resched(void *dest, const void *src, size_t cnt) {
+	for(size_t offset = 0; offset < cnt; offset += PREEMPT_COPY_CHUNK) {
+		size_t chunk = cnt - offset < PREEMPT_COPY_CHUNK ? cnt - offset : PREEMPT_COPY_CHUNK;
+
+		memcpy8(dest + offset, src + offset, chunk);
+		cond_resched();
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <types.h>
+
+#define PREEMPT_COPY_CHUNK 0x10000 // bytes copied between preemption points
+
+struct sched_queue;
+
+extern bool preempt_online;
+
+void preempt_init();
+void preempt_request(int cpu, uint64_t now);
+void preempt_account(struct sched_queue *queue, uint64_t now);
+void cond_resched();
+void copy_resched(void *dest, const void *src, size_t cnt);
@@ -48,13 +48,14 @@ static uint64_t *program_place_args(struct program *program, uint64_t *location)
 }
 
 static uint64_t *program_place_aux(struct program *program, uint64_t *location) {
-	location -= 10;
+	location -= 12;
 
 	location[0] = ELF_AT_PHNUM; location[1] = program->file.aux.at_phnum;
 	location[2] = ELF_AT_PHENT; location[3] = program->file.aux.at_phent;
 	location[4] = ELF_AT_PHDR;  location[5] = program->file.aux.at_phdr;
 	location[6] = ELF_AT_ENTRY; location[7] = program->file.aux.at_entry;
-	location[8] = 0; location[9] = 0;
+	location[8] = ELF_AT_SYSINFO_EHDR; location[9] = program->vdso_base;
+	location[10] = 0; location[11] = 0;
 
 	return location;
 }
@@ -23,6 +23,7 @@ struct program {
 	} parameters;
 
 	uint64_t entry;
+	uint64_t vdso_base;
 	bool loaded;
 };
 
@@ -9,67 +9,85 @@ int waitq_wait(struct waitq *waitq, int type) {
 	spinlock_irqsave(&waitq->lock);
 
 	if(waitq->status & type) {
-		/*int ret;
-		bsfl((waitq->status & type), &ret);
+		int status = waitq->status & type;
 		spinrelease_irqsave(&waitq->lock);
-		return ret;*/
-		return waitq->status & type;
+		return status;
 	}
 
-	VECTOR_PUSH(waitq->tasks, task);
-
-	spinrelease_irqsave(&waitq->lock);
-
 	for(;;) {
-		sched_dequeue(task);
-
-		task->signal_queue.active = true;
-
 		task->blocking = true;
-		asm volatile ("sti");
-		while(task->blocking);
-		task->blocking = false;
+		VECTOR_PUSH(waitq->tasks, task);
+
+		spinrelease_irqsave(&waitq->lock);
 
+		task->signal_queue.active = true;
+		sched_block(task);
 		task->signal_queue.active = false;
 
+		spinlock_irqsave(&waitq->lock);
+
 		if(task->signal_release_block) {
 			task->signal_release_block = false;
+			task->blocking = false;
+			VECTOR_REMOVE_BY_VALUE(waitq->tasks, task);
+			spinrelease_irqsave(&waitq->lock);
 			set_errno(EINTR);
 			return -1;
 		}
 
+		VECTOR_REMOVE_BY_VALUE(waitq->tasks, task);
+
+		if(task->blocking) { // requeued for a signal that was not delivered
+			continue;
+		}
+
 		struct waitq_trigger *trigger = (void*)task->last_trigger;
 		if(trigger == NULL) {
 			continue;
 		}
 
-		if(type == EVENT_ANY) {
-			return trigger->type;
-		} else if((trigger->type & type)) {
+		if(type == EVENT_ANY || (trigger->type & type)) {
+			spinrelease_irqsave(&waitq->lock);
 			return trigger->type;
 		}
 	}
+}
+
+static void waitq_timer_fire(struct timer *timer) {
+	struct waitq *waitq = timer->data;
 
-	return -1;
+	waitq_trigger_calibrate(waitq->timer_trigger, CURRENT_TASK, EVENT_TIMER);
+	waitq_wake(waitq->timer_trigger);
 }
 
 int waitq_set_timer(struct waitq *waitq, struct timespec timespec) {
-	struct waitq_trigger *timer_trigger = waitq_alloc(waitq, EVENT_TIMER);
+	timer_cancel(&waitq->timer);
 
-	waitq->timespec = timespec;
-	waitq->timer_trigger = timer_trigger;
+	if(waitq->timer_trigger == NULL) {
+		waitq->timer_trigger = waitq_alloc(waitq, EVENT_TIMER);
+		waitq_add(waitq, waitq->timer_trigger);
+	}
 
-	struct timer *timer = alloc(sizeof(struct timer));
-	timer->timespec = timespec;
+	waitq->timer_trigger->fired = 0;
 
-	waitq_add(waitq, timer_trigger);
+	waitq->timer.function = waitq_timer_fire;
+	waitq->timer.data = waitq;
 
-	VECTOR_PUSH(timer->triggers, (void*)timer_trigger);
-	VECTOR_PUSH(timer_list, timer);
+	timer_arm(&waitq->timer, timespec);
 
 	return 0;
 }
 
+// disarms a timer that did not get to fire, every waitq_set_timer needs one once the wait is over
+void waitq_clear_timer(struct waitq *waitq) {
+	timer_cancel(&waitq->timer);
+
+	if(waitq->timer_trigger) {
+		waitq_remove(waitq, waitq->timer_trigger);
+		waitq->timer_trigger = NULL;
+	}
+}
+
 int waitq_add(struct waitq *waitq, struct waitq_trigger *trigger) {
 	spinlock_irqsave(&waitq->lock);
 
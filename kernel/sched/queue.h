@@ -36,7 +36,7 @@ struct waitq {
 	VECTOR(struct task*) tasks;
 	VECTOR(struct waitq_trigger*) triggers;
 
-	struct timespec timespec;
+	struct timer timer;
 	struct waitq_trigger *timer_trigger;
 
 	int status;
@@ -46,6 +46,7 @@ struct waitq {
 
 int waitq_wait(struct waitq *waitq, int type);
 int waitq_set_timer(struct waitq *waitq, struct timespec timespec);
+void waitq_clear_timer(struct waitq *waitq);
 int waitq_add(struct waitq *waitq, struct waitq_trigger *trigger);
 int waitq_remove(struct waitq *waitq, struct waitq_trigger *trigger);
 int waitq_trigger_calibrate(struct waitq_trigger *trigger, struct task *task, int type);
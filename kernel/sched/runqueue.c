@@ -0,0 +1,901 @@
+#include <sched/runqueue.h>
+#include <sched/sched.h>
+#include <sched/smp.h>
+#include <sched/ehfi.h>
+#include <int/apic.h>
+#include <fs/cdev.h>
+#include <mm/pmm.h>
+#include <string.h>
+#include <errno.h>
+#include <cpu.h>
+#include <time.h>
+#include <int/clockevent.h>
+
+uint64_t sched_rr_quantum = SCHED_RR_QUANTUM;
+uint64_t sched_rt_runtime = SCHED_RT_RUNTIME;
+
+void sched_queue_init(struct cpu_local *cpu_local, int cpu) {
+	struct sched_queue *queue = alloc(sizeof(struct sched_queue));
+
+	queue->cpu = cpu;
+	queue->ehfi_index = cpu;
+	queue->perf_capability = UINT8_MAX;
+	queue->energy_capability = UINT8_MAX;
+	queue->idle_stack = pmm_alloc(DIV_ROUNDUP(SCHED_IDLE_STACK_SIZE, PAGE_SIZE), 1) + SCHED_IDLE_STACK_SIZE + HIGH_VMA;
+
+	cpu_local->queue = queue;
+}
+
+struct sched_queue *sched_queue_lock(struct task *task) {
+	for(;;) {
+		struct sched_queue *queue = __atomic_load_n(&task->queue, __ATOMIC_ACQUIRE);
+
+		if(queue == NULL) { // first wake up, the task starts out on the cpu that woke it unless it is busy or not allowed
+			struct sched_queue *target = sched_queue_select(task);
+			__atomic_compare_exchange_n(&task->queue, &queue, target ? target : CORE_LOCAL->queue, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+			continue;
+		}
+
+		spinlock_irqsave(&queue->lock);
+
+		if(__atomic_load_n(&task->queue, __ATOMIC_ACQUIRE) == queue) { // it may have been stolen while we were spinning
+			return queue;
+		}
+
+		spinrelease_irqsave(&queue->lock);
+	}
+}
+
+void sched_queue_unlock(struct sched_queue *queue) {
+	spinrelease_irqsave(&queue->lock);
+}
+
+// weight of each nice level, every step is worth roughly 10% of cpu time against a neighbour
+static const uint64_t sched_nice_weights[SCHED_NICE_MAX - SCHED_NICE_MIN + 1] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	9548, 7620, 6100, 4904, 3906,
+	3121, 2501, 1991, 1586, 1277,
+	1024, 820, 655, 526, 423,
+	335, 272, 215, 172, 137,
+	110, 87, 70, 56, 45,
+	36, 29, 23, 18, 15
+};
+
+uint64_t sched_nice_weight(int nice) {
+	if(nice < SCHED_NICE_MIN) nice = SCHED_NICE_MIN;
+	if(nice > SCHED_NICE_MAX) nice = SCHED_NICE_MAX;
+
+	return sched_nice_weights[nice - SCHED_NICE_MIN];
+}
+
+bool sched_task_rt(struct task *task) {
+	return task->policy != SCHED_OTHER;
+}
+
+// whether task takes the cpu from running as soon as it is runnable
+bool sched_task_rt_preempts(struct task *task, struct task *running) {
+	return sched_task_rt(task) && (!sched_task_rt(running) || task->rt_priority > running->rt_priority);
+}
+
+// fifo tasks never run out, only yielding hands the cpu to the next task of the same priority
+void sched_task_rt_refill(struct task *task) {
+	if(task->rt_slice == 0) {
+		task->rt_slice = task->policy == SCHED_RR ? sched_rr_quantum : UINT64_MAX;
+	}
+}
+
+// highest priority with a queued real time task, -1 when there is none
+static int sched_rt_top(struct sched_queue *queue) {
+	if(queue->rt_bitmap[1]) {
+		return 127 - __builtin_clzll(queue->rt_bitmap[1]);
+	}
+
+	if(queue->rt_bitmap[0]) {
+		return 63 - __builtin_clzll(queue->rt_bitmap[0]);
+	}
+
+	return -1;
+}
+
+static void sched_rt_push(struct sched_queue *queue, struct task *task, bool head) {
+	struct sched_rt_list *list = &queue->rt_lists[task->rt_priority];
+
+	task->rt_prev = NULL;
+	task->rt_next = NULL;
+
+	if(list->head == NULL) {
+		list->head = task;
+		list->tail = task;
+		queue->rt_bitmap[task->rt_priority / 64] |= 1ull << (task->rt_priority % 64);
+	} else if(head) {
+		task->rt_next = list->head;
+		list->head->rt_prev = task;
+		list->head = task;
+	} else {
+		task->rt_prev = list->tail;
+		list->tail->rt_next = task;
+		list->tail = task;
+	}
+
+	queue->rt_cnt++;
+}
+
+static void sched_rt_remove(struct sched_queue *queue, struct task *task) {
+	struct sched_rt_list *list = &queue->rt_lists[task->rt_priority];
+
+	if(task->rt_prev) task->rt_prev->rt_next = task->rt_next;
+	else list->head = task->rt_next;
+
+	if(task->rt_next) task->rt_next->rt_prev = task->rt_prev;
+	else list->tail = task->rt_prev;
+
+	if(list->head == NULL) {
+		queue->rt_bitmap[task->rt_priority / 64] &= ~(1ull << (task->rt_priority % 64));
+	}
+
+	task->rt_prev = NULL;
+	task->rt_next = NULL;
+
+	queue->rt_cnt--;
+}
+
+// real time tasks are held back for the rest of the period once they used up their runtime while fair tasks wait
+static bool sched_queue_rt_throttled(struct sched_queue *queue) {
+	return queue->rt_throttled && queue->tasks.length;
+}
+
+void sched_queue_account(struct task *task, uint64_t now) {
+	struct sched_queue *queue = task->queue;
+
+	if(queue && now - queue->rt_period_start >= SCHED_RT_PERIOD) {
+		queue->rt_period_start = now;
+		queue->rt_time = 0;
+		queue->rt_throttled = false;
+	}
+
+	if(task->exec_start && now > task->exec_start) {
+		uint64_t delta = now - task->exec_start;
+
+		task->exec_runtime += delta;
+		task->vruntime += delta * SCHED_NICE_0_WEIGHT / task->weight;
+
+		if(task->policy == SCHED_RR) {
+			task->rt_slice = task->rt_slice > delta ? task->rt_slice - delta : 0;
+		}
+
+		if(queue && sched_task_rt(task)) {
+			queue->rt_time += delta;
+
+			if(queue->rt_time >= sched_rt_runtime && !queue->rt_throttled) {
+				queue->rt_throttled = true;
+				queue->rt_throttle_cnt++;
+			}
+		}
+	}
+
+	task->exec_start = now;
+}
+
+void sched_queue_update_min(struct sched_queue *queue, struct task *running) {
+	struct priority_heap_node *min = priority_heap_min(&queue->tasks);
+	uint64_t vruntime;
+
+	if(running && min) {
+		vruntime = running->vruntime < min->key ? running->vruntime : min->key;
+	} else if(running) {
+		vruntime = running->vruntime;
+	} else if(min) {
+		vruntime = min->key;
+	} else {
+		return;
+	}
+
+	if(vruntime > queue->min_vruntime) { // only ever moves forward
+		queue->min_vruntime = vruntime;
+	}
+}
+
+bool sched_queue_should_preempt(struct sched_queue *queue, struct task *running) {
+	int top = sched_rt_top(queue);
+	bool throttled = sched_queue_rt_throttled(queue);
+
+	if(sched_task_rt(running)) { // the same priority only gets a turn once the quantum ran out or the task yielded
+		return throttled || top > running->rt_priority || (top == running->rt_priority && running->rt_slice == 0);
+	}
+
+	if(top != -1 && !throttled) {
+		return true;
+	}
+
+	struct priority_heap_node *min = priority_heap_min(&queue->tasks);
+
+	return min && min->key < running->vruntime;
+}
+
+// adaptive tick, a slice of the latency period when the cpu is contended, a long housekeeping
+// tick when the current task is alone and none at all when idle, pending timers always cut it short
+uint64_t sched_queue_next_tick(struct sched_queue *queue, uint64_t now) {
+	uint64_t deadline = timer_next(queue->cpu);
+
+	if(queue->current == NULL) {
+		return deadline;
+	}
+
+	struct task *current = queue->current;
+	uint64_t slice = SCHED_TICK_MAX;
+
+	if(sched_task_rt(current)) {
+		if(current->policy == SCHED_RR && queue->rt_lists[current->rt_priority].head && current->rt_slice < slice) {
+			slice = current->rt_slice;
+		}
+
+		if(queue->tasks.length) { // the throttle has to catch it the moment the runtime is used up
+			uint64_t budget = sched_rt_runtime > queue->rt_time ? sched_rt_runtime - queue->rt_time : 0;
+
+			if(budget < slice) {
+				slice = budget;
+			}
+		}
+	} else if(queue->tasks.length) {
+		slice = SCHED_LATENCY / (queue->tasks.length + 1);
+		if(slice < SCHED_MIN_SLICE) {
+			slice = SCHED_MIN_SLICE;
+		}
+	}
+
+	if(queue->rt_cnt && queue->rt_throttled) { // let them back in when the period ends
+		uint64_t end = queue->rt_period_start + SCHED_RT_PERIOD;
+		uint64_t wait = end > now ? end - now : 0;
+
+		if(wait < slice) {
+			slice = wait;
+		}
+	}
+
+	return now + slice < deadline ? now + slice : deadline;
+}
+
+void sched_queue_push(struct sched_queue *queue, struct task *task, bool wakeup) {
+	if(task->queued) {
+		return;
+	}
+
+	if(task->wait_start == 0) { // a move between queues keeps waiting from when it first became runnable
+		task->wait_start = clock_nanoseconds();
+		task->wakeup_pending = wakeup;
+	}
+
+	if(sched_task_rt(task)) { // preempted with quantum left it goes back to the front, as if it never left the cpu
+		sched_rt_push(queue, task, !wakeup && task->rt_slice);
+	} else {
+		if(wakeup) { // a sleeper gets a bounded head start, not the whole time it slept
+			uint64_t floor = queue->min_vruntime > SCHED_WAKEUP_CREDIT ? queue->min_vruntime - SCHED_WAKEUP_CREDIT : 0;
+
+			if(task->vruntime < floor) {
+				task->vruntime = floor;
+			}
+		}
+
+		task->run_node.key = task->vruntime;
+		task->run_node.data = task;
+
+		priority_heap_insert(&queue->tasks, &task->run_node);
+	}
+
+	task->queued = true;
+	queue->length++;
+
+	if(queue->length > queue->max_length) {
+		queue->max_length = queue->length;
+	}
+}
+
+void sched_queue_remove(struct sched_queue *queue, struct task *task) {
+	if(!task->queued) {
+		return;
+	}
+
+	if(sched_task_rt(task)) {
+		sched_rt_remove(queue, task);
+	} else {
+		priority_heap_delete(&queue->tasks, &task->run_node);
+	}
+
+	task->queued = false;
+	queue->length--;
+}
+
+struct task *sched_queue_take(struct sched_queue *queue) {
+	int top = sched_rt_top(queue);
+
+	if(top != -1 && !sched_queue_rt_throttled(queue)) {
+		struct task *task = queue->rt_lists[top].head;
+
+		if(__atomic_load_n(&task->on_cpu, __ATOMIC_ACQUIRE)) {
+			return NULL;
+		}
+
+		sched_queue_remove(queue, task);
+
+		return task;
+	}
+
+	struct priority_heap_node *min = priority_heap_min(&queue->tasks);
+	if(min == NULL) {
+		return NULL;
+	}
+
+	struct task *task = min->data;
+
+	if(__atomic_load_n(&task->on_cpu, __ATOMIC_ACQUIRE)) { // still switching away on its last cpu
+		return NULL;
+	}
+
+	sched_queue_remove(queue, task);
+
+	return task;
+}
+
+// keeps the lag of a task relative to the queue it moves to
+static void sched_queue_rebase(struct sched_queue *source, struct sched_queue *target, struct task *task) {
+	int64_t lag = task->vruntime - source->min_vruntime;
+
+	task->vruntime = (int64_t)target->min_vruntime + lag > 0 ? target->min_vruntime + lag : 0;
+}
+
+bool sched_task_allowed(struct task *task, int cpu) {
+	return cpu_mask_test(&task->cpu_mask, cpu);
+}
+
+// highest priority real time task, else the lowest vruntime one, that may run on cpu. the scan is bounded
+// since it runs from the tick
+static struct task *sched_queue_take_allowed(struct sched_queue *queue, int cpu) {
+	size_t i = 0;
+
+	for(int prio = SCHED_RT_PRIO_MAX; prio >= SCHED_RT_PRIO_MIN && queue->rt_cnt && i < SCHED_STEAL_SCAN; prio--) {
+		for(struct task *task = queue->rt_lists[prio].head; task && i < SCHED_STEAL_SCAN; task = task->rt_next, i++) {
+			if(sched_task_allowed(task, cpu) && !__atomic_load_n(&task->on_cpu, __ATOMIC_ACQUIRE)) {
+				sched_queue_remove(queue, task);
+				return task;
+			}
+		}
+	}
+
+	struct priority_heap_node *node = NULL;
+	struct priority_heap_node *best = NULL;
+
+	for(i = 0; i < SCHED_STEAL_SCAN && (node = priority_heap_next(&queue->tasks, node)); i++) {
+		struct task *task = node->data;
+
+		if(!sched_task_allowed(task, cpu) || __atomic_load_n(&task->on_cpu, __ATOMIC_ACQUIRE)) {
+			continue;
+		}
+
+		if(best == NULL || node->key < best->key) {
+			best = node;
+		}
+	}
+
+	if(best == NULL) {
+		return NULL;
+	}
+
+	sched_queue_remove(queue, best->data);
+
+	return best->data;
+}
+
+struct task *sched_queue_steal(struct sched_queue *queue) {
+	struct sched_queue *busiest = NULL;
+
+	if(ehfi_active && queue->perf_capability == 0) { // the hardware wants this cpu left alone
+		return NULL;
+	}
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *victim = cpu_list.data[i]->queue;
+
+		if(victim == queue || victim->length == 0) {
+			continue;
+		}
+
+		if(busiest == NULL || victim->length > busiest->length) {
+			busiest = victim;
+		}
+	}
+
+	if(busiest == NULL) {
+		return NULL;
+	}
+
+	// never wait on a remote queue from the tick, a contended queue has an active owner anyway
+	if(!spintrylock_irqsave(&busiest->lock)) {
+		return NULL;
+	}
+
+	struct task *task = sched_queue_take_allowed(busiest, queue->cpu);
+	if(task) {
+		sched_queue_rebase(busiest, queue, task);
+		__atomic_store_n(&task->queue, queue, __ATOMIC_RELEASE);
+		queue->steal_cnt++;
+	}
+
+	spinrelease_irqsave(&busiest->lock);
+
+	return task;
+}
+
+static int sched_hist_bucket(uint64_t ns) {
+	uint64_t us = ns / 1000;
+	int bucket = us ? 64 - __builtin_clzll(us) : 0;
+
+	return bucket < SCHED_HIST_BUCKETS ? bucket : SCHED_HIST_BUCKETS - 1;
+}
+
+// idle and wait time bookkeeping, called with the queue locked before next_task becomes current
+void sched_queue_account_switch(struct sched_queue *queue, struct task *next_task, uint64_t now) {
+	if(queue->idle_start) {
+		queue->idle_time += now - queue->idle_start;
+		queue->idle_start = 0;
+	}
+
+	if(next_task == NULL) {
+		queue->idle_start = now;
+		return;
+	}
+
+	if(next_task->wait_start) {
+		uint64_t wait = now > next_task->wait_start ? now - next_task->wait_start : 0;
+
+		next_task->wait_time += wait;
+
+		if(next_task->wakeup_pending) {
+			queue->wakeup_hist[sched_hist_bucket(wait)]++;
+			next_task->wakeup_cnt++;
+		}
+
+		next_task->wait_start = 0;
+		next_task->wakeup_pending = false;
+	}
+}
+
+int sched_task_class(struct task *task) {
+	if(sched_task_rt(task)) {
+		return SCHED_CLASS_PERF;
+	}
+
+	if(task->nice > 0) {
+		return SCHED_CLASS_BACKGROUND;
+	}
+
+	if(task->run_streak >= SCHED_CPU_BOUND_STREAK) {
+		return SCHED_CLASS_PERF;
+	}
+
+	return SCHED_CLASS_NORMAL;
+}
+
+// tasks queued or running on queue, not counting the task itself
+static size_t sched_queue_load(struct sched_queue *queue, struct task *task) {
+	size_t load = __atomic_load_n(&queue->length, __ATOMIC_RELAXED) + (queue->current != NULL);
+
+	if(queue == task->queue && (task->queued || queue->current == task) && load) {
+		load--;
+	}
+
+	return load;
+}
+
+// share of the capability the task would get on queue, background work is weighed by efficiency
+static uint64_t sched_queue_score(struct sched_queue *queue, struct task *task, int class) {
+	if(queue->perf_capability == 0) {
+		return 0;
+	}
+
+	uint64_t capability = class == SCHED_CLASS_BACKGROUND ? queue->energy_capability : queue->perf_capability;
+
+	return (capability * 1024) / (sched_queue_load(queue, task) + 1);
+}
+
+// where the hardware feedback table would rather have the task run, NULL when no allowed cpu is worth the move
+static struct sched_queue *sched_queue_select_ehfi(struct task *task, struct sched_queue *source, int class) {
+	uint64_t source_score = source ? sched_queue_score(source, task, class) : 0;
+
+	struct sched_queue *best = NULL;
+	uint64_t best_score = 0;
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *queue = cpu_list.data[i]->queue;
+		if(!sched_task_allowed(task, queue->cpu)) {
+			continue;
+		}
+
+		uint64_t score = sched_queue_score(queue, task, class);
+
+		if(score > best_score) {
+			best = queue;
+			best_score = score;
+		}
+	}
+
+	if(best && source && best_score <= source_score + source_score / SCHED_EHFI_MARGIN) { // not worth losing the cache over
+		return source;
+	}
+
+	return best;
+}
+
+// highest real time priority running or queued on queue, 0 when it only has fair tasks and -1 when idle
+static int sched_queue_rt_level(struct sched_queue *queue) {
+	struct task *current = __atomic_load_n(&queue->current, __ATOMIC_RELAXED);
+	int level = sched_rt_top(queue);
+
+	if(current == NULL) {
+		return level;
+	}
+
+	int running = sched_task_rt(current) ? current->rt_priority : 0;
+
+	return level > running ? level : running;
+}
+
+// real time tasks go to the allowed cpu running the least important work, the warm one as long as
+// nothing of the same or a higher priority holds it
+static struct sched_queue *sched_queue_select_rt(struct task *task, struct sched_queue *source) {
+	if(source && sched_queue_rt_level(source) < task->rt_priority) {
+		return source;
+	}
+
+	struct sched_queue *best = NULL;
+	int best_level = 0;
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *queue = cpu_list.data[i]->queue;
+		if(!sched_task_allowed(task, queue->cpu)) {
+			continue;
+		}
+
+		int level = sched_queue_rt_level(queue);
+
+		if(best == NULL || level < best_level || (level == best_level && queue->cpu == task->last_cpu)) {
+			best = queue;
+			best_level = level;
+		}
+	}
+
+	if(best == NULL || (source && best_level >= task->rt_priority)) { // nowhere better, wait our turn here
+		return source;
+	}
+
+	return best;
+}
+
+// where a waking task should run, NULL to leave it where it is. the cache stays warm on the cpu the task
+// last ran on, so it only moves when that cpu is not allowed or is overloaded compared to the idlest one
+struct sched_queue *sched_queue_select(struct task *task) {
+	struct sched_queue *home = task->queue ? task->queue : CORE_LOCAL->queue;
+	struct sched_queue *source = sched_task_allowed(task, home->cpu) ? home : NULL;
+	int class = sched_task_class(task);
+
+	if(sched_task_rt(task)) {
+		struct sched_queue *best = sched_queue_select_rt(task, source);
+
+		return best == home ? NULL : best;
+	}
+
+	// ordinary tasks only follow the feedback table off a cpu the hardware asked us to vacate
+	if(ehfi_active && (class != SCHED_CLASS_NORMAL || source == NULL || source->perf_capability == 0)) {
+		struct sched_queue *best = sched_queue_select_ehfi(task, source, class);
+
+		if(best) {
+			return best == home ? NULL : best;
+		}
+	}
+
+	struct sched_queue *idlest = NULL;
+	size_t idlest_load = 0;
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *queue = cpu_list.data[i]->queue;
+		if(!sched_task_allowed(task, queue->cpu)) {
+			continue;
+		}
+
+		size_t load = sched_queue_load(queue, task);
+
+		if(idlest == NULL || load < idlest_load || (load == idlest_load && queue->cpu == task->last_cpu)) {
+			idlest = queue;
+			idlest_load = load;
+		}
+	}
+
+	if(idlest == NULL || (source && sched_queue_load(source, task) <= idlest_load + SCHED_WARM_SLACK)) {
+		return NULL;
+	}
+
+	return idlest == home ? NULL : idlest;
+}
+
+// source is locked by the caller, a contended target is skipped instead of waited on
+static bool sched_queue_move(struct sched_queue *source, struct sched_queue *target, struct task *task) {
+	if(source->current == task || !spintrylock_irqsave(&target->lock)) {
+		return false;
+	}
+
+	bool queued = task->queued;
+
+	sched_queue_remove(source, task);
+	sched_queue_rebase(source, target, task);
+
+	__atomic_store_n(&task->queue, target, __ATOMIC_RELEASE);
+
+	if(queued) {
+		sched_queue_push(target, task, false);
+	}
+
+	target->migrate_cnt++;
+
+	spinrelease_irqsave(&target->lock);
+
+	return true;
+}
+
+// wake up placement, the caller requeues the task on whatever queue it ends up on. a task that is not
+// allowed on its queue anymore has to leave, so a contended target is retried instead of skipped
+void sched_queue_place(struct task *task) {
+	if(__atomic_load_n(&task->queue, __ATOMIC_ACQUIRE) == NULL) {
+		return;
+	}
+
+	for(;;) {
+		struct sched_queue *target = sched_queue_select(task);
+		if(target == NULL) {
+			return;
+		}
+
+		struct sched_queue *source = sched_queue_lock(task);
+
+		bool done = source == target || source->current == task || sched_queue_move(source, target, task) ||
+			sched_task_allowed(task, source->cpu);
+
+		sched_queue_unlock(source);
+
+		if(done) {
+			return;
+		}
+
+		asm volatile ("pause");
+	}
+}
+
+// the feedback table changed, queued tasks move right away and running ones follow on their next wake up
+void sched_queue_rebalance() {
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *source = cpu_list.data[i]->queue;
+		struct task *batch[SCHED_EHFI_BATCH];
+		size_t cnt = 0;
+
+		spinlock_irqsave(&source->lock);
+
+		struct priority_heap_node *node = NULL;
+		while(cnt < SCHED_EHFI_BATCH && (node = priority_heap_next(&source->tasks, node))) {
+			if(sched_queue_select(node->data)) {
+				batch[cnt++] = node->data;
+			}
+		}
+
+		for(size_t j = 0; j < cnt; j++) { // scores shift with every move, so each one is picked again
+			struct sched_queue *target = sched_queue_select(batch[j]);
+
+			if(target && sched_queue_move(source, target, batch[j]) && target->current == NULL) {
+				xapic_send_ipi(cpu_list.data[target->cpu]->apic_id, SCHED_VECTOR);
+			}
+		}
+
+		spinrelease_irqsave(&source->lock);
+	}
+}
+
+static ssize_t schedstat_read(struct file_handle *file, void *buf, size_t cnt, off_t offset);
+static ssize_t schedstat_write(struct file_handle *file, const void *buf, size_t cnt, off_t offset);
+static ssize_t taskstat_read(struct file_handle *file, void *buf, size_t cnt, off_t offset);
+
+static struct file_ops schedstat_ops = {
+	.read = schedstat_read,
+	.write = schedstat_write
+};
+
+static struct file_ops taskstat_ops = {
+	.read = taskstat_read
+};
+
+// the text is rebuilt on every read, so a reader that wants a consistent snapshot reads it in one go
+static ssize_t stat_copy(char *text, size_t length, void *buf, size_t cnt, off_t offset) {
+	if(offset >= length) {
+		free(text);
+		return 0;
+	}
+
+	if(cnt > length - offset) {
+		cnt = length - offset;
+	}
+
+	memcpy(buf, text + offset, cnt);
+	free(text);
+
+	return cnt;
+}
+
+static ssize_t schedstat_read(struct file_handle*, void *buf, size_t cnt, off_t offset) {
+	size_t line = 320 + SCHED_HIST_BUCKETS * 12;
+	size_t size = cpu_list.length * line + 128 + 1;
+
+	char *text = alloc(size);
+	size_t length = sprint(text, "rr_quantum %d rt_runtime %d rt_period %d\n", sched_rr_quantum, sched_rt_runtime, SCHED_RT_PERIOD);
+
+	uint64_t now = clock_nanoseconds();
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *queue = cpu_list.data[i]->queue;
+
+		spinlock_irqsave(&queue->lock);
+
+		size_t avg = queue->tick_cnt ? queue->load_sum * 10 / queue->tick_cnt : 0;
+		struct task *current = queue->current;
+
+		struct clockevent *clockevent = cpu_list.data[i]->clockevent;
+		struct timer_base *timers = cpu_list.data[i]->timers;
+
+		uint64_t idle_time = queue->idle_time;
+		if(queue->idle_start && now > queue->idle_start) {
+			idle_time += now - queue->idle_start;
+		}
+
+		length += sprint(text + length, "cpu%d running %d queued %d max %d avg %d.%d switches %d steals %d idle %d timer %d"
+			" armed %d fired %d cancelled %d migrations %d perf %d energy %d rt %d throttled %d deferred %d latency %d"
+			" idle_ns %d\n",
+			queue->cpu, current ? current->id.pid : 0, queue->length, queue->max_length,
+			avg / 10, avg % 10, queue->switch_cnt, queue->steal_cnt, queue->idle_cnt,
+			clockevent ? clockevent->program_cnt : 0, timers->armed_cnt, timers->fired_cnt, timers->cancel_cnt,
+			queue->migrate_cnt, queue->perf_capability, queue->energy_capability, queue->rt_cnt, queue->rt_throttle_cnt,
+			queue->defer_cnt, queue->latency_max, idle_time);
+
+		// wake up to run latency, bucket n counts latencies under 2^n us
+		length += sprint(text + length, "cpu%d wakeup_us", queue->cpu);
+
+		for(int j = 0; j < SCHED_HIST_BUCKETS; j++) {
+			length += sprint(text + length, " %d", queue->wakeup_hist[j]);
+		}
+
+		length += sprint(text + length, "\n");
+
+		spinrelease_irqsave(&queue->lock);
+	}
+
+	return stat_copy(text, length, buf, cnt, offset);
+}
+
+// one line per thread with a header naming the columns. the pid and tid lists are walked under sched_lock,
+// exits free their layers, the counters themselves are read racily
+static ssize_t taskstat_read(struct file_handle*, void *buf, size_t cnt, off_t offset) {
+	struct idr *process_list = &CURRENT_TASK->namespace->process_list;
+	size_t thread_cnt = 0;
+
+	spinlock_irqsave(&sched_lock);
+
+	struct task *task;
+	for(size_t pid = 0; (task = idr_next(process_list, &pid)); pid++) {
+		thread_cnt += task->thread_group->process_list.count;
+	}
+
+	spinrelease_irqsave(&sched_lock);
+
+	size_t size = thread_cnt * 192 + 192 + 1;
+	if(size > 65536) {
+		size = 65536;
+	}
+
+	char *text = alloc(size);
+	size_t length = sprint(text, "pid tid state cpu policy priority nice runtime_ns wait_ns nvcsw nivcsw migrations wakeups\n");
+
+	spinlock_irqsave(&sched_lock);
+
+	for(size_t pid = 0; length + 192 < size && (task = idr_next(process_list, &pid)); pid++) {
+		struct task *thread;
+		for(size_t tid = 0; length + 192 < size && (thread = idr_next(&task->thread_group->process_list, &tid)); tid++) {
+			const char *state;
+			switch(thread->sched_status) {
+				case TASK_RUNNING: state = "R"; break;
+				case TASK_WAITING: state = "W"; break;
+				case TASK_YIELD: state = "S"; break;
+				default: state = "Z";
+			}
+
+			// sprint has no signed conversion, a task that never ran shows cpu -1
+			length += sprint(text + length, "%d %d %s %s%d %d %d %s%d %d %d %d %d %d %d\n",
+				thread->id.pid, thread->id.tid, state, thread->last_cpu < 0 ? "-" : "",
+				thread->last_cpu < 0 ? 1 : thread->last_cpu, thread->policy, thread->rt_priority,
+				thread->nice < 0 ? "-" : "", thread->nice < 0 ? -thread->nice : thread->nice, thread->exec_runtime,
+				thread->wait_time, thread->nvcsw, thread->nivcsw, thread->migrate_cnt, thread->wakeup_cnt);
+		}
+	}
+
+	spinrelease_irqsave(&sched_lock);
+
+	return stat_copy(text, length, buf, cnt, offset);
+}
+
+// takes "rr_quantum ms" and "rt_runtime ms" lines
+static ssize_t schedstat_write(struct file_handle*, const void *buf, size_t cnt, off_t) {
+	const char *text = buf;
+	const char *end = text + cnt;
+
+	while(text < end) {
+		uint64_t *setting;
+		size_t name_length;
+
+		if(end - text > 10 && memcmp(text, "rr_quantum", 10) == 0) {
+			setting = &sched_rr_quantum;
+			name_length = 10;
+		} else if(end - text > 10 && memcmp(text, "rt_runtime", 10) == 0) {
+			setting = &sched_rt_runtime;
+			name_length = 10;
+		} else {
+			set_errno(EINVAL);
+			return -1;
+		}
+
+		text += name_length;
+		while(text < end && (*text == ' ' || *text == '\t')) text++;
+
+		if(text == end || *text < '0' || *text > '9') {
+			set_errno(EINVAL);
+			return -1;
+		}
+
+		uint64_t ms = 0;
+		while(text < end && *text >= '0' && *text <= '9') {
+			ms = ms * 10 + (*text++ - '0');
+		}
+
+		if(ms == 0 || ms * 1000000 > SCHED_RT_PERIOD) {
+			set_errno(EINVAL);
+			return -1;
+		}
+
+		*setting = ms * 1000000;
+
+		while(text < end && (*text == ' ' || *text == '\t' || *text == '\n')) text++;
+	}
+
+	return cnt;
+}
+
+int schedstat_init() {
+	struct cdev *cdev = alloc(sizeof(struct cdev));
+	cdev->fops = &schedstat_ops;
+	cdev->rdev = makedev(SCHEDSTAT_MAJOR, 0);
+	if(cdev_register(cdev) == -1)
+		return -1;
+
+	struct stat *stat = alloc(sizeof(struct stat));
+	stat_init(stat);
+	stat->st_mode = S_IFCHR | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+	stat->st_rdev = makedev(SCHEDSTAT_MAJOR, 0);
+	vfs_create_node_deep(NULL, NULL, NULL, stat, "/dev/schedstat");
+
+	cdev = alloc(sizeof(struct cdev));
+	cdev->fops = &taskstat_ops;
+	cdev->rdev = makedev(SCHEDSTAT_MAJOR, 1);
+	if(cdev_register(cdev) == -1)
+		return -1;
+
+	stat = alloc(sizeof(struct stat));
+	stat_init(stat);
+	stat->st_mode = S_IFCHR | S_IRUSR | S_IRGRP | S_IROTH;
+	stat->st_rdev = makedev(SCHEDSTAT_MAJOR, 1);
+	vfs_create_node_deep(NULL, NULL, NULL, stat, "/dev/taskstat");
+
+	return 0;
+}
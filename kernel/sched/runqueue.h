@@ -0,0 +1,148 @@
+#pragma once
+
+#include <types.h>
+#include <lock.h>
+#include <priority_heap.h>
+#include <cpu.h>
+
+#define SCHEDSTAT_MAJOR 240 // minor 0 is /dev/schedstat, minor 1 /dev/taskstat
+
+#define SCHED_IDLE_STACK_SIZE 0x4000
+
+#define SCHED_NICE_MIN -20
+#define SCHED_NICE_MAX 19
+#define SCHED_NICE_0_WEIGHT 1024
+
+#define SCHED_WAKEUP_CREDIT 10000000 // ns of vruntime a sleeper may start behind the queue
+#define SCHED_WAKEUP_GRANULARITY 1000000 // how far ahead a woken task must be to preempt
+
+#define SCHED_LATENCY 20000000 // ns in which every runnable task on a queue should get to run once
+#define SCHED_MIN_SLICE 2000000
+#define SCHED_TICK_MAX 100000000 // housekeeping tick for a task that has its cpu to itself
+
+#define SCHED_CPU_BOUND_STREAK 3 // ticks in a row a task was still runnable at before it counts as cpu bound
+#define SCHED_EHFI_MARGIN 4 // a move has to improve the score by at least 1/SCHED_EHFI_MARGIN
+#define SCHED_EHFI_BATCH 16
+
+#define SCHED_STEAL_SCAN 32 // queued tasks looked at for one the stealing cpu is allowed to run
+#define SCHED_WARM_SLACK 1 // tasks leave their last cpu once it has more than this many extra tasks queued over the idlest
+
+#define SCHED_CPU_MAX 256
+
+#define SCHED_HIST_BUCKETS 16 // wake up latency histogram, bucket n counts latencies under 2^n us, the last one the rest
+
+#define SCHED_OTHER 0
+#define SCHED_FIFO 1
+#define SCHED_RR 2
+
+#define SCHED_RT_PRIO_MIN 1
+#define SCHED_RT_PRIO_MAX 99
+
+#define SCHED_RR_QUANTUM 100000000 // default ns a round robin task runs before the next one of its priority
+#define SCHED_RT_PERIOD 1000000000
+#define SCHED_RT_RUNTIME 950000000 // default ns of each period real time tasks may use, the rest is left to fair tasks
+
+#define SCHED_CLASS_NORMAL 0
+#define SCHED_CLASS_PERF 1
+#define SCHED_CLASS_BACKGROUND 2
+
+struct task;
+struct cpu_local;
+
+struct cpu_mask {
+	uint64_t bits[SCHED_CPU_MAX / 64];
+};
+
+static inline bool cpu_mask_test(const struct cpu_mask *mask, int cpu) {
+	return cpu < SCHED_CPU_MAX && (mask->bits[cpu / 64] & (1ull << (cpu % 64)));
+}
+
+static inline void cpu_mask_fill(struct cpu_mask *mask) {
+	for(size_t i = 0; i < SCHED_CPU_MAX / 64; i++) {
+		mask->bits[i] = ~0ull;
+	}
+}
+
+struct sched_param {
+	int sched_priority;
+};
+
+struct sched_rt_list {
+	struct task *head;
+	struct task *tail;
+};
+
+struct sched_queue {
+	struct spinlock lock;
+
+	struct priority_heap tasks; // runnable tasks keyed on vruntime
+	uint64_t min_vruntime;
+
+	// real time tasks always go before the fair ones, a fifo per priority and a bitmap of the non empty ones
+	struct sched_rt_list rt_lists[SCHED_RT_PRIO_MAX + 1];
+	uint64_t rt_bitmap[2];
+	size_t rt_cnt;
+
+	uint64_t rt_period_start;
+	uint64_t rt_time; // ns real time tasks ran for in the current period
+	bool rt_throttled;
+
+	size_t length; // queued tasks of every class
+
+	struct task *current;
+
+	int cpu;
+	uintptr_t idle_stack;
+	struct registers idle_regs; // frame the cpu resumes from when nothing is runnable
+
+	int ehfi_index; // row of this cpu in the hardware feedback table
+	uint8_t perf_capability; // 0 asks us to keep work off this cpu
+	uint8_t energy_capability;
+
+	size_t max_length;
+	size_t load_sum;
+	size_t tick_cnt;
+	size_t switch_cnt;
+	size_t steal_cnt;
+	size_t idle_cnt;
+	size_t migrate_cnt;
+	size_t rt_throttle_cnt;
+	size_t defer_cnt; // ticks that found kernel code in a preempt section
+	uint64_t latency_max; // worst ns between a tick or reschedule request and the cpu acting on it
+
+	uint64_t idle_start; // when the cpu went idle, 0 while it runs a task
+	uint64_t idle_time;
+	size_t wakeup_hist[SCHED_HIST_BUCKETS];
+};
+
+extern uint64_t sched_rr_quantum;
+extern uint64_t sched_rt_runtime;
+
+void sched_queue_init(struct cpu_local *cpu_local, int cpu);
+
+struct sched_queue *sched_queue_lock(struct task *task);
+void sched_queue_unlock(struct sched_queue *queue);
+
+void sched_queue_push(struct sched_queue *queue, struct task *task, bool wakeup);
+void sched_queue_remove(struct sched_queue *queue, struct task *task);
+struct task *sched_queue_take(struct sched_queue *queue);
+struct task *sched_queue_steal(struct sched_queue *queue);
+bool sched_task_allowed(struct task *task, int cpu);
+
+void sched_queue_account(struct task *task, uint64_t now);
+void sched_queue_account_switch(struct sched_queue *queue, struct task *next_task, uint64_t now);
+void sched_queue_update_min(struct sched_queue *queue, struct task *running);
+bool sched_queue_should_preempt(struct sched_queue *queue, struct task *running);
+uint64_t sched_queue_next_tick(struct sched_queue *queue, uint64_t now);
+
+int sched_task_class(struct task *task);
+bool sched_task_rt(struct task *task);
+bool sched_task_rt_preempts(struct task *task, struct task *running);
+void sched_task_rt_refill(struct task *task);
+struct sched_queue *sched_queue_select(struct task *task);
+void sched_queue_place(struct task *task);
+void sched_queue_rebalance();
+
+uint64_t sched_nice_weight(int nice);
+
+int schedstat_init();
@@ -1,4 +1,5 @@
 #include <sched/sched.h>
+#include <sched/smp.h>
 #include <int/apic.h>
 #include <vector.h>
 #include <cpu.h>
@@ -7,14 +8,19 @@
 #include <debug.h>
 #include <elf.h>
 #include <mm/mmap.h>
+#include <mm/reclaim.h>
 #include <types.h>
 #include <errno.h>
 #include <fs/fd.h>
 #include <time.h>
 #include <lock.h>
+#include <drivers/hpet.h>
+#include <int/clockevent.h>
+#include <sched/vdso.h>
+#include <sched/fpu.h>
+#include <sched/preempt.h>
 
 static struct hash_table namespace_list;
-static VECTOR(struct task*) task_queue;
 
 static struct bitmap nid_bitmap = {
 	.data = NULL,
@@ -30,87 +36,148 @@ struct task *sched_translate_pid(nid_t nid, pid_t pid, tid_t tid) {
 		return NULL;
 	}
 
-	struct task *task = hash_table_search(&namespace->process_list, &pid, sizeof(pid));
+	struct task *task = idr_find(&namespace->process_list, pid);
 	if(task == NULL) {
 		return NULL;
 	}
 
-	struct task *thread = hash_table_search(&task->thread_group->process_list, &tid, sizeof(tid));
+	return idr_find(&task->thread_group->process_list, tid);
+}
 
-	return thread;
+// what CURRENT_TASK returns on this cpu, NULL drops the identity of whatever ran last
+static void sched_set_current(struct task *task) {
+	CORE_LOCAL_WRITE(current, task);
+	CORE_LOCAL_WRITE(pid, task ? task->id.pid : -1);
+	CORE_LOCAL_WRITE(tid, task ? task->id.tid : -1);
 }
 
-struct task *find_next_task() {
-	struct task *ret = NULL;
+static bool sched_release_dummy;
 
-	for(size_t i = 0, cnt = 0; i < task_queue.length; i++) {
-		struct task *task = task_queue.data[i];
-		if(task == NULL) {
-			continue;
-		}
+extern void sched_switch(struct registers *save, struct registers *next, bool *release);
+extern __attribute__((noreturn)) void sched_resume(struct registers *next, bool *release);
 
-		task->idle_cnt++;
+static void sched_idle_loop() {
+	for(;;) {
+		asm volatile ("hlt");
+	}
+}
 
-		//print("task: %d:%d: status: %d\n", task->id.pid, task->id.tid, task->sched_status);
+// the cpu idles on its own stack, the last task may resume on another cpu while we wait
+static struct registers *sched_idle_frame(struct sched_queue *queue) {
+	queue->idle_regs = (struct registers) {
+		.rip = (uintptr_t)sched_idle_loop,
+		.cs = 0x28,
+		.rflags = 0x202,
+		.rsp = queue->idle_stack - 8,
+		.ss = 0x30
+	};
 
-		if((task->sched_status == TASK_WAITING || task->dispatch_ready == true) && cnt < task->idle_cnt) {
-			cnt = task->idle_cnt;
-			ret = task;
-		}
-	}
+	return &queue->idle_regs;
+}
 
-	return ret;
+// false when there is nothing to save, the cpu was idle or the task was abandoned by exit/execve
+static bool sched_live(struct task *last_task) {
+	return last_task && CORE_LOCAL_READ(current) != NULL;
 }
 
-void sched_idle() {
-	xapic_write(XAPIC_EOI_OFF, 0);
-	spinrelease_irqsave(&sched_lock);
+static bool sched_save(struct sched_queue *queue, struct task *last_task, uint64_t now) {
+	if(!sched_live(last_task)) {
+		return false;
+	}
 
-	for(;;) {
-		asm volatile ("hlt");
+	if(last_task->sched_status == TASK_RUNNING) {
+		last_task->sched_status = TASK_WAITING;
+	}
+
+	last_task->errno = CORE_LOCAL->errno;
+	last_task->user_fs_base = get_user_fs();
+	last_task->user_gs_base = get_user_gs();
+	last_task->user_stack.sp = CORE_LOCAL->user_stack;
+
+	sched_queue_account(last_task, now);
+
+	bool runnable = last_task->sched_status == TASK_WAITING;
+
+	if(!runnable) {
+		last_task->run_streak = 0;
 	}
+
+	// the mask no longer covers this cpu, switch away without queueing and let the timer place it elsewhere
+	if(runnable && !sched_task_allowed(last_task, queue->cpu)) {
+		timer_arm(&last_task->migrate_timer, (struct timespec) { 0 });
+		runnable = false;
+	}
+
+	sched_queue_update_min(queue, runnable && !sched_task_rt(last_task) ? last_task : NULL);
+
+	return runnable;
 }
 
-void reschedule(struct registers *regs, void*) {
-	if(__atomic_test_and_set(&sched_lock, __ATOMIC_ACQUIRE)) {
-		return;
+static struct task *sched_pick_next(struct sched_queue *queue, struct task *last_task, bool runnable) {
+	if(runnable && !sched_queue_should_preempt(queue, last_task)) {
+		sched_task_rt_refill(last_task); // alone on its priority, a round robin task starts another quantum
+		return NULL;
 	}
 
-	struct task *next_task = find_next_task();
-	if(next_task == NULL) {
-		if(CORE_LOCAL->tid != -1 && CORE_LOCAL->pid != -1) {
-			signal_dispatch(CURRENT_TASK, regs);
-			spinrelease_irqsave(&sched_lock);
-			return;
-		}
-		sched_idle();
+	struct task *next_task = sched_queue_take(queue);
+	if(next_task == NULL && !runnable) {
+		next_task = sched_queue_steal(queue);
 	}
 
-	if(CORE_LOCAL->tid != -1 && CORE_LOCAL->pid != -1) {
-		struct task *last_task = CURRENT_TASK;
-		if(last_task == NULL) {
-			sched_idle();
+	return next_task;
+}
+
+// makes next_task current on this cpu and returns the frame it resumes from
+static struct registers *sched_enter(struct sched_queue *queue, struct task *last_task, bool runnable,
+	struct task *next_task, uint64_t now) {
+	fpu_switch(sched_live(last_task) ? last_task : NULL);
+
+	if(sched_live(last_task)) { // a task evicted by its affinity mask still wanted the cpu
+		if(last_task->sched_status == TASK_WAITING) {
+			last_task->nivcsw++;
+		} else {
+			last_task->nvcsw++;
 		}
+	}
 
-		if(last_task->sched_status != TASK_YIELD) {
-			last_task->sched_status = TASK_WAITING;
+	if(runnable) {
+		sched_queue_push(queue, last_task, false);
+	}
+
+	sched_queue_account_switch(queue, next_task, now);
+
+	queue->current = next_task;
+
+	clockevent_program(sched_queue_next_tick(queue, now));
+
+	if(next_task == NULL) {
+		sched_set_current(NULL);
+
+		if(last_task) {
+			queue->idle_cnt++;
 		}
 
-		if(last_task->sched_status != TASK_YIELD) {
-			last_task->sched_status = TASK_WAITING;
+		return sched_idle_frame(queue);
+	}
+
+	queue->switch_cnt++;
+
+	if(next_task->last_cpu != queue->cpu) {
+		if(next_task->last_cpu != -1) {
+			next_task->migrate_cnt++;
 		}
 
-		last_task->errno = CORE_LOCAL->errno;
-		last_task->regs = *regs;
-		last_task->user_fs_base = get_user_fs();
-		last_task->user_gs_base = get_user_gs();
-		last_task->user_stack.sp = CORE_LOCAL->user_stack;
+		next_task->last_cpu = queue->cpu;
 	}
 
-	CORE_LOCAL->pid = next_task->id.pid;
-	CORE_LOCAL->tid = next_task->id.tid;
-	CORE_LOCAL->nid = next_task->namespace->nid;
-	CORE_LOCAL->errno = next_task->errno;
+	next_task->on_cpu = true;
+	next_task->exec_start = now;
+
+	sched_task_rt_refill(next_task);
+
+	sched_set_current(next_task);
+	CORE_LOCAL_WRITE(nid, next_task->namespace->nid);
+	CORE_LOCAL_WRITE(errno, next_task->errno);
 
 	CORE_LOCAL->page_table = next_task->page_table;
 
@@ -121,90 +188,284 @@ void reschedule(struct registers *regs, void*) {
 	CORE_LOCAL->kernel_stack = next_task->kernel_stack.sp;
 	CORE_LOCAL->user_stack = next_task->user_stack.sp;
 
-	next_task->idle_cnt = 0;
-	next_task->idle_cnt = 0;
 	next_task->sched_status = TASK_RUNNING;
 
 	set_user_fs(next_task->user_fs_base);
-	set_user_gs(next_task->user_gs_base);
+	set_user_gs(next_task->user_gs_base); // swapped in by sched_resume, the callers still drop locks through gs
+
+	//print("rescheduling to %x:%x to %x:%x [stack] %x:%x rax %x\n", next_task->regs.cs, next_task->regs.rip, next_task->id.pid, next_task->id.tid, next_task->regs.ss, next_task->regs.rsp, next_task->regs.rax);
+
+	return &next_task->regs;
+}
+
+void reschedule(struct registers *regs, void*) {
+	struct sched_queue *queue = CORE_LOCAL->queue;
+
+	// kernel code holding a spinlock keeps the cpu, it reschedules once it drops the last one
+	bool atomic = !(regs->cs & 0x3) && CORE_LOCAL_READ(preempt_count);
+
+	timer_expire(clock_nanoseconds()); // the wake ups lock run queues, ours included
+
+	spinlock_irqsave(&queue->lock);
+
+	queue->tick_cnt++;
+	queue->load_sum += queue->length;
 
-	if(next_task->regs.cs & 0x3) {
-		swapgs();
+	uint64_t now = clock_nanoseconds();
+
+	if(atomic) {
+		preempt_request(queue->cpu, now);
+		queue->defer_cnt++;
+
+		clockevent_program(sched_queue_next_tick(queue, now));
+		spinrelease_irqsave(&queue->lock);
+		return;
 	}
 
-	//print("rescheduling to %x:%x to %x:%x [stack] %x:%x rax %x\n", next_task->regs.cs, next_task->regs.rip, next_task->id.pid, next_task->id.tid, next_task->regs.ss, next_task->regs.rsp, next_task->regs.rax);
+	preempt_account(queue, now);
+
+	struct task *last_task = queue->current;
+	if(sched_live(last_task)) {
+		last_task->regs = *regs;
+	}
+
+	bool runnable = sched_save(queue, last_task, now);
+
+	if(runnable) { // the tick found it still wanting the cpu
+		last_task->run_streak++;
+	}
+
+	struct task *next_task = sched_pick_next(queue, last_task, runnable);
+
+	if(next_task == NULL && runnable) {
+		last_task->sched_status = TASK_RUNNING;
+		clockevent_program(sched_queue_next_tick(queue, now));
+		signal_dispatch(last_task, regs);
+		spinrelease_irqsave(&queue->lock);
+		return;
+	}
+
+	bool *release = last_task && last_task != next_task ? &last_task->on_cpu : &sched_release_dummy;
+	struct registers *frame = sched_enter(queue, last_task, runnable, next_task, now);
 
 	xapic_write(XAPIC_EOI_OFF, 0);
-	spinrelease_irqsave(&sched_lock);
+	spinrelease_irqsave(&queue->lock);
 
-	asm volatile (
-		"mov %0, %%rsp\n\t"
-		"pop %%r15\n\t"
-		"pop %%r14\n\t"
-		"pop %%r13\n\t"
-		"pop %%r12\n\t"
-		"pop %%r11\n\t"
-		"pop %%r10\n\t"
-		"pop %%r9\n\t"
-		"pop %%r8\n\t"
-		"pop %%rsi\n\t"
-		"pop %%rdi\n\t"
-		"pop %%rbp\n\t"
-		"pop %%rdx\n\t"
-		"pop %%rcx\n\t"
-		"pop %%rbx\n\t"
-		"pop %%rax\n\t"
-		"addq $16, %%rsp\n\t"
-		"iretq\n\t"
-		:: "r" (&next_task->regs)
-	);
+	sched_resume(frame, release);
+}
+
+void schedule() {
+	bool interrupts = get_interrupt_state();
+	asm volatile ("cli");
+
+	// a task that sleeps inside a preempt section takes its count along, the cpu goes on from 0
+	int preempt_count = CORE_LOCAL_READ(preempt_count);
+	CORE_LOCAL_WRITE(preempt_count, 0);
+
+	struct sched_queue *queue = CORE_LOCAL->queue;
+
+	spinlock_irqsave(&queue->lock);
+
+	uint64_t now = clock_nanoseconds();
+
+	preempt_account(queue, now);
+
+	struct task *last_task = queue->current;
+	bool live = sched_live(last_task);
+	bool runnable = sched_save(queue, last_task, now);
+
+	struct task *next_task = sched_pick_next(queue, last_task, runnable);
+
+	if(next_task == NULL && runnable) {
+		last_task->sched_status = TASK_RUNNING;
+		clockevent_program(sched_queue_next_tick(queue, now));
+		spinrelease_irqsave(&queue->lock);
+
+		CORE_LOCAL_WRITE(preempt_count, preempt_count);
+
+		if(interrupts) {
+			asm volatile ("sti");
+		}
+
+		return;
+	}
+
+	bool *release = last_task && last_task != next_task ? &last_task->on_cpu : &sched_release_dummy;
+	struct registers *frame = sched_enter(queue, last_task, runnable, next_task, now);
+
+	spinrelease_irqsave(&queue->lock);
+
+	if(!live) { // nobody will ever resume the caller
+		sched_resume(frame, release);
+	}
+
+	// on_cpu keeps other cpus away from last_task until its frame is complete and we left its stack
+	sched_switch(&last_task->regs, frame, release);
+
+	CORE_LOCAL_WRITE(preempt_count, preempt_count); // possibly on another cpu by now
+
+	if(interrupts) {
+		asm volatile ("sti");
+	}
 }
 
 void sched_dequeue(struct task *task) {
-	spinlock_irqsave(&sched_lock);
+	if(task == NULL) {
+		return;
+	}
+
+	struct sched_queue *queue = sched_queue_lock(task);
 
-	if(task) {
+	if(task->sched_status != TASK_DEAD) {
 		task->sched_status = TASK_YIELD;
 	}
 
-	spinrelease_irqsave(&sched_lock);
+	sched_queue_remove(queue, task);
+	task->wait_start = 0;
+
+	sched_queue_unlock(queue);
+}
+
+// idle cpus do not tick, so one has to be woken up to pull work over from a busy queue
+static void sched_kick_idle(int except) {
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct sched_queue *queue = cpu_list.data[i]->queue;
+
+		if(queue->cpu != except && __atomic_load_n(&queue->current, __ATOMIC_RELAXED) == NULL) {
+			xapic_send_ipi(cpu_list.data[i]->apic_id, SCHED_VECTOR);
+			return;
+		}
+	}
 }
 
 void sched_requeue(struct task *task) {
-	spinlock_irqsave(&sched_lock);
+	sched_queue_place(task);
 
-	task->sched_status = TASK_WAITING;
-	task->idle_cnt = TASK_MAX_PRIORITY;
+	struct sched_queue *queue = sched_queue_lock(task);
+	bool kick = false;
+	bool balance = false;
 
-	spinrelease_irqsave(&sched_lock);
+	if(task->sched_status != TASK_DEAD) {
+		task->sched_status = TASK_WAITING;
+
+		if(queue->current != task && !task->queued) {
+			sched_queue_push(queue, task, true);
+
+			// get an idle cpu out of hlt, or preempt the current task if the sleeper is owed the cpu, real time
+			// tasks take it from anything less important right away
+			struct task *current = queue->current;
+
+			kick = current == NULL || sched_task_rt_preempts(task, current) || (!sched_task_rt(current) &&
+				!sched_task_rt(task) && task->vruntime + SCHED_WAKEUP_GRANULARITY < current->vruntime);
+
+			if(!kick && queue == CORE_LOCAL->queue) { // the tick may be a long one, cut it down to a slice
+				clockevent_program(sched_queue_next_tick(queue, clock_nanoseconds()));
+			} else if(!kick) {
+				kick = queue->length == 1 || sched_task_rt(task); // the remote tick has to account for it
+			}
+
+			balance = !kick;
+		}
+	}
+
+	int cpu = queue->cpu;
+
+	sched_queue_unlock(queue);
+
+	if(kick) { // the request is what a cpu polling in a long syscall notices
+		preempt_request(cpu, clock_nanoseconds());
+		xapic_send_ipi(cpu_list.data[cpu]->apic_id, SCHED_VECTOR);
+	} else if(balance) {
+		sched_kick_idle(cpu);
+	}
+}
+
+void sched_detach(struct task *task) {
+	struct sched_queue *queue = sched_queue_lock(task);
+
+	task->sched_status = TASK_DEAD;
+
+	sched_queue_remove(queue, task);
+	task->wait_start = 0;
+
+	sched_queue_unlock(queue);
+}
+
+void sched_block(struct task *task) {
+	struct sched_queue *queue = sched_queue_lock(task);
+
+	// the waker clears blocking before requeueing, both under this lock, so a wake up cannot slip in between
+	if(!task->blocking) {
+		sched_queue_unlock(queue);
+		return;
+	}
+
+	task->sched_status = TASK_YIELD;
+
+	sched_queue_unlock(queue);
+
+	schedule(); // returns once the task is woken and picked again
 }
 
 void sched_yield() {
-	asm volatile ("sti");
+	struct task *task = CURRENT_TASK;
 
-	xapic_write(XAPIC_ICR_OFF + 0x10, CORE_LOCAL->apic_id << 24);
-	xapic_write(XAPIC_ICR_OFF, 32);
+	if(task && sched_task_rt(task)) { // lets the next task of the same priority go first
+		task->rt_slice = 0;
+	}
 
-	for(;;) {
-		asm volatile ("hlt");
+	schedule();
+}
+
+// a task evicted by an affinity change was switched away still runnable, queue it on a cpu it may use
+static void sched_migrate_expire(struct timer *timer) {
+	struct task *task = timer->data;
+
+	struct sched_queue *queue = sched_queue_lock(task);
+	bool pending = task->sched_status == TASK_WAITING && !task->queued && queue->current != task;
+	sched_queue_unlock(queue);
+
+	if(pending) {
+		sched_requeue(task);
+	}
+}
+
+static void sched_affinity_init(struct task *task, struct task *parent) {
+	if(parent) {
+		task->cpu_mask = parent->cpu_mask;
+	} else {
+		cpu_mask_fill(&task->cpu_mask);
 	}
+
+	task->last_cpu = -1;
+	task->migrate_timer.function = sched_migrate_expire;
+	task->migrate_timer.data = task;
 }
 
-int sched_default_task(struct task *task, struct pid_namespace *namespace, int queue) {
+int sched_default_task(struct task *task, struct pid_namespace *namespace) {
 	spinlock_irqsave(&sched_lock);
 
 	task->namespace = namespace;
-	task->id.pid = bitmap_alloc(&namespace->pid_bitmap);
+	task->id.pid = idr_alloc_cyclic(&namespace->process_list, task);
 
 	task->fd_table = alloc(sizeof(struct fd_table));
 	fd_table_init(task->fd_table);
 
 	task->thread_group = sched_default_namespace();
-	task->id.tid = bitmap_alloc(&task->thread_group->pid_bitmap);
-	hash_table_push(&task->thread_group->process_list, &task->id.tid, task, sizeof(task->id.tid));
+	task->id.tid = idr_alloc_cyclic(&task->thread_group->process_list, task);
 
 	task->sched_status = TASK_YIELD;
 
+	task->nice = 0;
+	task->weight = sched_nice_weight(0);
+
+	task->policy = SCHED_OTHER;
+	task->rt_priority = 0;
+	task->normal_policy = SCHED_OTHER;
+	task->normal_rt_priority = 0;
+
+	sched_affinity_init(task, NULL);
+
 	task->waitq = alloc(sizeof(struct waitq));
 	task->status_trigger = waitq_alloc(task->waitq, EVENT_PROCESS_STATUS);
 
@@ -244,15 +505,7 @@ int sched_default_task(struct task *task, struct pid_namespace *namespace, int q
 	task->signal_kernel_stack.sp = pmm_alloc(DIV_ROUNDUP(THREAD_KERNEL_STACK_SIZE, PAGE_SIZE), 1) + THREAD_KERNEL_STACK_SIZE + HIGH_VMA;
 	task->signal_kernel_stack.size = THREAD_KERNEL_STACK_SIZE;
 
-	hash_table_push(&namespace->process_list, &task->id.pid, task, sizeof(task->id.pid));
-
 	task->id.nid = namespace->nid;
-	task->id.pid = task->id.pid;
-	task->id.tid = task->id.tid;
-
-	if(queue) {
-		VECTOR_PUSH(task_queue, task);
-	}
 
 	spinrelease_irqsave(&sched_lock);
 
@@ -328,15 +581,45 @@ int sched_default_task(struct task *task, struct pid_namespace *namespace, int q
 	return task;
 }*/
 
+// cpu -1 lets the task run anywhere, otherwise it is pinned to that cpu from the start
+struct task *sched_kernel_task_cpu(void (*entry)(void*), void *arg, int cpu) {
+	struct task *current_task = CURRENT_TASK;
+	if(current_task == NULL) {
+		return NULL;
+	}
+
+	struct task *task = alloc(sizeof(struct task));
+	sched_default_task(task, current_task->namespace);
+
+	task->regs.cs = 0x28;
+	task->regs.ss = 0x30;
+	task->regs.rip = (uintptr_t)entry;
+	task->regs.rdi = (uintptr_t)arg;
+	task->regs.rflags = 0x202;
+	task->regs.rsp = task->kernel_stack.sp;
+
+	task->session = current_task->session;
+	task->group = current_task->group;
+
+	if(cpu != -1) {
+		task->cpu_mask = (struct cpu_mask) { 0 };
+		task->cpu_mask.bits[cpu / 64] = 1ull << (cpu % 64);
+	}
+
+	sched_requeue(task);
+
+	return task;
+}
+
+struct task *sched_kernel_task(void (*entry)(void*), void *arg) {
+	return sched_kernel_task_cpu(entry, arg, -1);
+}
+
 struct pid_namespace *sched_default_namespace() {
 	struct pid_namespace *namespace = alloc(sizeof(struct pid_namespace));
 
 	namespace->nid = bitmap_alloc(&nid_bitmap);
-	namespace->pid_bitmap = (struct bitmap) {
-		.data = NULL,
-		.size = 0,
-		.resizable = true
-	};
+	namespace->process_list.limit = PID_MAX;
 
 	hash_table_push(&namespace_list, &namespace->nid, namespace, sizeof(namespace->nid));
 
@@ -355,8 +638,7 @@ int sched_task_init(struct task *task, char **envp, char **argv) {
 		panic("");
 	}
 
-	CORE_LOCAL->pid = task->id.pid;
-	CORE_LOCAL->tid = task->id.tid;
+	sched_set_current(task);
 
 	vmm_init_page_table(task->page_table);
 
@@ -376,10 +658,11 @@ int sched_task_init(struct task *task, char **envp, char **argv) {
 	) + THREAD_USER_STACK_SIZE;
 	task->user_stack.size = THREAD_USER_STACK_SIZE;
 
+	task->program.vdso_base = vdso_map(task->page_table);
+
 	int ret = program_place_parameters(&task->program, envp, argv);
 
-	CORE_LOCAL->pid = current_task->id.pid;
-	CORE_LOCAL->tid = current_task->id.tid;
+	sched_set_current(current_task);
 
 	vmm_init_page_table(current_task->page_table);
 
@@ -403,21 +686,19 @@ int sched_load_program(struct task *task, const char *path) {
 	task->program.task = task;
 
 	vmm_init_page_table(task->page_table);
-	CORE_LOCAL->tid = task->id.tid;
-	CORE_LOCAL->pid = task->id.pid;
+	sched_set_current(task);
 
 	int ret = program_load(&task->program, path);
-	if(ret == -1) {
-		spinrelease_irqsave(&sched_lock);
-		return -1;
-	}
 
 	vmm_init_page_table(current_task->page_table);
-	CORE_LOCAL->tid = current_task->id.tid;
-	CORE_LOCAL->pid = current_task->id.pid;
+	sched_set_current(current_task);
 
 	spinrelease_irqsave(&sched_lock);
 
+	if(ret == -1) {
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -487,7 +768,7 @@ void syscall_waitpid(struct registers *regs) {
 	int *status = (int*)regs->rsi;
 	int options = regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] waitpid: pid {%x}, status {%x}, options {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid, (uintptr_t)status, options);
 #endif
 
@@ -590,28 +871,38 @@ void task_terminate(struct task *task, int status) {
 
 	task->fd_table->refcnt--;
 	if(task->fd_table->refcnt == 0) {
-		for(size_t i = 0; i < task->fd_table->fd_bitmap.size; i++) {
-			if(BIT_TEST(task->fd_table->fd_bitmap.data, i)) {
-				fd_close(i);
-			}
+		for(size_t fd = 0; idr_next(&task->fd_table->fd_list, &fd); fd++) {
+			fd_close(fd);
 		}
 	}
 
+	// pid and tid lists change under sched_lock like in clone, idr_remove frees the layers it empties
 	if(task->id.tid == 0) {
-		for(size_t i = 0; i < task->thread_group->process_list.capacity; i++) {
-			struct task *thread = task->thread_group->process_list.data[i];
+		struct idr *thread_list = &task->thread_group->process_list;
+
+		for(size_t tid = 0;; tid++) {
+			spinlock_irqsave(&sched_lock);
+			struct task *thread = idr_next(thread_list, &tid);
+			spinrelease_irqsave(&sched_lock);
+
 			if(thread == NULL) {
-				continue;
+				break;
 			}
 
-			thread->sched_status = TASK_YIELD;
-			hash_table_delete(&task->thread_group->process_list, &thread->id.tid, sizeof(thread->id.tid));
-			VECTOR_REMOVE_BY_VALUE(task_queue, thread);
+			futex_exit(thread);
+			sched_detach(thread);
+
+			spinlock_irqsave(&sched_lock);
+			idr_remove(thread_list, tid);
+			spinrelease_irqsave(&sched_lock);
 		}
 	} else {
-		task->sched_status = TASK_YIELD;
-		hash_table_delete(&task->thread_group->process_list, &task->id.tid, sizeof(task->id.tid));
-		VECTOR_REMOVE_BY_VALUE(task_queue, task);
+		futex_exit(task);
+		sched_detach(task);
+
+		spinlock_irqsave(&sched_lock);
+		idr_remove(&task->thread_group->process_list, task->id.tid);
+		spinrelease_irqsave(&sched_lock);
 	}
 
 	struct page_table *page_table = task->page_table;
@@ -623,15 +914,21 @@ void task_terminate(struct task *task, int status) {
 
 			if(page) {
 				hash_table_delete(page_table->pages, &page->vaddr, sizeof(page->vaddr));
+				reclaim_page_release(page);
 
-				if((*page->reference) <= 1) { // shared page
+				if((page->flags & VMM_SHARE_FLAG) || (*page->reference) > 1) { // shared page
 					(*page->reference)--;
 					continue;
 				}
 
-				pmm_free(page->frame->addr, 1);
+				if(page->frame->addr) {
+					pmm_free(page->frame->addr, 1);
+				}
 			}
 		}
+
+		vmm_free_region_tree(page_table->mmap_region_root); // drops the references on mapped files
+		page_table->mmap_region_root = NULL;
 	}
 
 	signal_send_task(NULL, task, SIGCHLD);
@@ -662,14 +959,13 @@ void task_terminate(struct task *task, int status) {
 	task->status_trigger->agent_task->process_status = status;
 	waitq_wake(task->status_trigger);
 
-	task->sched_status = TASK_YIELD;
-
 	if(task->id.tid == 0) {
-		hash_table_delete(&task->namespace->process_list, &task->id.pid, sizeof(task->id.pid));
+		spinlock_irqsave(&sched_lock);
+		idr_remove(&task->namespace->process_list, task->id.pid);
+		spinrelease_irqsave(&sched_lock);
 	}
 
-	CORE_LOCAL->pid = -1;
-	CORE_LOCAL->tid = -1;
+	sched_set_current(NULL);
 
 	vmm_init_page_table(&kernel_mappings);
 
@@ -713,6 +1009,17 @@ struct task *clone(int flags, void *child_stack, pid_t *ptid, pid_t *ctid, void
 		return NULL;
 	}
 
+	// forked before any locks are taken, it can sleep on swap in and a failure has nothing else to undo
+	struct page_table *page_table = NULL;
+
+	if((flags & CLONE_VM) != CLONE_VM) {
+		page_table = vmm_fork_page_table(current_task->page_table);
+		if(page_table == NULL) {
+			free(task);
+			return NULL;
+		}
+	}
+
 	task_lock(current_task);
 	spinlock_irqsave(&sched_lock);
 
@@ -727,18 +1034,14 @@ struct task *clone(int flags, void *child_stack, pid_t *ptid, pid_t *ctid, void
 		task->fd_table = alloc(sizeof(struct fd_table));
 		fd_table_init(task->fd_table);
 
-		for(size_t i = 0; i < current_task->fd_table->fd_list.capacity; i++) {
-			struct fd_handle *handle = current_task->fd_table->fd_list.data[i];
-			if(handle) {
-				struct fd_handle *new_handle = alloc(sizeof(struct fd_handle));
-				*new_handle = *handle;
-				file_get(new_handle->file_handle);
-				hash_table_push(&task->fd_table->fd_list, &new_handle->fd_number, new_handle, sizeof(new_handle->fd_number));
-			}
+		struct fd_handle *handle;
+		for(size_t fd = 0; (handle = idr_next(&current_task->fd_table->fd_list, &fd)); fd++) {
+			struct fd_handle *new_handle = alloc(sizeof(struct fd_handle));
+			*new_handle = *handle;
+			file_get(new_handle->file_handle);
+			idr_insert(&task->fd_table->fd_list, fd, new_handle);
 		}
 
-		bitmap_dup(&current_task->fd_table->fd_bitmap, &task->fd_table->fd_bitmap);
-
 		spinrelease_irqsave(&current_task->fd_table->fd_lock);
 	}
 
@@ -782,22 +1085,21 @@ struct task *clone(int flags, void *child_stack, pid_t *ptid, pid_t *ctid, void
 		task->namespace = current_task->namespace;
 	}
 
+	// the pid keeps mapping to the group leader, threads are found through its thread group
 	if((flags & CLONE_THREAD) == CLONE_THREAD) {
 		task->thread_group = current_task->thread_group;
 		task->id.pid = current_task->id.pid;
 	} else {
 		task->thread_group = sched_default_namespace();
-		task->id.pid = bitmap_alloc(&task->namespace->pid_bitmap);
+		task->id.pid = idr_alloc_cyclic(&task->namespace->process_list, task);
 	}
 
-	task->id.tid = bitmap_alloc(&task->thread_group->pid_bitmap);
-	hash_table_push(&task->thread_group->process_list, &task->id.tid, task, sizeof(task->id.tid));
-
-	hash_table_push(&task->namespace->process_list, &task->id.pid, task, sizeof(task->id.pid));
-	VECTOR_PUSH(task_queue, task);
+	task->id.tid = idr_alloc_cyclic(&task->thread_group->process_list, task);
 
 	task->regs = *regs;
 
+	fpu_fork(current_task, task);
+
 	if((flags & CLONE_VM) == CLONE_VM) {
 		task->page_table = current_task->page_table;
 		task->regs.rsp = (uint64_t)child_stack;
@@ -807,13 +1109,12 @@ struct task *clone(int flags, void *child_stack, pid_t *ptid, pid_t *ctid, void
 			.size = THREAD_USER_STACK_SIZE
 		};
 	} else {
-		task->page_table = vmm_fork_page_table(current_task->page_table);
+		task->page_table = page_table;
 		task->user_stack = current_task->user_stack;
 	}
 
 	if((flags & CLONE_CHILD_SETTID) == CLONE_CHILD_SETTID && ctid != NULL) {
-		CORE_LOCAL->pid = task->id.pid;
-		CORE_LOCAL->tid = task->id.tid;
+		sched_set_current(task);
 
 		vmm_init_page_table(task->page_table);
 
@@ -821,13 +1122,11 @@ struct task *clone(int flags, void *child_stack, pid_t *ptid, pid_t *ctid, void
 
 		vmm_init_page_table(CORE_LOCAL->page_table);
 
-		CORE_LOCAL->pid = current_task->id.pid;
-		CORE_LOCAL->tid = current_task->id.tid;
+		sched_set_current(current_task);
 	}
 
 	if((flags & CLONE_PARENT_SETTID) == CLONE_PARENT_SETTID && ptid != NULL) {
-		CORE_LOCAL->pid = task->id.pid;
-		CORE_LOCAL->tid = task->id.tid;
+		sched_set_current(task);
 
 		vmm_init_page_table(task->page_table);
 
@@ -835,15 +1134,23 @@ struct task *clone(int flags, void *child_stack, pid_t *ptid, pid_t *ctid, void
 
 		vmm_init_page_table(CORE_LOCAL->page_table);
 
-		CORE_LOCAL->pid = current_task->id.pid;
-		CORE_LOCAL->tid = current_task->id.tid;
+		sched_set_current(current_task);
 	}
 
-	task->sched_status = TASK_WAITING;
-
 	task->group = current_task->group;
 	task->session = current_task->session;
 
+	task->nice = current_task->nice;
+	task->weight = current_task->weight;
+	task->vruntime = current_task->vruntime; // forking does not buy a fresh share of the cpu
+
+	task->policy = current_task->normal_policy; // a pi boost is not inherited
+	task->rt_priority = current_task->normal_rt_priority;
+	task->normal_policy = current_task->normal_policy;
+	task->normal_rt_priority = current_task->normal_rt_priority;
+
+	sched_affinity_init(task, current_task);
+
 	task->real_uid = current_task->real_uid;
 	task->effective_uid = current_task->effective_uid;
 	task->saved_uid = current_task->saved_uid;
@@ -867,11 +1174,13 @@ struct task *clone(int flags, void *child_stack, pid_t *ptid, pid_t *ctid, void
 	spinrelease_irqsave(&sched_lock);
 	task_unlock(current_task);
 
+	sched_requeue(task);
+
 	return task;
 }
 
 void syscall_exit(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] exit: status {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, regs->rdi);
 #endif
 	struct task *task = CURRENT_TASK;
@@ -917,7 +1226,7 @@ void syscall_execve(struct registers *regs) {
 		strcpy(argv[i], _argv[i]);
 	}
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: execve: path {%s}, argv {", path);
 
 	for(size_t i = 0; i < argv_cnt; i++) {
@@ -944,7 +1253,6 @@ void syscall_execve(struct registers *regs) {
 	struct task *parent = current_task->parent;
 	VECTOR_REMOVE_BY_VALUE(parent->children, current_task);
 	VECTOR_REMOVE_BY_VALUE(parent->group->process_list, current_task);
-	VECTOR_REMOVE_BY_VALUE(task_queue, current_task);
 
 	if(stat_has_access(vfs_node->stat, current_task->effective_uid,
 		current_task->effective_gid, X_OK) == -1) {
@@ -957,7 +1265,7 @@ void syscall_execve(struct registers *regs) {
 	bool is_sgid = vfs_node->stat->st_mode & S_ISGID ? true : false;
 
 	struct task *task = alloc(sizeof(struct task));
-	sched_default_task(task, current_task->namespace, 0);
+	sched_default_task(task, current_task->namespace);
 
 	int ret = sched_load_program(task, path);
 	if(ret == -1) {
@@ -974,21 +1282,19 @@ void syscall_execve(struct registers *regs) {
 	waitq_trigger_calibrate(task->status_trigger, task, EVENT_PROCESS_STATUS);
 	waitq_add(current_task->waitq, task->status_trigger);
 
-	bitmap_dup(&current_task->fd_table->fd_bitmap, &task->fd_table->fd_bitmap);
-	for(size_t i = 0; i < task->fd_table->fd_bitmap.size; i++) {
-		if(BIT_TEST(task->fd_table->fd_bitmap.data, i)) {
-			struct fd_handle *handle = fd_translate(i);
-			if(handle->flags & O_CLOEXEC) {
-				fd_close(i);
-				continue;
-			}
-
-			hash_table_push(&task->fd_table->fd_list, &handle->fd_number, handle, sizeof(handle->fd_number));
+	struct fd_handle *handle;
+	for(size_t fd = 0; (handle = idr_next(&current_task->fd_table->fd_list, &fd)); fd++) {
+		if(handle->flags & O_CLOEXEC) {
+			fd_close(fd);
+			continue;
 		}
+
+		idr_insert(&task->fd_table->fd_list, fd, handle);
 	}
 
-	hash_table_delete(&task->namespace->process_list, &current_task->id.pid, sizeof(current_task->id.pid));
-	hash_table_delete(&task->namespace->process_list, &task->id.pid, sizeof(task->id.pid));
+	spinlock_irqsave(&sched_lock);
+	idr_remove(&task->namespace->process_list, task->id.pid); // the new image takes over the old pid
+	spinrelease_irqsave(&sched_lock);
 
 	task->cwd = current_task->cwd;
 	task->id.pid = current_task->id.pid;
@@ -1009,6 +1315,17 @@ void syscall_execve(struct registers *regs) {
 	task->umask = current_task->umask;
 	task->has_execved = 1;
 
+	task->nice = current_task->nice;
+	task->weight = current_task->weight;
+	task->vruntime = current_task->vruntime;
+
+	task->policy = current_task->normal_policy; // a pi boost is not inherited
+	task->rt_priority = current_task->normal_rt_priority;
+	task->normal_policy = current_task->normal_policy;
+	task->normal_rt_priority = current_task->normal_rt_priority;
+
+	sched_affinity_init(task, current_task);
+
 	for(size_t i = 0; i < SIGNAL_MAX; i++) {
 		struct sigaction *task_act = &task->sigactions[i];
 		struct sigaction *current_act = &current_task->sigactions[i];
@@ -1027,13 +1344,15 @@ void syscall_execve(struct registers *regs) {
 	VECTOR_PUSH(parent->children, task);
 	VECTOR_PUSH(task->group->process_list, task);
 
-	CORE_LOCAL->pid = -1;
-	CORE_LOCAL->tid = -1;
+	sched_detach(current_task);
 
-	hash_table_push(&task->namespace->process_list, &task->id.pid, task, sizeof(task->id.pid));
-	VECTOR_PUSH(task_queue, task);
+	sched_set_current(NULL);
 
-	task->sched_status = TASK_WAITING;
+	spinlock_irqsave(&sched_lock);
+	idr_replace(&task->namespace->process_list, task->id.pid, task);
+	spinrelease_irqsave(&sched_lock);
+
+	sched_requeue(task);
 
 	sched_yield();
 }
@@ -1054,7 +1373,7 @@ void syscall_clone(struct registers *regs) {
 	pid_t *ctid = (void*)clone_args->child_tid;
 	void *tls = (void*)clone_args->tls;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] clone: stack {%x}, flags {%x}, ptid {%x}, tls {%x}, ctid {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, stack, flags, ptid, tls, ctid);
 #endif
 
@@ -1074,7 +1393,7 @@ void syscall_clone(struct registers *regs) {
 }
 
 void syscall_fork(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] fork\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	
@@ -1089,49 +1408,49 @@ void syscall_fork(struct registers *regs) {
 }
 
 void syscall_getpid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getpid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	regs->rax = CORE_LOCAL->pid;
 }
 
 void syscall_getppid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getppid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	regs->rax = CURRENT_TASK->parent->id.pid;
 }
 
 void syscall_gettid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] gettid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	regs->rax = CORE_LOCAL->tid;
 }
 
 void syscall_getuid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getuid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	regs->rax = CURRENT_TASK->real_uid;
 }
 
 void syscall_geteuid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] geteuid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	regs->rax = CURRENT_TASK->effective_uid;
 }
 
 void syscall_getgid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getgid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	regs->rax = CURRENT_TASK->real_gid;
 }
 
 void syscall_getegid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getegid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	regs->rax = CURRENT_TASK->effective_gid;
@@ -1141,7 +1460,7 @@ void syscall_setuid(struct registers *regs) {
 	uid_t uid = regs->rdi;
 	struct task *current_task = CURRENT_TASK;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] setuid: uid {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, uid);
 #endif
 
@@ -1167,7 +1486,7 @@ void syscall_seteuid(struct registers *regs) {
 	uid_t euid = regs->rdi;
 	struct task *current_task = CURRENT_TASK;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] seteuid: euid {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, euid);
 #endif
 
@@ -1185,7 +1504,7 @@ void syscall_setgid(struct registers *regs) {
 	gid_t gid = regs->rdi;
 	struct task *current_task = CURRENT_TASK;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] setgid: gid {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, gid);
 #endif
 
@@ -1211,7 +1530,7 @@ void syscall_setegid(struct registers *regs) {
 	uid_t egid = regs->rdi;
 	struct task *current_task = CURRENT_TASK;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] setegid: egid {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, egid);
 #endif
 
@@ -1229,7 +1548,7 @@ void syscall_setpgid(struct registers *regs) {
 	pid_t pid = regs->rdi == 0 ? CORE_LOCAL->pid : regs->rdi;
 	pid_t pgid = regs->rsi == 0 ? CORE_LOCAL->pid : regs->rsi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] setpgid: pid {%x}, pgid {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid, pgid);
 #endif
 
@@ -1246,7 +1565,7 @@ void syscall_setpgid(struct registers *regs) {
 void syscall_getpgid(struct registers *regs) {
 	pid_t pid = regs->rdi == 0 ? CORE_LOCAL->pid : regs->rdi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getpgid: pid {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid);
 #endif
 
@@ -1267,7 +1586,7 @@ void syscall_getpgid(struct registers *regs) {
 }
 
 void syscall_setsid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] setsid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 
@@ -1280,9 +1599,437 @@ void syscall_setsid(struct registers *regs) {
 }
 
 void syscall_getsid(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] getsid\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 
 	regs->rax = CURRENT_TASK->session->sid;
 }
+
+// whether the caller may change the scheduling parameters of task
+static bool task_sched_permitted(struct task *task) {
+	struct task *current_task = CURRENT_TASK;
+
+	return current_task->effective_uid == 0 || current_task->effective_uid == task->real_uid ||
+		current_task->effective_uid == task->effective_uid;
+}
+
+static int task_set_nice(struct task *task, int nice) {
+	struct task *current_task = CURRENT_TASK;
+
+	if(!task_sched_permitted(task)) {
+		set_errno(EPERM);
+		return -1;
+	}
+
+	if(nice < SCHED_NICE_MIN) nice = SCHED_NICE_MIN;
+	if(nice > SCHED_NICE_MAX) nice = SCHED_NICE_MAX;
+
+	if(nice < task->nice && current_task->effective_uid != 0) {
+		set_errno(EACCES);
+		return -1;
+	}
+
+	struct task *thread;
+	for(size_t tid = 0; (thread = idr_next(&task->thread_group->process_list, &tid)); tid++) {
+		struct sched_queue *queue = sched_queue_lock(thread);
+
+		thread->nice = nice;
+		thread->weight = sched_nice_weight(nice);
+
+		sched_queue_unlock(queue);
+	}
+
+	return 0;
+}
+
+static int priority_for_each(int which, int who, int (*action)(struct task*, void*), void *arg) {
+	struct task *current_task = CURRENT_TASK;
+	int found = 0, ret = 0;
+
+	if(which == PRIO_PROCESS) {
+		struct task *task = sched_translate_pid(CORE_LOCAL->nid, who == 0 ? CORE_LOCAL->pid : who, 0);
+		if(task == NULL) {
+			set_errno(ESRCH);
+			return -1;
+		}
+
+		return action(task, arg);
+	}
+
+	if(which == PRIO_PGRP) {
+		struct process_group *group = current_task->group;
+
+		if(who != 0) {
+			group = hash_table_search(&current_task->session->group_list, &who, sizeof(who));
+			if(group == NULL) {
+				set_errno(ESRCH);
+				return -1;
+			}
+		}
+
+		for(size_t i = 0; i < group->process_list.length; i++, found++) {
+			if(action(group->process_list.data[i], arg) == -1) {
+				ret = -1;
+			}
+		}
+	} else if(which == PRIO_USER) {
+		uid_t uid = who == 0 ? current_task->real_uid : who;
+		struct task *task;
+
+		for(size_t pid = 0; (task = idr_next(&current_task->namespace->process_list, &pid)); pid++) {
+			if(task->real_uid != uid) {
+				continue;
+			}
+
+			found++;
+
+			if(action(task, arg) == -1) {
+				ret = -1;
+			}
+		}
+	} else {
+		set_errno(EINVAL);
+		return -1;
+	}
+
+	if(found == 0) {
+		set_errno(ESRCH);
+		return -1;
+	}
+
+	return ret;
+}
+
+static int priority_set(struct task *task, void *arg) {
+	return task_set_nice(task, *(int*)arg);
+}
+
+static int priority_get(struct task *task, void *arg) {
+	int *nice = arg;
+
+	if(task->nice < *nice) {
+		*nice = task->nice;
+	}
+
+	return 0;
+}
+
+void syscall_setpriority(struct registers *regs) {
+	int which = regs->rdi;
+	int who = regs->rsi;
+	int prio = regs->rdx;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] setpriority: which {%x}, who {%x}, prio {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, which, who, prio);
+#endif
+
+	regs->rax = priority_for_each(which, who, priority_set, &prio);
+}
+
+void syscall_getpriority(struct registers *regs) {
+	int which = regs->rdi;
+	int who = regs->rsi;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] getpriority: which {%x}, who {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, which, who);
+#endif
+
+	int nice = SCHED_NICE_MAX + 1;
+
+	if(priority_for_each(which, who, priority_get, &nice) == -1) {
+		regs->rax = -1;
+		return;
+	}
+
+	regs->rax = 20 - nice; // biased like linux so a valid result is never -1
+}
+
+void syscall_nice(struct registers *regs) {
+	int inc = regs->rdi;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] nice: inc {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, inc);
+#endif
+
+	struct task *current_task = CURRENT_TASK;
+
+	regs->rax = task_set_nice(current_task, current_task->nice + inc);
+}
+
+// drops the cpus that are not online, false when none is left
+static bool cpu_mask_online(struct cpu_mask *mask) {
+	bool empty = true;
+
+	for(size_t i = 0; i < SCHED_CPU_MAX / 64; i++) {
+		size_t online = cpu_list.length > i * 64 ? cpu_list.length - i * 64 : 0;
+
+		if(online < 64) {
+			mask->bits[i] &= (1ull << online) - 1;
+		}
+
+		empty = empty && mask->bits[i] == 0;
+	}
+
+	return !empty;
+}
+
+static void task_set_affinity(struct task *task, struct cpu_mask *mask) {
+	struct sched_queue *queue = sched_queue_lock(task);
+
+	task->cpu_mask = *mask;
+
+	bool running = queue->current == task;
+	int cpu = queue->cpu;
+
+	sched_queue_unlock(queue);
+
+	sched_queue_place(task); // a queued task moves right away, a sleeping one on its next wake up
+
+	if(!running || sched_task_allowed(task, cpu)) {
+		return;
+	}
+
+	if(task == CURRENT_TASK) {
+		schedule();
+	} else { // its cpu evicts it on the tick this forces
+		xapic_send_ipi(cpu_list.data[cpu]->apic_id, SCHED_VECTOR);
+	}
+}
+
+void syscall_sched_setaffinity(struct registers *regs) {
+	pid_t pid = regs->rdi;
+	size_t size = regs->rsi;
+	const uint8_t *user_mask = (void*)regs->rdx;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] sched_setaffinity: pid {%x}, size {%x}, mask {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid, size, user_mask);
+#endif
+
+	struct task *task = pid == 0 ? CURRENT_TASK : sched_translate_pid(CORE_LOCAL->nid, pid, 0);
+	if(task == NULL) {
+		set_errno(ESRCH);
+		regs->rax = -1;
+		return;
+	}
+
+	if(!task_sched_permitted(task)) {
+		set_errno(EPERM);
+		regs->rax = -1;
+		return;
+	}
+
+	struct cpu_mask mask = { 0 };
+	memcpy(&mask, user_mask, size < sizeof(mask) ? size : sizeof(mask));
+
+	if(!cpu_mask_online(&mask)) {
+		set_errno(EINVAL);
+		regs->rax = -1;
+		return;
+	}
+
+	if(pid == 0) {
+		task_set_affinity(task, &mask);
+		regs->rax = 0;
+		return;
+	}
+
+	struct task *thread;
+	for(size_t tid = 0; (thread = idr_next(&task->thread_group->process_list, &tid)); tid++) {
+		task_set_affinity(thread, &mask);
+	}
+
+	regs->rax = 0;
+}
+
+void syscall_sched_getaffinity(struct registers *regs) {
+	pid_t pid = regs->rdi;
+	size_t size = regs->rsi;
+	uint8_t *user_mask = (void*)regs->rdx;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] sched_getaffinity: pid {%x}, size {%x}, mask {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid, size, user_mask);
+#endif
+
+	struct task *task = pid == 0 ? CURRENT_TASK : sched_translate_pid(CORE_LOCAL->nid, pid, 0);
+	if(task == NULL) {
+		set_errno(ESRCH);
+		regs->rax = -1;
+		return;
+	}
+
+	if(size < DIV_ROUNDUP(cpu_list.length, 64) * 8 || size % 8) { // has to hold every online cpu
+		set_errno(EINVAL);
+		regs->rax = -1;
+		return;
+	}
+
+	if(size > sizeof(struct cpu_mask)) {
+		size = sizeof(struct cpu_mask);
+	}
+
+	struct cpu_mask mask = task->cpu_mask;
+	cpu_mask_online(&mask);
+
+	memcpy(user_mask, &mask, size);
+
+	regs->rax = size;
+}
+
+// requeues the task at the class and priority it runs at now, true when the task is the current one and has to
+// reschedule once the caller holds no locks
+bool sched_task_set_prio(struct task *task, int policy, int priority) {
+	struct sched_queue *queue = sched_queue_lock(task);
+	bool queued = task->queued;
+
+	sched_queue_remove(queue, task);
+
+	if(sched_task_rt(task) && policy == SCHED_OTHER) { // the time it ran as real time is not held against it
+		task->vruntime = queue->min_vruntime;
+	}
+
+	task->policy = policy;
+	task->rt_priority = priority;
+	task->rt_slice = 0;
+
+	if(queued) {
+		sched_queue_push(queue, task, false);
+	}
+
+	bool resched = queued || queue->current == task;
+	int cpu = queue->cpu;
+
+	sched_queue_unlock(queue);
+
+	if(!resched) {
+		return false;
+	}
+
+	if(task == CURRENT_TASK) {
+		return true;
+	}
+
+	xapic_send_ipi(cpu_list.data[cpu]->apic_id, SCHED_VECTOR);
+
+	return false;
+}
+
+// a boost from a pi futex the task holds outlives the change
+static void task_set_scheduler(struct task *task, int policy, int priority) {
+	if(futex_pi_setscheduler(task, policy, priority)) {
+		schedule();
+	}
+}
+
+void syscall_sched_setscheduler(struct registers *regs) {
+	pid_t pid = regs->rdi;
+	int policy = regs->rsi;
+	struct sched_param *param = (void*)regs->rdx;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] sched_setscheduler: pid {%x}, policy {%x}, param {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid, policy, param);
+#endif
+
+	if(param == NULL || (policy != SCHED_OTHER && policy != SCHED_FIFO && policy != SCHED_RR)) {
+		set_errno(EINVAL);
+		regs->rax = -1;
+		return;
+	}
+
+	int priority = param->sched_priority;
+
+	if(policy == SCHED_OTHER ? priority != 0 : priority < SCHED_RT_PRIO_MIN || priority > SCHED_RT_PRIO_MAX) {
+		set_errno(EINVAL);
+		regs->rax = -1;
+		return;
+	}
+
+	struct task *task = pid == 0 ? CURRENT_TASK : sched_translate_pid(CORE_LOCAL->nid, pid, 0);
+	if(task == NULL) {
+		set_errno(ESRCH);
+		regs->rax = -1;
+		return;
+	}
+
+	if(!task_sched_permitted(task) || (policy != SCHED_OTHER && CURRENT_TASK->effective_uid != 0)) {
+		set_errno(EPERM);
+		regs->rax = -1;
+		return;
+	}
+
+	if(pid == 0) {
+		task_set_scheduler(task, policy, priority);
+		regs->rax = 0;
+		return;
+	}
+
+	struct task *thread;
+	for(size_t tid = 0; (thread = idr_next(&task->thread_group->process_list, &tid)); tid++) {
+		task_set_scheduler(thread, policy, priority);
+	}
+
+	regs->rax = 0;
+}
+
+void syscall_sched_getscheduler(struct registers *regs) {
+	pid_t pid = regs->rdi;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] sched_getscheduler: pid {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid);
+#endif
+
+	struct task *task = pid == 0 ? CURRENT_TASK : sched_translate_pid(CORE_LOCAL->nid, pid, 0);
+	if(task == NULL) {
+		set_errno(ESRCH);
+		regs->rax = -1;
+		return;
+	}
+
+	regs->rax = task->normal_policy;
+}
+
+void syscall_sched_getparam(struct registers *regs) {
+	pid_t pid = regs->rdi;
+	struct sched_param *param = (void*)regs->rsi;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] sched_getparam: pid {%x}, param {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid, param);
+#endif
+
+	struct task *task = pid == 0 ? CURRENT_TASK : sched_translate_pid(CORE_LOCAL->nid, pid, 0);
+	if(task == NULL) {
+		set_errno(ESRCH);
+		regs->rax = -1;
+		return;
+	}
+
+	if(param == NULL) {
+		set_errno(EINVAL);
+		regs->rax = -1;
+		return;
+	}
+
+	param->sched_priority = task->normal_rt_priority;
+
+	regs->rax = 0;
+}
+
+void syscall_sched_rr_get_interval(struct registers *regs) {
+	pid_t pid = regs->rdi;
+	struct timespec *interval = (void*)regs->rsi;
+
+#ifdef SYSCALL_DEBUG
+	print("syscall: [pid %x, tid %x] sched_rr_get_interval: pid {%x}, interval {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid, interval);
+#endif
+
+	struct task *task = pid == 0 ? CURRENT_TASK : sched_translate_pid(CORE_LOCAL->nid, pid, 0);
+	if(task == NULL) {
+		set_errno(ESRCH);
+		regs->rax = -1;
+		return;
+	}
+
+	*interval = timespec_from_nanoseconds(task->policy == SCHED_RR ? sched_rr_quantum : 0); // fifo never runs out
+
+	regs->rax = 0;
+}
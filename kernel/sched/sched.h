@@ -7,22 +7,26 @@
 #include <cpu.h>
 #include <bitmap.h>
 #include <hash.h>
+#include <idr.h>
 #include <elf.h>
 #include <sched/signal.h>
 #include <drivers/tty/tty.h>
 #include <sched/signal.h>
 #include <sched/program.h>
 #include <sched/futex.h>
+#include <sched/runqueue.h>
 #include <lock.h>
 
 struct task;
 struct process_group;
+struct sysprof_task;
 struct session;
 
+#define PID_MAX 0x8000 // pids and tids are handed out cyclically below it
+
 struct pid_namespace {
 	nid_t nid;
-	struct hash_table process_list;
-	struct bitmap pid_bitmap;
+	struct idr process_list; // pid to task, or tid to thread for a thread group
 };
 
 struct task_id {
@@ -43,8 +47,47 @@ struct task {
 
 	int has_execved;
 
-	size_t idle_cnt;
 	int sched_status;
+
+	struct sched_queue *queue;
+	struct priority_heap_node run_node;
+	bool queued;
+	bool on_cpu;
+
+	int nice;
+	uint64_t weight;
+	uint64_t vruntime;
+	uint64_t exec_start;
+	uint64_t exec_runtime;
+	int run_streak; // ticks in a row the task was still runnable at, reset when it sleeps
+
+	uint64_t wait_start; // when the task last became runnable without running, 0 while it runs or sleeps
+	uint64_t wait_time; // ns spent runnable on a queue
+	bool wakeup_pending; // the wait started with a wake up, its end goes into the latency histogram
+	size_t wakeup_cnt;
+	size_t nvcsw; // switched away because it blocked or yielded
+	size_t nivcsw; // preempted while still runnable
+
+	struct cpu_mask cpu_mask;
+	int last_cpu; // where the cache is warm, -1 before the first run
+	size_t migrate_cnt;
+	struct timer migrate_timer; // requeues the task once it is off a cpu it may no longer use
+
+	int policy;
+	int rt_priority; // 0 for fair tasks
+	uint64_t rt_slice; // ns left of the round robin quantum, 0 once it ran out or the task yielded
+	struct task *rt_next;
+	struct task *rt_prev;
+
+	int normal_policy; // what sched_setscheduler asked for, policy and rt_priority may be boosted above it
+	int normal_rt_priority;
+	struct futex_pi_state *pi_owned; // contended pi futexes the task holds
+	struct futex_pi_state *pi_blocked_on;
+	struct futex_waiter *futex_waiter; // set while the task sleeps on a futex
+	size_t futex_waiter_cnt; // more than one for futex_waitv
+
+	struct sysprof_task *sysprof; // syscall counts of the whole process, only set on the thread group leader
+
 	int process_status;
 
 	size_t user_gs_base;
@@ -70,6 +113,11 @@ struct task {
 	struct registers regs;
 	struct ucontext signal_context;
 
+	void *fpu_area; // xsave area, allocated on the first fpu use
+	void *fpu_signal_area; // interrupted state while a signal handler runs
+	bool fpu_valid; // false until the task used the fpu, it then starts from the initial state
+	bool fpu_signal_valid;
+
 	struct fd_table *fd_table;
 	struct vfs_node **cwd;
 
@@ -85,7 +133,6 @@ struct task {
 
 	struct spinlock sig_lock;
 	struct sigaction *sigactions;
-	bool dispatch_ready;
 
 	VECTOR(struct task*) children;
 	VECTOR(struct task*) zombies;
@@ -129,14 +176,20 @@ struct sched_arguments {
 
 struct pid_namespace *sched_default_namespace();
 struct task *sched_translate_pid(nid_t nid, pid_t pid, tid_t tid);
-int sched_default_task(struct task *task, struct pid_namespace *namespace, int queue);
+int sched_default_task(struct task *task, struct pid_namespace *namespace);
+struct task *sched_kernel_task(void (*entry)(void*), void *arg);
+struct task *sched_kernel_task_cpu(void (*entry)(void*), void *arg, int cpu);
 int sched_task_init(struct task *task, char **envp, char **argv);
 int sched_load_program(struct task *task, const char *path);
 
 void reschedule(struct registers *regs, void *ptr);
 void sched_dequeue(struct task *task);
 void sched_requeue(struct task *task);
+bool sched_task_set_prio(struct task *task, int policy, int priority);
+void sched_detach(struct task *task);
+void sched_block(struct task *task);
 void sched_yield();
+void schedule();
 void task_terminate(struct task *task, int status);
 void task_stop(struct task *task, int sig);
 void task_continue(struct task *task);
@@ -145,11 +198,7 @@ int task_create_session(struct task *task, bool force);
 extern struct spinlock sched_lock;
 
 #define CURRENT_TASK ({ \
-	struct task *ret = NULL; \
-	if(CORE_LOCAL) { \
-		ret = sched_translate_pid(CORE_LOCAL->nid, CORE_LOCAL->pid, CORE_LOCAL->tid); \
-	} \
-	ret; \
+	CORE_LOCAL_READ(current); \
 })
 
 #define SIGPENDING ({ \
@@ -159,13 +208,17 @@ extern struct spinlock sched_lock;
 #define TASK_RUNNING 0
 #define TASK_WAITING 1
 #define TASK_YIELD 2
+#define TASK_DEAD 3
+
+#define SCHED_VECTOR 32
+
+#define PRIO_PROCESS 0
+#define PRIO_PGRP 1
+#define PRIO_USER 2
 
 #define THREAD_KERNEL_STACK_SIZE 0x4000
 #define THREAD_USER_STACK_SIZE 0x100000
 
-#define TASK_MAX_PRIORITY ~(0ull)
-#define TASK_MIN_PRIORITY ~(0)
-
 static inline void session_lock(struct session *session) {
 	spinlock_irqsave(&session->lock);
 }
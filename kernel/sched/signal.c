@@ -2,6 +2,7 @@
 #include <sched/sched.h>
 #include <mm/mmap.h>
 #include <mm/pmm.h>
+#include <sched/fpu.h>
 #include <debug.h>
 #include <errno.h>
 
@@ -160,12 +161,11 @@ int signal_send_task(struct task *sender, struct task *target, int sig) {
 	signal->queue = signal_queue;
 	signal_queue->sigpending |= SIGMASK(sig);
 
-	target->dispatch_ready = true;
-	target->dispatch_ready = true;
-
 	spinrelease_irqsave(&queue->siglock);
 	spinrelease_irqsave(&target->sig_lock);
 
+	sched_requeue(target); // make sure a blocked target gets to run its handler
+
 	return 0;
 }
 
@@ -249,7 +249,7 @@ int signal_dispatch(struct task *task, struct registers *state) {
 
 			task->signal_queue.sigpending &= ~SIGMASK(i);
 
-			print("dispatching signal %d with action %x\n", i, action->handler.sa_sigaction);
+			klog_ratelimited(KLOG_DEBUG, "dispatching signal %d with action %x\n", i, action->handler.sa_sigaction);
 
 			if(action->handler.sa_sigaction == SIG_ERR) {
 				spinrelease_irqsave(&CURRENT_TASK->sig_lock);
@@ -316,6 +316,8 @@ int signal_dispatch(struct task *task, struct registers *state) {
 			context.registers = *state;
 			context.signum = signal->signum;
 
+			fpu_signal_enter(task);
+
 			memset8((void*)state, 0, sizeof(*state));
 
 			stack.sp -= 128;
@@ -390,6 +392,10 @@ int signal_wait(struct signal_queue *signal_queue, sigset_t mask, struct timespe
 	int ret = waitq_wait(&signal_queue->waitq, EVENT_SIGNAL);
 	waitq_release(&signal_queue->waitq, EVENT_SIGNAL);
 
+	if(timespec) {
+		waitq_clear_timer(&signal_queue->waitq);
+	}
+
 	if(ret == -1) {
 		return -1;
 	}
@@ -478,9 +484,6 @@ static void sigreturn_default(int release_block) {
 		task->signal_release_block = true;
 	}
 
-	task->dispatch_ready = false;
-	task->dispatch_ready = false;
-
 	CORE_LOCAL->user_stack = task->user_stack.sp;
 	CORE_LOCAL->kernel_stack = task->kernel_stack.sp;
 
@@ -512,7 +515,7 @@ static void sigreturn_default(int release_block) {
 }
 
 void syscall_sigreturn(struct registers*) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] sigreturn\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 	asm volatile ("cli");
@@ -534,12 +537,11 @@ void syscall_sigreturn(struct registers*) {
 	task->regs = *context;
 	munmap(task->page_table, (void*)(stack->sp - stack->size), stack->size);
 
+	fpu_signal_leave(task);
+
 	task->blocking = false;
 	task->signal_release_block = true;
 
-	task->dispatch_ready = false;
-	task->dispatch_ready = false;
-
 	struct stack tmp = task->kernel_stack;
 	task->kernel_stack = task->signal_kernel_stack;
 	task->signal_kernel_stack = tmp;
@@ -614,7 +616,7 @@ void syscall_sigaction(struct registers *regs) {
 	const struct sigaction *act = (void*)regs->rsi;
 	struct sigaction *old = (void*)regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] sigaction: signum {%x}, act {%x}, old {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, sig, act, old);
 #endif
 
@@ -624,7 +626,7 @@ void syscall_sigaction(struct registers *regs) {
 void syscall_sigpending(struct registers *regs) {
 	sigset_t *set = (void*)regs->rdi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] sigpending: set {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, set);
 #endif
 
@@ -636,7 +638,7 @@ void syscall_sigprocmask(struct registers *regs) {
 	const sigset_t *set = (void*)regs->rsi;
 	sigset_t *oldset = (void*)regs->rdx;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] sigprocmask: how {%x}, set {%x}, oldset {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, how, set, oldset);
 #endif
 
@@ -647,7 +649,7 @@ void syscall_kill(struct registers *regs) {
 	pid_t pid = regs->rdi;
 	int sig = regs->rsi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] kill: pid {%x}, sig {%x}\n", CORE_LOCAL->pid, CORE_LOCAL->tid, pid, sig);
 #endif
 
@@ -655,7 +657,7 @@ void syscall_kill(struct registers *regs) {
 }
 
 void syscall_pause(struct registers *regs) {
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] pause\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 
@@ -675,7 +677,7 @@ void syscall_pause(struct registers *regs) {
 void syscall_sigsuspend(struct registers *regs) {
 	sigset_t *mask = (void*)regs->rdi;
 
-#ifndef SYSCALL_DEBUG
+#ifdef SYSCALL_DEBUG
 	print("syscall: [pid %x, tid %x] pause\n", CORE_LOCAL->pid, CORE_LOCAL->tid);
 #endif
 
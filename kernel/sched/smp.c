@@ -9,25 +9,31 @@
 #include <cpu.h>
 #include <debug.h>
 #include <lock.h>
+#include <sched/runqueue.h>
+#include <int/clockevent.h>
+#include <sched/ehfi.h>
+#include <time.h>
 
-static struct spinlock core_init_lock;
+static char core_init_lock; // taken by the bsp and released by the ap it boots, so it is not a preempt section
 
 size_t logical_processor_cnt;
+typeof(cpu_list) cpu_list;
 
 static void core_bootstrap(struct cpu_local *cpu_local) {
 	init_cpu_features();
 	gdt_init();
 
-	print("initalising core: apic_id %x\n", xapic_read(XAPIC_ID_REG_OFF) >> 24);
+	wrmsr(MSR_GS_BASE, (uintptr_t)cpu_local); // before the first lock, that counts on this cpu's preempt_count
 
-	spinrelease_irqsave(&core_init_lock);
+	print("initalising core: apic_id %x\n", xapic_read(XAPIC_ID_REG_OFF) >> 24);
 
-	wrmsr(MSR_GS_BASE, (uintptr_t)cpu_local);
+	raw_spinrelease(&core_init_lock);
 
 	xapic_write(XAPIC_TPR_OFF, 0);
 	xapic_write(XAPIC_SINT_OFF, xapic_read(XAPIC_SINT_OFF) | 0x1ff);
 
-	apic_timer_init(20);
+	clockevent_init();
+	ehfi_cpu_init();
 
 	asm volatile ("mov %0, %%cr8\nsti" :: "r"(0ull));
 
@@ -69,15 +75,21 @@ void boot_aps() {
 			.apic_id = madt0->apic_id,
 			.pid = -1,
 			.tid = -1,
-			.page_table = &kernel_mappings
+			.page_table = &kernel_mappings,
+			.self = cpu_local
 		};
 
+		sched_queue_init(cpu_local, cpu_list.length);
+		timer_base_init(cpu_local, cpu_list.length);
+
+		VECTOR_PUSH(cpu_list, cpu_local);
+
 		if(cpu_local->apic_id == (xapic_read(XAPIC_ID_REG_OFF) >> 24)) {
 			wrmsr(MSR_GS_BASE, (uintptr_t)cpu_local);
 			continue;
 		}
 
-		spinlock_irqsave(&core_init_lock);
+		raw_spinlock(&core_init_lock);
 
 		uint64_t *parameters = (uint64_t*)0x81000;
 
@@ -102,7 +114,7 @@ void boot_aps() {
 		xapic_write(XAPIC_ICR_OFF, 0x600 | 0x80); // MT = 0b11 V=0x80 for 0x80000
 	}
 
-	spinlock_irqsave(&core_init_lock);
+	raw_spinlock(&core_init_lock);
 
 	kernel_mappings.unmap_page(&kernel_mappings, 0);
 }
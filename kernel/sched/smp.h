@@ -3,6 +3,11 @@
 #include <mm/vmm.h>
 #include <types.h>
 
+struct sched_queue;
+struct clockevent;
+struct timer_base;
+struct task;
+
 struct cpu_local {
 	uintptr_t kernel_stack;
 	uintptr_t user_stack;
@@ -12,8 +17,19 @@ struct cpu_local {
 	tid_t tid;
 	int apic_id;
 	struct page_table *page_table;
+	struct sched_queue *queue;
+	struct clockevent *clockevent;
+	struct timer_base *timers;
+	struct cpu_local *self; // CORE_LOCAL reads this through gs, NULL until the cpu is brought up
+	struct task *current; // NULL while idle or once the running task was torn down
+	struct task *fpu_owner; // task whose state the fpu registers hold, cr0.ts is set while NULL
+	uint64_t resched_stamp; // when a reschedule was first asked for and could not happen yet, 0 when none is pending
+	int preempt_count; // spinlocks held, the task is only switched away from kernel code while this is 0
+	bool fpu_interrupts; // interrupt state kernel_fpu_end goes back to
+	struct page_table *cr3_table; // what vmm_init_page_table last loaded, page_table is only the scheduled task's
 } __attribute__((packed));
 
 extern size_t logical_processor_cnt;
+extern VECTOR(struct cpu_local*) cpu_list;
 
 void boot_aps();
@@ -0,0 +1,74 @@
+; offsets into struct registers
+%define REGS_R15 0
+%define REGS_R14 8
+%define REGS_R13 16
+%define REGS_R12 24
+%define REGS_RBP 80
+%define REGS_RBX 104
+%define REGS_RIP 136
+%define REGS_CS 144
+%define REGS_RFLAGS 152
+%define REGS_RSP 160
+%define REGS_SS 168
+
+global sched_switch
+global sched_resume
+
+; void sched_switch(struct registers *save, struct registers *next, bool *release)
+;
+; records the caller in save as a kernel frame that resumes by returning from this
+; call, so only the callee-saved registers and the flags are kept, then resumes next
+sched_switch:
+	mov [rdi + REGS_R15], r15
+	mov [rdi + REGS_R14], r14
+	mov [rdi + REGS_R13], r13
+	mov [rdi + REGS_R12], r12
+	mov [rdi + REGS_RBP], rbp
+	mov [rdi + REGS_RBX], rbx
+
+	pushfq
+	pop qword [rdi + REGS_RFLAGS]
+
+	lea rax, [rel .resume]
+	mov [rdi + REGS_RIP], rax
+	mov [rdi + REGS_RSP], rsp
+	mov qword [rdi + REGS_CS], 0x28
+	mov qword [rdi + REGS_SS], 0x30
+
+	mov rdi, rsi
+	mov rsi, rdx
+	jmp sched_resume
+.resume:
+	ret
+
+; void sched_resume(struct registers *next, bool *release)
+;
+; release is cleared once we are off the previous stack, after that the task
+; that owned it may be picked up by another cpu. a ring 3 frame gets the user
+; gs swapped in right before the iretq, nothing may go through gs after that
+sched_resume:
+	mov rsp, rdi
+	mov byte [rsi], 0
+
+	pop r15
+	pop r14
+	pop r13
+	pop r12
+	pop r11
+	pop r10
+	pop r9
+	pop r8
+	pop rsi
+	pop rdi
+	pop rbp
+	pop rdx
+	pop rcx
+	pop rbx
+	pop rax
+	add rsp, 16
+
+	test qword [rsp + 8], 0x3 ; cs
+	jz .iret
+	swapgs
+.iret:
+	iretq
@@ -0,0 +1,83 @@
+#include <sched/vdso.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <mm/mmap.h>
+#include <vdso/vdso.h>
+#include <string.h>
+#include <hash.h>
+#include <cpu.h>
+#include <debug.h>
+#include <time.h>
+
+asm (
+	".global vdso_image_begin\n\t"
+	"vdso_image_begin: .incbin \"vdso/vdso.so\"\n\t"
+	".global vdso_image_end\n\t"
+	"vdso_image_end:\n\t"
+);
+
+extern uint8_t vdso_image_begin[];
+extern uint8_t vdso_image_end[];
+
+// the time page sits right below the image, the linker script points vdso_time at it
+static uint64_t vdso_base;
+static size_t vdso_page_cnt;
+
+// every address space shares the same frames, the kernel holds a reference so they are never freed
+static int vdso_reference = 1;
+
+void vdso_init() {
+	size_t image_size = (uintptr_t)vdso_image_end - (uintptr_t)vdso_image_begin;
+
+	vdso_page_cnt = DIV_ROUNDUP(image_size, PAGE_SIZE) + 1;
+	vdso_base = pmm_alloc(vdso_page_cnt, 1);
+
+	memset((void*)(vdso_base + HIGH_VMA), 0, vdso_page_cnt * PAGE_SIZE);
+	memcpy((void*)(vdso_base + PAGE_SIZE + HIGH_VMA), vdso_image_begin, image_size);
+
+	clock_vdso_publish((void*)(vdso_base + HIGH_VMA));
+
+	print("vdso: %x bytes at %x\n", image_size, vdso_base);
+}
+
+// maps the time page and the image into page_table, returns the address of the image elf header
+uint64_t vdso_map(struct page_table *page_table) {
+	uint64_t base = (uint64_t)mmap(
+			page_table,
+			NULL,
+			vdso_page_cnt * PAGE_SIZE,
+			MMAP_PROT_READ | MMAP_PROT_EXEC | MMAP_PROT_USER,
+			MMAP_MAP_ANONYMOUS,
+			0,
+			0
+	);
+
+	if(base == (uint64_t)-1) {
+		return 0;
+	}
+
+	for(size_t i = 0; i < vdso_page_cnt; i++) {
+		struct frame *frame = alloc(sizeof(struct frame));
+		frame->addr = vdso_base + i * PAGE_SIZE;
+
+		uint64_t flags = VMM_FLAGS_P | VMM_FLAGS_US | VMM_SHARE_FLAG;
+		if(i == 0) flags |= VMM_FLAGS_NX;
+
+		struct page *page = alloc(sizeof(struct page));
+
+		*page = (struct page) {
+			.vaddr = base + i * PAGE_SIZE,
+			.frame = frame,
+			.size = PAGE_SIZE,
+			.flags = flags,
+			.pml_entry = page_table->map_page(page_table, base + i * PAGE_SIZE, frame->addr, flags),
+			.reference = &vdso_reference
+		};
+
+		vdso_reference++;
+
+		hash_table_push(page_table->pages, &page->vaddr, page, sizeof(page->vaddr));
+	}
+
+	return base + PAGE_SIZE;
+}
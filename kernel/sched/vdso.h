@@ -0,0 +1,8 @@
+#pragma once
+
+#include <types.h>
+
+struct page_table;
+
+void vdso_init();
+uint64_t vdso_map(struct page_table *page_table);
@@ -0,0 +1,269 @@
+#include <sched/workqueue.h>
+#include <sched/sched.h>
+#include <sched/smp.h>
+#include <sched/runqueue.h>
+#include <fs/cdev.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+#include <time.h>
+#include <cpu.h>
+
+static struct worker_pool **workqueue_pools;
+static size_t workqueue_pool_cnt;
+
+void work_init(struct work *work, void (*function)(struct work *work), void *data) {
+	*work = (struct work) {
+		.function = function,
+		.data = data
+	};
+}
+
+static void worker_thread(void *_pool) {
+	struct worker_pool *pool = _pool;
+	struct task *task = CURRENT_TASK;
+
+	spinlock_irqsave(&pool->lock);
+
+	for(;;) {
+		struct work *work = pool->head;
+
+		// the queuer clears blocking under the pool lock before requeueing, so a wake up cannot slip in between
+		if(work == NULL) {
+			task->blocking = true;
+			pool->idle = true;
+
+			spinrelease_irqsave(&pool->lock);
+			sched_block(task);
+			spinlock_irqsave(&pool->lock);
+
+			continue;
+		}
+
+		pool->head = work->next;
+		if(pool->head == NULL) {
+			pool->tail = NULL;
+		}
+
+		pool->length--;
+
+		work->next = NULL;
+		pool->running = work;
+
+		__atomic_store_n(&work->pending, false, __ATOMIC_RELEASE); // from here on it may be queued again
+
+		uint64_t start = clock_nanoseconds();
+		if(start - work->queued_at > pool->latency_max) {
+			pool->latency_max = start - work->queued_at;
+		}
+
+		spinrelease_irqsave(&pool->lock);
+
+		work->function(work);
+
+		spinlock_irqsave(&pool->lock);
+
+		pool->running = NULL;
+		pool->run_cnt++;
+		pool->busy_time += clock_nanoseconds() - start;
+	}
+}
+
+// returns false when the item was already pending, safe from interrupt handlers
+bool work_queue_on(int cpu, struct work *work) {
+	if(workqueue_pools == NULL) { // before the workers exist the caller runs it
+		work->function(work);
+		return true;
+	}
+
+	if(cpu < 0 || cpu >= workqueue_pool_cnt) {
+		cpu = 0;
+	}
+
+	// claimed before taking a pool lock, the item may be pending on another cpu's pool
+	if(__atomic_exchange_n(&work->pending, true, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	struct worker_pool *pool = workqueue_pools[cpu];
+
+	spinlock_irqsave(&pool->lock);
+
+	work->pool = pool;
+	work->next = NULL;
+	work->queued_at = clock_nanoseconds();
+
+	if(pool->tail) {
+		pool->tail->next = work;
+	} else {
+		pool->head = work;
+	}
+
+	pool->tail = work;
+
+	if(++pool->length > pool->max_length) {
+		pool->max_length = pool->length;
+	}
+
+	pool->queued_cnt++;
+
+	bool wake = pool->idle;
+	if(wake) {
+		pool->idle = false;
+		pool->worker->blocking = false;
+	}
+
+	spinrelease_irqsave(&pool->lock);
+
+	if(wake) {
+		sched_requeue(pool->worker);
+	}
+
+	return true;
+}
+
+bool work_queue(struct work *work) {
+	struct sched_queue *queue = CORE_LOCAL->queue;
+
+	return work_queue_on(queue ? queue->cpu : 0, work);
+}
+
+// takes the item off its pool if it has not started yet, returns whether it was pending
+bool work_cancel(struct work *work) {
+	struct worker_pool *pool = work->pool;
+	if(pool == NULL) {
+		return false;
+	}
+
+	spinlock_irqsave(&pool->lock);
+
+	// a racing work_queue_on may have claimed it without linking it yet, that one is not cancelled
+	struct work **link = &pool->head;
+	struct work *prev = NULL;
+
+	while(*link && *link != work) {
+		prev = *link;
+		link = &(*link)->next;
+	}
+
+	bool pending = *link != NULL;
+
+	if(pending) {
+		*link = work->next;
+		if(pool->tail == work) {
+			pool->tail = prev;
+		}
+
+		pool->length--;
+		pool->cancel_cnt++;
+
+		work->next = NULL;
+		__atomic_store_n(&work->pending, false, __ATOMIC_RELEASE);
+	}
+
+	spinrelease_irqsave(&pool->lock);
+
+	return pending;
+}
+
+// waits until the item is neither pending nor running, never call it on an item from that item's function
+void work_flush(struct work *work) {
+	for(;;) {
+		struct worker_pool *pool = __atomic_load_n(&work->pool, __ATOMIC_ACQUIRE); // requeued elsewhere meanwhile
+		if(pool == NULL) {
+			return;
+		}
+
+		spinlock_irqsave(&pool->lock);
+		bool busy = __atomic_load_n(&work->pending, __ATOMIC_ACQUIRE) || pool->running == work;
+		spinrelease_irqsave(&pool->lock);
+
+		if(!busy) {
+			return;
+		}
+
+		sched_yield(); // the worker may share our cpu
+	}
+}
+
+void workqueue_init() {
+	struct worker_pool **pools = alloc(sizeof(struct worker_pool*) * cpu_list.length);
+
+	for(size_t i = 0; i < cpu_list.length; i++) {
+		struct worker_pool *pool = alloc(sizeof(struct worker_pool));
+
+		pool->cpu = i;
+		pool->start = clock_nanoseconds();
+		pool->worker = sched_kernel_task_cpu(worker_thread, pool, i);
+
+		pools[i] = pool;
+	}
+
+	workqueue_pool_cnt = cpu_list.length;
+	workqueue_pools = pools;
+
+	print("workqueue: %d worker pools\n", workqueue_pool_cnt);
+}
+
+static ssize_t workqueue_read(struct file_handle *file, void *buf, size_t cnt, off_t offset);
+
+static struct file_ops workqueue_ops = {
+	.read = workqueue_read
+};
+
+static ssize_t workqueue_read(struct file_handle*, void *buf, size_t cnt, off_t offset) {
+	size_t size = workqueue_pool_cnt * 256 + 1;
+
+	char *text = alloc(size);
+	size_t length = 0;
+
+	uint64_t now = clock_nanoseconds();
+
+	for(size_t i = 0; i < workqueue_pool_cnt; i++) {
+		struct worker_pool *pool = workqueue_pools[i];
+
+		spinlock_irqsave(&pool->lock);
+
+		// percent of the time since the worker came up that it spent running items, to a tenth
+		uint64_t uptime = now - pool->start;
+		uint64_t utilisation = uptime ? pool->busy_time * 1000 / uptime : 0;
+
+		length += sprint(text + length, "cpu%d worker %d pending %d max %d queued %d run %d cancelled %d"
+			" busy_ns %d util %d.%d latency %d\n",
+			pool->cpu, pool->worker ? pool->worker->id.tid : 0, pool->length, pool->max_length,
+			pool->queued_cnt, pool->run_cnt, pool->cancel_cnt, pool->busy_time,
+			utilisation / 10, utilisation % 10, pool->latency_max);
+
+		spinrelease_irqsave(&pool->lock);
+	}
+
+	if(offset >= length) {
+		free(text);
+		return 0;
+	}
+
+	if(cnt > length - offset) {
+		cnt = length - offset;
+	}
+
+	memcpy(buf, text + offset, cnt);
+	free(text);
+
+	return cnt;
+}
+
+int workqueue_dev_init() {
+	struct cdev *cdev = alloc(sizeof(struct cdev));
+	cdev->fops = &workqueue_ops;
+	cdev->rdev = makedev(WORKQUEUE_MAJOR, 0);
+	if(cdev_register(cdev) == -1)
+		return -1;
+
+	struct stat *stat = alloc(sizeof(struct stat));
+	stat_init(stat);
+	stat->st_mode = S_IFCHR | S_IRUSR | S_IRGRP | S_IROTH;
+	stat->st_rdev = makedev(WORKQUEUE_MAJOR, 0);
+	vfs_create_node_deep(NULL, NULL, NULL, stat, "/dev/workqueue");
+
+	return 0;
+}
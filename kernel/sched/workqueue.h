@@ -0,0 +1,53 @@
+#pragma once
+
+#include <types.h>
+#include <lock.h>
+
+#define WORKQUEUE_MAJOR 241
+
+struct work;
+struct task;
+
+// one per cpu, a kernel thread pinned to the cpu runs the items queued there in order
+struct worker_pool {
+	struct spinlock lock;
+	int cpu;
+
+	struct task *worker;
+	bool idle; // the worker is blocked waiting for work
+
+	struct work *head;
+	struct work *tail;
+	struct work *running;
+
+	size_t length;
+	size_t max_length;
+
+	size_t queued_cnt;
+	size_t run_cnt;
+	size_t cancel_cnt;
+
+	uint64_t start; // when the worker came up
+	uint64_t busy_time; // ns spent in work functions
+	uint64_t latency_max; // worst ns between queueing an item and it starting
+};
+
+struct work {
+	void (*function)(struct work *work); // runs in the worker thread, may sleep
+	void *data;
+
+	struct worker_pool *pool; // pool it was last queued on, NULL if it never was
+	struct work *next;
+	bool pending;
+
+	uint64_t queued_at;
+};
+
+void work_init(struct work *work, void (*function)(struct work *work), void *data);
+bool work_queue(struct work *work);
+bool work_queue_on(int cpu, struct work *work);
+bool work_cancel(struct work *work);
+void work_flush(struct work *work);
+
+void workqueue_init();
+int workqueue_dev_init();
@@ -0,0 +1,117 @@
+#include <vdso/vdso.h>
+#include <stddef.h>
+
+#define CLOCK_REALTIME 0
+#define CLOCK_MONOTONIC 1
+
+#define NSEC_PER_SEC 1000000000ull
+
+struct timespec {
+	int64_t tv_sec;
+	long tv_nsec;
+};
+
+struct timeval {
+	int64_t tv_sec;
+	long tv_usec;
+};
+
+// placed on the page right before the image by the linker script
+extern volatile struct vdso_time vdso_time __attribute__((visibility("hidden")));
+
+static inline uint64_t vdso_rdtsc() {
+	uint32_t low, high;
+	asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+	return ((uint64_t)high << 32) | low;
+}
+
+static long vdso_syscall_clock_gettime(int clock, struct timespec *ts) {
+	long ret, err;
+	asm volatile ("syscall" : "=a"(ret), "=d"(err) : "a"(VDSO_SYSCALL_CLOCK_GETTIME), "D"(clock), "S"(ts) : "rcx", "r11", "memory");
+	return ret == -1 ? -err : 0;
+}
+
+// returns -1 when the page does not describe a usable clock
+static int vdso_read(int clock, struct timespec *ts) {
+	uint32_t seq;
+	uint64_t ns;
+	int64_t epoch;
+
+	do {
+		seq = __atomic_load_n(&vdso_time.seq, __ATOMIC_ACQUIRE);
+		if(seq & 1) {
+			continue;
+		}
+
+		if(vdso_time.mode != VDSO_CLOCK_TSC) {
+			return -1;
+		}
+
+		uint64_t tsc = vdso_rdtsc();
+		uint64_t base = vdso_time.tsc_base;
+		uint64_t delta = tsc > base ? tsc - base : 0;
+
+		ns = vdso_time.monotonic_base + (uint64_t)(((unsigned __int128)delta * vdso_time.mult) >> VDSO_TSC_SHIFT);
+		epoch = vdso_time.epoch;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while((seq & 1) || seq != __atomic_load_n(&vdso_time.seq, __ATOMIC_RELAXED));
+
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+
+	if(clock == CLOCK_REALTIME) {
+		ts->tv_sec += epoch;
+	}
+
+	return 0;
+}
+
+// the exported entry points only call static code, the image must not need relocating
+static int vdso_clock_gettime(int clock, struct timespec *ts) {
+	if((clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC) || vdso_read(clock, ts) == -1) {
+		return vdso_syscall_clock_gettime(clock, ts);
+	}
+
+	return 0;
+}
+
+int __vdso_clock_gettime(int clock, struct timespec *ts) {
+	return vdso_clock_gettime(clock, ts);
+}
+
+int __vdso_gettimeofday(struct timeval *tv, void *tz) {
+	(void)tz;
+
+	if(tv) {
+		struct timespec ts;
+
+		int ret = vdso_clock_gettime(CLOCK_REALTIME, &ts);
+		if(ret) {
+			return ret;
+		}
+
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+	}
+
+	return 0;
+}
+
+int64_t __vdso_time(int64_t *t) {
+	struct timespec ts;
+
+	if(vdso_clock_gettime(CLOCK_REALTIME, &ts)) {
+		return -1;
+	}
+
+	if(t) {
+		*t = ts.tv_sec;
+	}
+
+	return ts.tv_sec;
+}
+
+int clock_gettime(int clock, struct timespec *ts) __attribute__((weak, alias("__vdso_clock_gettime")));
+int gettimeofday(struct timeval *tv, void *tz) __attribute__((weak, alias("__vdso_gettimeofday")));
+int64_t time(int64_t *t) __attribute__((weak, alias("__vdso_time")));
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// layout of the time page, shared between the kernel and the vdso
+
+#define VDSO_CLOCK_SYSCALL 0 // no usable tsc, the vdso falls back to the syscall
+#define VDSO_CLOCK_TSC 1
+
+#define VDSO_TSC_SHIFT 32
+
+#define VDSO_SYSCALL_CLOCK_GETTIME 72
+
+struct vdso_time {
+	uint32_t seq; // odd while the kernel is updating the page
+	uint32_t mode;
+
+	uint64_t tsc_base;
+	uint64_t monotonic_base; // nanoseconds at tsc_base
+	uint64_t mult; // nanoseconds per tsc tick << VDSO_TSC_SHIFT
+
+	int64_t epoch; // seconds between the monotonic and the realtime clock
+};
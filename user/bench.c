@@ -0,0 +1,882 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <time.h>
+#include <elf.h>
+#include <sys/auxv.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+static uint64_t rdtsc() {
+	uint32_t low, high;
+	asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+	return ((uint64_t)high << 32) | low;
+}
+
+static uint64_t spin_for(uint64_t cycles) {
+	volatile uint64_t iterations = 0;
+	uint64_t end = rdtsc() + cycles;
+
+	while(rdtsc() < end) {
+		iterations++;
+	}
+
+	return iterations;
+}
+
+// blocked tasks must not take cpu time away from a runnable one
+static int bench_idle(int argc, char **argv) {
+	int sleepers = argc > 0 ? atoi(argv[0]) : 64;
+	uint64_t window = 2000000000ull; // tsc cycles, about a second
+
+	uint64_t baseline = spin_for(window);
+
+	int fds[2];
+	if(pipe(fds) == -1) {
+		perror("pipe");
+		return 1;
+	}
+
+	pid_t *children = calloc(sleepers, sizeof(pid_t));
+
+	for(int i = 0; i < sleepers; i++) {
+		children[i] = fork();
+		if(children[i] == 0) {
+			char c;
+			close(fds[1]);
+			read(fds[0], &c, 1); // parked until the pipe closes
+			_exit(0);
+		}
+	}
+
+	close(fds[0]);
+
+	uint64_t loaded = spin_for(window);
+
+	close(fds[1]);
+
+	for(int i = 0; i < sleepers; i++) {
+		waitpid(children[i], NULL, 0);
+	}
+
+	printf("idle: %d sleepers, %llu iterations alone, %llu with sleepers (%llu%%)\n",
+		sleepers, (unsigned long long)baseline, (unsigned long long)loaded,
+		(unsigned long long)(baseline ? loaded * 100 / baseline : 0));
+
+	free(children);
+
+	return 0;
+}
+
+// round trips between two tasks that block on each other, every hop is a voluntary switch
+static int bench_yield(int argc, char **argv) {
+	int rounds = argc > 0 ? atoi(argv[0]) : 10000;
+
+	int ping[2], pong[2];
+	if(pipe(ping) == -1 || pipe(pong) == -1) {
+		perror("pipe");
+		return 1;
+	}
+
+	pid_t child = fork();
+	if(child == 0) {
+		char c;
+		close(ping[1]);
+		close(pong[0]);
+		while(read(ping[0], &c, 1) == 1) {
+			write(pong[1], &c, 1);
+		}
+		_exit(0);
+	}
+
+	char c = 0;
+	uint64_t start = rdtsc();
+
+	for(int i = 0; i < rounds; i++) {
+		write(ping[1], &c, 1);
+		read(pong[0], &c, 1);
+	}
+
+	uint64_t elapsed = rdtsc() - start;
+
+	close(ping[1]);
+	waitpid(child, NULL, 0);
+
+	printf("yield: %d round trips, %llu cycles each\n", rounds,
+		(unsigned long long)(rounds ? elapsed / rounds : 0));
+
+	return 0;
+}
+
+// short timed sleeps, the cost above the requested timeout is timer and wake up latency
+static int bench_sleep(int argc, char **argv) {
+	int rounds = argc > 0 ? atoi(argv[0]) : 1000;
+	int timeout = argc > 1 ? atoi(argv[1]) : 1; // ms
+
+	uint64_t best = ~0ull, total = 0;
+
+	for(int i = 0; i < rounds; i++) {
+		uint64_t start = rdtsc();
+		poll(NULL, 0, timeout);
+		uint64_t elapsed = rdtsc() - start;
+
+		total += elapsed;
+		if(elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	printf("sleep: %d x %dms, %llu cycles average, %llu best\n", rounds, timeout,
+		(unsigned long long)(rounds ? total / rounds : 0), (unsigned long long)best);
+
+	return 0;
+}
+
+// holds a pattern in xmm0-7 across a spin long enough to be preempted, returns whether it survived
+static int fpu_hold(uint64_t seed, uint64_t cycles) {
+	uint64_t in[16], out[16];
+
+	for(int i = 0; i < 16; i++) {
+		in[i] = seed * 0x9e3779b97f4a7c15ull + i;
+	}
+
+	uint64_t deadline = rdtsc() + cycles;
+
+	asm volatile (
+		"movdqu 0(%0), %%xmm0\n\t"
+		"movdqu 16(%0), %%xmm1\n\t"
+		"movdqu 32(%0), %%xmm2\n\t"
+		"movdqu 48(%0), %%xmm3\n\t"
+		"movdqu 64(%0), %%xmm4\n\t"
+		"movdqu 80(%0), %%xmm5\n\t"
+		"movdqu 96(%0), %%xmm6\n\t"
+		"movdqu 112(%0), %%xmm7\n\t"
+		"1:\n\t"
+		"rdtsc\n\t"
+		"shl $32, %%rdx\n\t"
+		"or %%rdx, %%rax\n\t"
+		"cmp %1, %%rax\n\t"
+		"jb 1b\n\t"
+		"movdqu %%xmm0, 0(%2)\n\t"
+		"movdqu %%xmm1, 16(%2)\n\t"
+		"movdqu %%xmm2, 32(%2)\n\t"
+		"movdqu %%xmm3, 48(%2)\n\t"
+		"movdqu %%xmm4, 64(%2)\n\t"
+		"movdqu %%xmm5, 80(%2)\n\t"
+		"movdqu %%xmm6, 96(%2)\n\t"
+		"movdqu %%xmm7, 112(%2)\n\t"
+		:: "r"(in), "r"(deadline), "r"(out)
+		: "rax", "rdx", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "memory"
+	);
+
+	return memcmp(in, out, sizeof(in)) == 0;
+}
+
+static int bench_fpu(int argc, char **argv) {
+	int procs = argc > 0 ? atoi(argv[0]) : 4;
+	int rounds = argc > 1 ? atoi(argv[1]) : 200;
+
+	for(int i = 0; i < procs; i++) {
+		if(fork() == 0) {
+			int corrupt = 0;
+
+			for(int j = 0; j < rounds; j++) {
+				corrupt += !fpu_hold(getpid() * 1000 + j, 2000000);
+			}
+
+			_exit(corrupt > 255 ? 255 : corrupt);
+		}
+	}
+
+	int corrupt = 0;
+
+	for(int i = 0; i < procs; i++) {
+		int status;
+		if(wait(&status) != -1 && WIFEXITED(status)) {
+			corrupt += WEXITSTATUS(status);
+		}
+	}
+
+	printf("fpu: %d processes x %d rounds, %d corrupted\n", procs, rounds, corrupt);
+
+	return corrupt != 0;
+}
+
+// raw getpid, libc may cache it and it has to stay a round trip through the kernel entry path
+static long getpid_syscall() {
+	long ret;
+
+	asm volatile ("syscall" : "=a"(ret) : "a"(15) : "rcx", "r11", "rdx", "memory");
+
+	return ret;
+}
+
+static int bench_syscall(int argc, char **argv) {
+	int rounds = argc > 0 ? atoi(argv[0]) : 100000;
+
+	uint64_t best = ~0ull, total = 0;
+
+	for(int i = 0; i < rounds; i++) {
+		uint64_t start = rdtsc();
+		getpid_syscall();
+		uint64_t elapsed = rdtsc() - start;
+
+		total += elapsed;
+		if(elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	printf("syscall: %d x getpid, %llu cycles average, %llu best\n", rounds,
+		(unsigned long long)(rounds ? total / rounds : 0), (unsigned long long)best);
+
+	return 0;
+}
+
+// what /dev/trace hands out, see kernel/int/trace.h
+struct trace_event {
+	uint64_t start;
+	uint64_t end;
+	int32_t pid;
+	int32_t tid;
+	uint16_t number;
+	uint16_t cpu;
+	uint32_t error;
+	uint64_t args[6];
+	uint64_t ret;
+};
+
+static uint64_t getpid_average(int rounds) {
+	uint64_t start = rdtsc();
+
+	for(int i = 0; i < rounds; i++) {
+		getpid_syscall();
+	}
+
+	return rounds ? (rdtsc() - start) / rounds : 0;
+}
+
+static int trace_switch(const char *state) {
+	int fd = open("/dev/trace", O_WRONLY);
+	if(fd == -1) {
+		return -1;
+	}
+
+	ssize_t ret = write(fd, state, strlen(state));
+	close(fd);
+
+	return ret == -1 ? -1 : 0;
+}
+
+// getpid with syscall tracing off and on, then drains the rings and checks our calls made it in
+static int bench_trace(int argc, char **argv) {
+	int rounds = argc > 0 ? atoi(argv[0]) : 512;
+
+	uint64_t off = getpid_average(rounds);
+
+	if(trace_switch("on") == -1) {
+		perror("trace");
+		return 1;
+	}
+
+	uint64_t on = getpid_average(rounds);
+	trace_switch("off");
+
+	int fd = open("/dev/trace", O_RDONLY);
+	if(fd == -1) {
+		perror("trace");
+		return 1;
+	}
+
+	static struct trace_event events[256];
+	pid_t pid = getpid();
+	size_t total = 0, ours = 0;
+	uint64_t cycles = 0;
+	ssize_t length;
+
+	while((length = read(fd, events, sizeof(events))) > 0) {
+		for(size_t i = 0; i < length / sizeof(struct trace_event); i++) {
+			total++;
+
+			if(events[i].number == 15 && events[i].pid == pid) {
+				ours++;
+				cycles += events[i].end - events[i].start;
+			}
+		}
+	}
+
+	close(fd);
+
+	printf("trace: %d x getpid, %llu cycles off, %llu cycles on\n", rounds, (unsigned long long)off,
+		(unsigned long long)on);
+	printf("trace: drained %zu events, %zu of our getpid calls, %llu cycles in the kernel on average\n", total, ours,
+		(unsigned long long)(ours ? cycles / ours : 0));
+	printf("trace: see /dev/tracestat for drops\n");
+
+	return 0;
+}
+
+// looks a symbol up in the vdso through its dynamic section, the image is linked at 0
+static void *vdso_symbol(const char *name) {
+	uintptr_t base = getauxval(AT_SYSINFO_EHDR);
+	if(base == 0) {
+		return NULL;
+	}
+
+	Elf64_Ehdr *ehdr = (void*)base;
+	Elf64_Phdr *phdr = (void*)(base + ehdr->e_phoff);
+	Elf64_Dyn *dyn = NULL;
+
+	for(int i = 0; i < ehdr->e_phnum; i++) {
+		if(phdr[i].p_type == PT_DYNAMIC) {
+			dyn = (void*)(base + phdr[i].p_vaddr);
+		}
+	}
+
+	if(dyn == NULL) {
+		return NULL;
+	}
+
+	Elf64_Sym *symtab = NULL;
+	const char *strtab = NULL;
+	uint32_t *hash = NULL;
+
+	for(; dyn->d_tag != DT_NULL; dyn++) {
+		if(dyn->d_tag == DT_SYMTAB) symtab = (void*)(base + dyn->d_un.d_ptr);
+		if(dyn->d_tag == DT_STRTAB) strtab = (void*)(base + dyn->d_un.d_ptr);
+		if(dyn->d_tag == DT_HASH) hash = (void*)(base + dyn->d_un.d_ptr);
+	}
+
+	if(symtab == NULL || strtab == NULL || hash == NULL) {
+		return NULL;
+	}
+
+	for(uint32_t i = 0; i < hash[1]; i++) { // nchain is the symbol count
+		if(symtab[i].st_shndx != SHN_UNDEF && strcmp(strtab + symtab[i].st_name, name) == 0) {
+			return (void*)(base + symtab[i].st_value);
+		}
+	}
+
+	return NULL;
+}
+
+static long clock_gettime_syscall(clockid_t clock, struct timespec *timespec) {
+	long ret;
+
+	asm volatile ("syscall" : "=a"(ret) : "a"(72), "D"(clock), "S"(timespec) : "rcx", "r11", "rdx", "memory");
+
+	return ret;
+}
+
+static int bench_clock(int argc, char **argv) {
+	int rounds = argc > 0 ? atoi(argv[0]) : 100000;
+
+	int (*vdso_clock_gettime)(clockid_t, struct timespec*) = vdso_symbol("__vdso_clock_gettime");
+	if(vdso_clock_gettime == NULL) {
+		printf("clock: no vdso\n");
+		return 1;
+	}
+
+	struct timespec timespec;
+
+	uint64_t start = rdtsc();
+	for(int i = 0; i < rounds; i++) {
+		clock_gettime_syscall(CLOCK_MONOTONIC, &timespec);
+	}
+	uint64_t syscall = rdtsc() - start;
+
+	start = rdtsc();
+	for(int i = 0; i < rounds; i++) {
+		vdso_clock_gettime(CLOCK_MONOTONIC, &timespec);
+	}
+	uint64_t vdso = rdtsc() - start;
+
+	printf("clock: %d calls, syscall %llu cycles/call, vdso %llu cycles/call\n", rounds,
+		(unsigned long long)(rounds ? syscall / rounds : 0), (unsigned long long)(rounds ? vdso / rounds : 0));
+
+	return 0;
+}
+
+static long sched_setaffinity_syscall(pid_t pid, size_t size, const uint64_t *mask) {
+	long ret;
+
+	asm volatile ("syscall" : "=a"(ret), "+d"(mask) : "a"(73), "D"(pid), "S"(size) : "rcx", "r11", "memory"); // errno comes back in rdx
+
+	return ret;
+}
+
+// the yield ping pong with both ends pinned to one cpu, compare against yield to see what a cold cache costs
+static int bench_affinity(int argc, char **argv) {
+	int cpu = argc > 0 ? atoi(argv[0]) : 0;
+	uint64_t mask[4] = { 0 };
+
+	if(cpu < 0 || cpu >= 256) {
+		fprintf(stderr, "affinity: bad cpu %d\n", cpu);
+		return 1;
+	}
+
+	mask[cpu / 64] = 1ull << (cpu % 64);
+
+	if(sched_setaffinity_syscall(0, sizeof(mask), mask) == -1) { // inherited by the child
+		printf("affinity: cpu %d is not online\n", cpu);
+		return 1;
+	}
+
+	printf("affinity: pinned to cpu %d, see /dev/taskstat for migrations\n", cpu);
+
+	return bench_yield(argc - 1, argv + 1);
+}
+
+static long sched_setscheduler_syscall(pid_t pid, int policy, int priority) {
+	long ret;
+	int param = priority;
+	int *ptr = &param;
+
+	asm volatile ("syscall" : "=a"(ret), "+d"(ptr) : "a"(75), "D"(pid), "S"(policy) : "rcx", "r11", "memory");
+
+	return ret;
+}
+
+// cycles a short sleep overshoots by, on average and at worst
+static void sleep_latency(int rounds, int timeout, uint64_t *average, uint64_t *worst) {
+	uint64_t total = 0;
+	*worst = 0;
+
+	for(int i = 0; i < rounds; i++) {
+		uint64_t start = rdtsc();
+		poll(NULL, 0, timeout);
+		uint64_t elapsed = rdtsc() - start;
+
+		total += elapsed;
+		if(elapsed > *worst) {
+			*worst = elapsed;
+		}
+	}
+
+	*average = rounds ? total / rounds : 0;
+}
+
+// wake up latency of a sleeper with cpu bound fair tasks on every cpu, first as a fair task then as SCHED_FIFO
+static int bench_rt(int argc, char **argv) {
+	int spinners = argc > 0 ? atoi(argv[0]) : 8;
+	int rounds = argc > 1 ? atoi(argv[1]) : 200;
+	int timeout = argc > 2 ? atoi(argv[2]) : 1; // ms
+
+	pid_t *children = calloc(spinners, sizeof(pid_t));
+
+	for(int i = 0; i < spinners; i++) {
+		children[i] = fork();
+		if(children[i] == 0) {
+			for(;;) {
+				spin_for(1000000);
+			}
+		}
+	}
+
+	uint64_t fair_average, fair_worst;
+	sleep_latency(rounds, timeout, &fair_average, &fair_worst);
+
+	uint64_t rt_average = 0, rt_worst = 0;
+	long ret = sched_setscheduler_syscall(0, 1, 50);
+
+	if(ret != -1) {
+		sleep_latency(rounds, timeout, &rt_average, &rt_worst);
+		sched_setscheduler_syscall(0, 0, 0);
+	}
+
+	for(int i = 0; i < spinners; i++) {
+		kill(children[i], SIGKILL);
+		waitpid(children[i], NULL, 0);
+	}
+
+	free(children);
+
+	printf("rt: %d spinners, %d x %dms sleeps\n", spinners, rounds, timeout);
+	printf("rt: fair %llu cycles average, %llu worst\n", (unsigned long long)fair_average, (unsigned long long)fair_worst);
+
+	if(ret == -1) {
+		printf("rt: SCHED_FIFO not permitted\n");
+	} else {
+		printf("rt: fifo %llu cycles average, %llu worst\n", (unsigned long long)rt_average, (unsigned long long)rt_worst);
+	}
+
+	return 0;
+}
+
+// wake up latency of a sleeper while another task sits in long write syscalls, see latency in /dev/schedstat
+static int bench_preempt(int argc, char **argv) {
+	const char *path = argc > 0 ? argv[0] : "/tmp/bench-preempt";
+	size_t size = (argc > 1 ? atoi(argv[1]) : 16) << 20; // mb per write
+	int rounds = argc > 2 ? atoi(argv[2]) : 200;
+
+	uint64_t mask[4] = { 1 };
+	sched_setaffinity_syscall(0, sizeof(mask), mask); // both on one cpu, so the writer is what the sleeper waits on
+
+	pid_t child = fork();
+	if(child == 0) {
+		char *buffer = calloc(size, 1);
+		int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+		if(buffer == NULL || fd == -1) {
+			_exit(1);
+		}
+
+		for(;;) {
+			pwrite(fd, buffer, size, 0);
+		}
+	}
+
+	uint64_t average, worst;
+	sleep_latency(rounds, 1, &average, &worst);
+
+	kill(child, SIGKILL);
+	waitpid(child, NULL, 0);
+	unlink(path);
+
+	printf("preempt: %zumb writes, %d x 1ms sleeps, %llu cycles average, %llu worst\n", size >> 20, rounds,
+		(unsigned long long)average, (unsigned long long)worst);
+
+	return 0;
+}
+
+static void dump_file(const char *path) {
+	char buffer[4096];
+	int fd = open(path, O_RDONLY);
+
+	if(fd == -1) {
+		printf("top: cannot open %s\n", path);
+		return;
+	}
+
+	ssize_t length;
+	while((length = read(fd, buffer, sizeof(buffer))) > 0) {
+		fwrite(buffer, 1, length, stdout);
+	}
+
+	close(fd);
+}
+
+// a few spinners and a sleeper, then the per cpu and per task accounting the way a top like tool reads it
+static int bench_top(int argc, char **argv) {
+	int spinners = argc > 0 ? atoi(argv[0]) : 4;
+	int rounds = argc > 1 ? atoi(argv[1]) : 100;
+
+	pid_t *children = calloc(spinners, sizeof(pid_t));
+
+	for(int i = 0; i < spinners; i++) {
+		children[i] = fork();
+		if(children[i] == 0) {
+			for(;;) {
+				spin_for(1000000);
+			}
+		}
+	}
+
+	uint64_t average, worst;
+	sleep_latency(rounds, 1, &average, &worst);
+
+	dump_file("/dev/schedstat");
+	dump_file("/dev/taskstat");
+
+	for(int i = 0; i < spinners; i++) {
+		kill(children[i], SIGKILL);
+		waitpid(children[i], NULL, 0);
+	}
+
+	free(children);
+
+	return 0;
+}
+
+static long futex_syscall(uint32_t *uaddr, int op, uint32_t val) {
+	long ret;
+	register void *timeout asm("r10") = NULL;
+
+	asm volatile ("syscall" : "=a"(ret), "+d"(val) : "a"(66), "D"(uaddr), "S"(op), "r"(timeout) : "rcx", "r11", "memory");
+
+	return ret;
+}
+
+#define FUTEX_WAIT_PRIVATE 128
+#define FUTEX_WAKE_PRIVATE 129
+
+// 0 unlocked, 1 locked, 2 locked with waiters, the unlock only enters the kernel in the last case
+static void mutex_lock(uint32_t *word) {
+	uint32_t state = 0;
+	if(__atomic_compare_exchange_n(word, &state, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	if(state != 2) {
+		state = __atomic_exchange_n(word, 2, __ATOMIC_ACQUIRE);
+	}
+
+	while(state != 0) {
+		futex_syscall(word, FUTEX_WAIT_PRIVATE, 2);
+		state = __atomic_exchange_n(word, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+static void mutex_unlock(uint32_t *word) {
+	if(__atomic_exchange_n(word, 0, __ATOMIC_RELEASE) == 2) {
+		futex_syscall(word, FUTEX_WAKE_PRIVATE, 1);
+	}
+}
+
+static struct {
+	uint32_t word;
+	uint64_t count;
+	int rounds;
+	uint64_t hold; // cycles spent inside the critical section
+} contended_mutex;
+
+static void *mutex_thread(void*) {
+	for(int i = 0; i < contended_mutex.rounds; i++) {
+		mutex_lock(&contended_mutex.word);
+		contended_mutex.count++;
+		spin_for(contended_mutex.hold);
+		mutex_unlock(&contended_mutex.word);
+	}
+
+	return NULL;
+}
+
+// threads fighting over one futex based mutex, the lock and unlock cost under contention and a lost update check
+static int bench_mutex(int argc, char **argv) {
+	int threads = argc > 0 ? atoi(argv[0]) : 8;
+	int rounds = argc > 1 ? atoi(argv[1]) : 10000;
+	int hold = argc > 2 ? atoi(argv[2]) : 100;
+
+	contended_mutex.word = 0;
+	contended_mutex.count = 0;
+	contended_mutex.rounds = rounds;
+	contended_mutex.hold = hold;
+
+	pthread_t *ids = calloc(threads, sizeof(pthread_t));
+
+	uint64_t start = rdtsc();
+
+	for(int i = 0; i < threads; i++) {
+		pthread_create(&ids[i], NULL, mutex_thread, NULL);
+	}
+
+	for(int i = 0; i < threads; i++) {
+		pthread_join(ids[i], NULL);
+	}
+
+	uint64_t elapsed = rdtsc() - start;
+	uint64_t expected = (uint64_t)threads * rounds;
+
+	free(ids);
+
+	printf("mutex: %d threads x %d rounds, %llu cycles per lock/unlock, count %llu of %llu%s\n", threads, rounds,
+		(unsigned long long)(expected ? elapsed / expected : 0), (unsigned long long)contended_mutex.count,
+		(unsigned long long)expected, contended_mutex.count == expected ? "" : ", updates lost");
+	printf("mutex: see /dev/taskstat for the switches the waiters took\n");
+
+	return contended_mutex.count != expected;
+}
+
+// the ring layout, see kernel/fs/uring.h
+struct io_uring_sqe {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t ioprio;
+	int32_t fd;
+	uint64_t off;
+	uint64_t addr;
+	uint32_t len;
+	uint32_t op_flags;
+	uint64_t user_data;
+	uint64_t addr2;
+	uint64_t pad[2];
+};
+
+struct io_uring_cqe {
+	uint64_t user_data;
+	int32_t res;
+	uint32_t flags;
+};
+
+struct io_uring_rings {
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint32_t cq_mask;
+	uint32_t cq_entries;
+};
+
+struct io_uring_params {
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	uint32_t flags;
+	uint32_t sq_off;
+	uint32_t cq_off;
+	uint32_t resv;
+	uint64_t ring;
+	uint64_t ring_size;
+};
+
+#define IORING_OP_READ 1
+#define IORING_OP_WRITE 2
+
+static long uring_setup_syscall(uint32_t entries, struct io_uring_params *params) {
+	long ret;
+
+	asm volatile ("syscall" : "=a"(ret) : "a"(80), "D"(entries), "S"(params) : "rcx", "r11", "rdx", "memory");
+
+	return ret;
+}
+
+static long uring_enter_syscall(int fd, uint32_t to_submit) {
+	long ret;
+	register long flags asm("r10") = 0;
+
+	asm volatile ("syscall" : "=a"(ret) : "a"(81), "D"(fd), "S"(to_submit), "d"(0), "r"(flags) : "rcx", "r11", "memory");
+
+	return ret;
+}
+
+// batches of one byte pipe writes and the read draining them, one syscall each against one enter per batch
+static int bench_uring(int argc, char **argv) {
+	int batch = argc > 0 ? atoi(argv[0]) : 64;
+	int rounds = argc > 1 ? atoi(argv[1]) : 1000;
+
+	if(batch < 1 || batch > 1024) {
+		fprintf(stderr, "uring: batch must be between 1 and 1024\n");
+		return 1;
+	}
+
+	int fds[2];
+	if(pipe(fds) == -1) {
+		perror("pipe");
+		return 1;
+	}
+
+	char byte = 'x';
+	char *drain = malloc(batch);
+
+	uint64_t start = rdtsc();
+
+	for(int i = 0; i < rounds; i++) {
+		for(int j = 0; j < batch; j++) {
+			write(fds[1], &byte, 1);
+		}
+
+		read(fds[0], drain, batch);
+	}
+
+	uint64_t plain = rdtsc() - start;
+
+	struct io_uring_params params = { 0 };
+	int ring_fd = uring_setup_syscall(batch + 1, &params);
+	if(ring_fd < 0) {
+		perror("io_uring_setup");
+		return 1;
+	}
+
+	struct io_uring_rings *rings = (void*)params.ring;
+	struct io_uring_sqe *sqes = (void*)(params.ring + params.sq_off);
+	struct io_uring_cqe *cqes = (void*)(params.ring + params.cq_off);
+
+	int failed = 0;
+
+	start = rdtsc();
+
+	for(int i = 0; i < rounds; i++) {
+		uint32_t tail = rings->sq_tail;
+
+		for(int j = 0; j <= batch; j++) {
+			struct io_uring_sqe *sqe = &sqes[tail++ & rings->sq_mask];
+
+			memset(sqe, 0, sizeof(struct io_uring_sqe));
+			sqe->opcode = j < batch ? IORING_OP_WRITE : IORING_OP_READ;
+			sqe->fd = j < batch ? fds[1] : fds[0];
+			sqe->off = -1;
+			sqe->addr = j < batch ? (uintptr_t)&byte : (uintptr_t)drain;
+			sqe->len = j < batch ? 1 : batch;
+			sqe->user_data = j;
+		}
+
+		__atomic_store_n(&rings->sq_tail, tail, __ATOMIC_RELEASE);
+
+		if(uring_enter_syscall(ring_fd, batch + 1) != batch + 1) {
+			failed++;
+		}
+
+		uint32_t head = rings->cq_head;
+		uint32_t cq_tail = __atomic_load_n(&rings->cq_tail, __ATOMIC_ACQUIRE);
+
+		for(; head != cq_tail; head++) {
+			struct io_uring_cqe *cqe = &cqes[head & rings->cq_mask];
+
+			if(cqe->res != (cqe->user_data < (uint64_t)batch ? 1 : batch)) {
+				failed++;
+			}
+		}
+
+		__atomic_store_n(&rings->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	uint64_t ringed = rdtsc() - start;
+	uint64_t ops = (uint64_t)rounds * (batch + 1);
+
+	close(ring_fd);
+	close(fds[0]);
+	close(fds[1]);
+	free(drain);
+
+	printf("uring: %d rounds of %d writes and a read, %llu cycles per op with syscalls, %llu through the ring, %d failed\n",
+		rounds, batch, (unsigned long long)(ops ? plain / ops : 0), (unsigned long long)(ops ? ringed / ops : 0), failed);
+
+	return failed != 0;
+}
+
+static struct {
+	const char *name;
+	int (*run)(int argc, char **argv);
+} benches[] = {
+	{ "idle", bench_idle },
+	{ "yield", bench_yield },
+	{ "sleep", bench_sleep },
+	{ "clock", bench_clock },
+	{ "syscall", bench_syscall },
+	{ "fpu", bench_fpu },
+	{ "affinity", bench_affinity },
+	{ "rt", bench_rt },
+	{ "preempt", bench_preempt },
+	{ "top", bench_top },
+	{ "mutex", bench_mutex },
+	{ "trace", bench_trace },
+	{ "uring", bench_uring }
+};
+
+int main(int argc, char **argv) {
+	setbuf(stdout, NULL);
+
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s <bench> [args]\n", argv[0]);
+		for(size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+			fprintf(stderr, "\t%s\n", benches[i].name);
+		}
+		return 1;
+	}
+
+	for(size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		if(strcmp(argv[1], benches[i].name) == 0) {
+			return benches[i].run(argc - 2, argv + 2);
+		}
+	}
+
+	fprintf(stderr, "%s: unknown bench %s\n", argv[0], argv[1]);
+
+	return 1;
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define SYSCALL_MAX 128
+#define PROCESS_MAX 1024
+#define BUCKETS_MAX 64
+
+struct syscall_stat {
+	int nr;
+	char name[32];
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t cycles;
+	uint64_t max;
+	uint64_t hist[BUCKETS_MAX];
+};
+
+struct process_stat {
+	int pid;
+	uint64_t calls;
+	uint64_t cycles;
+	int top_nr; // the syscall the process spent the most time in
+	uint64_t top_cycles;
+};
+
+static uint64_t tsc_per_ms;
+static int buckets;
+
+static struct syscall_stat syscalls[SYSCALL_MAX];
+static int syscall_cnt;
+static char *names[SYSCALL_MAX];
+
+// with -p the syscall table is that one process' breakdown, which has no errors or histogram
+static struct syscall_stat process_syscalls[SYSCALL_MAX];
+static int process_syscall_cnt;
+
+static struct process_stat processes[PROCESS_MAX];
+static int process_cnt;
+
+static char *read_all(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if(fd == -1) {
+		perror(path);
+		return NULL;
+	}
+
+	size_t size = 65536, length = 0;
+	char *text = malloc(size);
+
+	for(;;) {
+		if(length + 1 == size) {
+			size *= 2;
+			text = realloc(text, size);
+		}
+
+		ssize_t ret = read(fd, text + length, size - length - 1);
+		if(ret == -1) {
+			perror("read");
+			close(fd);
+			free(text);
+			return NULL;
+		}
+
+		if(ret == 0) {
+			break;
+		}
+
+		length += ret;
+	}
+
+	close(fd);
+	text[length] = '\0';
+
+	return text;
+}
+
+static uint64_t to_ns(uint64_t cycles) {
+	if(tsc_per_ms == 0) {
+		return 0;
+	}
+
+	return cycles / tsc_per_ms * 1000000 + cycles % tsc_per_ms * 1000000 / tsc_per_ms;
+}
+
+// upper bound of the bucket the given fraction of calls falls into, the last bucket is open ended
+static uint64_t percentile_ns(struct syscall_stat *stat, int permille) {
+	uint64_t target = (stat->calls * permille + 999) / 1000;
+	uint64_t seen = 0;
+
+	for(int i = 0; i < buckets - 1 && i < BUCKETS_MAX; i++) {
+		seen += stat->hist[i];
+		if(seen >= target) {
+			return to_ns(1ull << i);
+		}
+	}
+
+	return to_ns(stat->max);
+}
+
+static struct process_stat *process_get(int pid) {
+	for(int i = 0; i < process_cnt; i++) {
+		if(processes[i].pid == pid) {
+			return &processes[i];
+		}
+	}
+
+	if(process_cnt == PROCESS_MAX) {
+		return NULL;
+	}
+
+	struct process_stat *process = &processes[process_cnt++];
+	memset(process, 0, sizeof(struct process_stat));
+	process->pid = pid;
+
+	return process;
+}
+
+static void parse(char *text, int only_pid) {
+	for(char *line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+		if(strncmp(line, "sysprof ", 8) == 0) {
+			int enabled, cpus;
+			sscanf(line, "sysprof enabled %d cpus %d tsc_per_ms %lu buckets %d", &enabled, &cpus, &tsc_per_ms, &buckets);
+			printf("profiling %s, %d cpus, %lu tsc cycles/ms\n", enabled ? "on" : "off", cpus, tsc_per_ms);
+		} else if(strncmp(line, "syscall ", 8) == 0 && syscall_cnt < SYSCALL_MAX) {
+			struct syscall_stat *stat = &syscalls[syscall_cnt];
+			int consumed;
+
+			if(sscanf(line, "syscall %d %31s %lu %lu %lu %lu%n", &stat->nr, stat->name, &stat->calls, &stat->errors,
+				&stat->cycles, &stat->max, &consumed) != 6) {
+				continue;
+			}
+
+			char *rest = line + consumed;
+			for(int i = 0; i < buckets && i < BUCKETS_MAX; i++) {
+				stat->hist[i] = strtoull(rest, &rest, 10);
+			}
+
+			if(stat->nr >= 0 && stat->nr < SYSCALL_MAX) {
+				names[stat->nr] = strdup(stat->name);
+			}
+
+			syscall_cnt++;
+		} else if(strncmp(line, "pid ", 4) == 0) {
+			int pid, nr;
+			uint64_t calls, cycles;
+
+			if(sscanf(line, "pid %d %d %lu %lu", &pid, &nr, &calls, &cycles) != 4) {
+				continue;
+			}
+
+			struct process_stat *process = process_get(pid);
+			if(process == NULL) {
+				continue;
+			}
+
+			process->calls += calls;
+			process->cycles += cycles;
+
+			if(cycles > process->top_cycles) {
+				process->top_nr = nr;
+				process->top_cycles = cycles;
+			}
+
+			if(only_pid == pid && process_syscall_cnt < SYSCALL_MAX) {
+				struct syscall_stat *stat = &process_syscalls[process_syscall_cnt++];
+				memset(stat, 0, sizeof(struct syscall_stat));
+
+				stat->nr = nr;
+				stat->calls = calls;
+				stat->cycles = cycles;
+				snprintf(stat->name, sizeof(stat->name), "%s", nr < SYSCALL_MAX && names[nr] ? names[nr] : "?");
+			}
+		}
+	}
+}
+
+static int syscall_compare(const void *a, const void *b) {
+	const struct syscall_stat *x = a, *y = b;
+	return x->cycles < y->cycles ? 1 : x->cycles > y->cycles ? -1 : 0;
+}
+
+static int process_compare(const void *a, const void *b) {
+	const struct process_stat *x = a, *y = b;
+	return x->cycles < y->cycles ? 1 : x->cycles > y->cycles ? -1 : 0;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-n top] [-p pid] | on | off | reset\n", name);
+}
+
+int main(int argc, char **argv) {
+	setbuf(stdout, NULL);
+
+	if(argc == 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0 || strcmp(argv[1], "reset") == 0)) {
+		int fd = open("/dev/sysprof", O_WRONLY);
+		if(fd == -1 || write(fd, argv[1], strlen(argv[1])) == -1) {
+			perror("/dev/sysprof");
+			return 1;
+		}
+
+		close(fd);
+		return 0;
+	}
+
+	int top = 15;
+	int only_pid = -1;
+
+	int opt;
+	while((opt = getopt(argc, argv, "n:p:")) != -1) {
+		switch(opt) {
+			case 'n': top = atoi(optarg); break;
+			case 'p': only_pid = atoi(optarg); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+
+	char *text = read_all("/dev/sysprof");
+	if(text == NULL) {
+		return 1;
+	}
+
+	parse(text, only_pid);
+
+	struct syscall_stat *table = syscalls;
+	int table_cnt = syscall_cnt;
+
+	if(only_pid >= 0) {
+		table = process_syscalls;
+		table_cnt = process_syscall_cnt;
+	}
+
+	uint64_t total = 0;
+	for(int i = 0; i < table_cnt; i++) {
+		total += table[i].cycles;
+	}
+
+	qsort(table, table_cnt, sizeof(struct syscall_stat), syscall_compare);
+
+	if(only_pid >= 0) {
+		printf("\npid %d\n", only_pid);
+		printf("%-24s %10s %12s %10s %6s\n", "syscall", "calls", "total_us", "avg_ns", "time%");
+	} else {
+		printf("\n%-24s %10s %8s %12s %10s %10s %10s %10s %6s\n", "syscall", "calls", "errors", "total_us",
+			"avg_ns", "p50_ns", "p99_ns", "max_us", "time%");
+	}
+
+	for(int i = 0; i < table_cnt && i < top; i++) {
+		struct syscall_stat *stat = &table[i];
+		if(stat->calls == 0) {
+			break;
+		}
+
+		uint64_t share = total ? stat->cycles * 1000 / total : 0;
+
+		if(only_pid >= 0) {
+			printf("%-24s %10lu %12lu %10lu %4lu.%lu\n", stat->name, stat->calls, to_ns(stat->cycles) / 1000,
+				to_ns(stat->cycles / stat->calls), share / 10, share % 10);
+		} else {
+			printf("%-24s %10lu %8lu %12lu %10lu %10lu %10lu %10lu %4lu.%lu\n", stat->name, stat->calls, stat->errors,
+				to_ns(stat->cycles) / 1000, to_ns(stat->cycles / stat->calls), percentile_ns(stat, 500),
+				percentile_ns(stat, 990), to_ns(stat->max) / 1000, share / 10, share % 10);
+		}
+	}
+
+	if(only_pid >= 0) {
+		return 0;
+	}
+
+	qsort(processes, process_cnt, sizeof(struct process_stat), process_compare);
+
+	printf("\n%-8s %10s %12s %s\n", "pid", "calls", "total_us", "top syscall");
+
+	for(int i = 0; i < process_cnt && i < top; i++) {
+		struct process_stat *process = &processes[i];
+		const char *name = process->top_nr < SYSCALL_MAX && names[process->top_nr] ? names[process->top_nr] : "?";
+
+		printf("%-8d %10lu %12lu %s\n", process->pid, process->calls, to_ns(process->cycles) / 1000, name);
+	}
+
+	return 0;
+}